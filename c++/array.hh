@@ -0,0 +1,415 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+
+#include "arrow.hh"
+#include "parallel.hh"
+#include "sum.hh"
+
+using std::ptrdiff_t;
+using std::size_t;
+
+//------------------------------------------------------------------------------
+
+using byte = uint8_t;
+
+template<class T>
+inline T*
+advance(
+  T* const ptr,
+  ptrdiff_t const stride)
+{
+  return (T*) ((byte*) ptr + stride);
+}
+
+template<class T>
+inline T const*
+advance(
+  T const* const ptr,
+  ptrdiff_t const stride)
+{
+  return (T const*) ((byte const*) ptr + stride);
+}
+
+
+template<class T>
+inline T*
+index(
+  T* const ptr,
+  ptrdiff_t const stride,
+  size_t const index)
+{
+  return (T*) ((byte*) ptr + stride * index);
+}
+
+
+// Minimum number of elements per task, for parallel operations.
+size_t constexpr GRAIN = 64 * 1024;
+
+
+//------------------------------------------------------------------------------
+
+// FIXME: What should we call this?  Vector?  Seqence?  Span?
+
+template<class T>
+class Array
+{
+public:
+
+  using const_pointer = T const*;
+  using const_reference = T const&;
+  using difference_type = ptrdiff_t;
+  using pointer = T*;
+  using reference = T&;
+  using size_type = size_t;
+  using value_type = T;
+
+  Array() noexcept                          = default;
+  Array(Array const&) noexcept              = default;
+  Array(Array&&) noexcept                   = default;
+  Array& operator=(Array const&) noexcept   = default;
+  Array& operator=(Array&&) noexcept        = default;
+  ~Array() noexcept                         = default;
+
+  Array(
+    pointer const ptr, 
+    size_t const length, 
+    ptrdiff_t const stride=sizeof(T))
+    noexcept
+  : ptr_(ptr),
+    length_(length),
+    stride_(stride)
+  {
+  }
+
+  pointer ptr() noexcept { assert(ptr_ != nullptr); return ptr_; }
+  const_pointer ptr() const noexcept { assert(ptr_ != nullptr); return ptr_; }
+  size_t length() const noexcept { return length_; }
+  ptrdiff_t stride() const noexcept { return stride_; }
+
+  class iterator;
+
+  iterator begin() noexcept { return iterator(*this, 0); }
+  iterator end() noexcept { return iterator(*this, length_); }
+
+private:
+
+  pointer           ptr_    = nullptr;
+  size_type         length_ = 0;
+  difference_type   stride_ = 0;
+
+};
+
+
+template<class T>
+class Array<T>::iterator 
+{
+public:
+
+  using difference_type = Array::difference_type;
+  using pointer         = Array::pointer;
+  using reference       = Array::reference;
+  using value_type      = Array::value_type;
+
+  using iterator_category = std::random_access_iterator_tag;
+
+  iterator() = delete;  // FIXME: ??
+  iterator(iterator const&) noexcept = default;
+  iterator(iterator&&) noexcept = default;
+  iterator& operator=(iterator const&) noexcept = default;
+  iterator& operator=(iterator&&) noexcept = default;
+  ~iterator() = default;
+
+  iterator(Array& array, size_type const pos=0)
+    : array_(array), pos_(pos) { assert(pos <= array.length()); }
+
+  bool operator==(iterator const i) const noexcept
+    { return same_array(i) && i.pos_ == pos_; }
+  bool operator!=(iterator const i) const noexcept
+    { return ! operator==(i); }
+
+  iterator&         operator++() noexcept 
+    { ++pos_; return *this; }
+  iterator          operator++(int) noexcept 
+    { return iterator(array_, pos_++); }
+  iterator&         operator--() noexcept 
+    { --pos_; return *this; }
+  iterator          operator--(int) noexcept 
+    { return iterator(array_, pos_--); }
+  iterator&         operator+=(size_type const o) noexcept 
+    { pos_ += o; return *this; }
+  iterator          operator+(size_type const o) const noexcept 
+    { return iterator(array_, pos_ + o); }
+  iterator&         operator-=(size_type const o) noexcept 
+    { pos_ -= o; return *this; }
+  iterator          operator-(size_type const o) const noexcept 
+    { return iterator(array_, pos_ - o); }
+  difference_type   operator-(iterator const i) const 
+    { assert(same_array(i)); return pos_ - i.pos_; }
+
+  reference operator*() const noexcept { return *index(array_.ptr(), array_.stride(), pos_); }
+  pointer operator->() const noexcept { return index(array_.ptr(), array_.stride(), pos_); }
+  reference operator[](size_type const pos) const noexcept { return *index(array_.ptr(), array_.stride(), pos + pos_); }  // FIXME: Check length?
+
+private:
+
+  bool same_array(iterator const i) const noexcept { return &i.array_ == &array_; }
+
+  Array&    array_;
+  size_type pos_;
+
+};
+
+// FIXME: ContiguousArray, with stride=0.
+
+
+/*
+ * Returns a view of elements [start, stop) of an array.
+ */
+template<class T>
+inline Array<T>
+slice(
+  Array<T> const& arr,
+  size_t const start,
+  size_t const stop)
+{
+  assert(start <= stop && stop <= arr.length());
+  return Array<T>(
+    index(const_cast<T*>(arr.ptr()), arr.stride(), start), stop - start,
+    arr.stride());
+}
+
+
+//------------------------------------------------------------------------------
+
+template<class T>
+inline Array<T>
+alloc(
+  size_t const length)
+{
+  // FIXME: Leak.
+  return Array<T>(new T[length], length);
+}
+
+
+template<class T>
+inline void
+fill(
+  Array<T>& arr,
+  T const val)
+{
+  // FIXME: Use memset() or memset_pattern*() if appropriate?
+
+  // if (arr.length() == 0)
+  //   return;
+  // auto ptr = arr.ptr();
+  // for (size_t i = 0; i < arr.length(); ++i, ptr = advance(ptr, arr.stride()))
+  //   *ptr = val;
+
+  std::fill(arr.begin(), arr.end(), val);
+}
+
+
+template<>
+__attribute((noinline)) 
+inline void
+fill<double>(
+  Array<double>& arr,
+  double const val)
+{
+#ifdef __APPLE__
+  if (arr.stride() == sizeof(double))
+    memset_pattern8(arr.ptr(), &val, arr.length() * sizeof(double));
+  else
+#endif
+    std::fill(arr.begin(), arr.end(), val);
+}
+
+
+/*
+ * Fills in parallel on `pool`, or serially if it is null.
+ */
+template<class T>
+inline void
+fill(
+  Array<T>& arr,
+  T const val,
+  ThreadPool* const pool)
+{
+  if (pool == nullptr)
+    fill(arr, val);
+  else
+    pool->parallel_for(
+      0, arr.length(), GRAIN,
+      [&arr, val](size_t const start, size_t const stop) {
+        auto part = slice(arr, start, stop);
+        fill(part, val);
+      });
+}
+
+
+template<class T>
+inline T
+sum(
+  Array<T> const& arr,
+  T const init={})
+{
+  if (arr.length() == 0)
+    return init;
+  auto sum = init;
+  auto ptr = arr.ptr();
+  for (size_t i = 0; i < arr.length(); ++i, ptr = advance(ptr, arr.stride()))
+    sum += *ptr;
+  return sum;
+}
+
+
+/*
+ * Sums with the given summation algorithm, in parallel on `pool` or serially
+ * if it is null.  The array is summed in fixed chunks whose sums are combined
+ * in order with compensation, so the result is the same for any pool.
+ */
+template<class T>
+inline T
+sum(
+  Array<T> const& arr,
+  T const init,
+  ThreadPool* const pool,
+  Summation const summation=Summation::NAIVE)
+{
+  Compensated<T> total;
+  total.add(init);
+  return parallel_reduce(
+    pool, 0, arr.length(), GRAIN, total,
+    [&arr, summation](size_t const start, size_t const stop) {
+      auto const ptr = index(const_cast<T*>(arr.ptr()), arr.stride(), start);
+      auto const stride = arr.stride();
+      // Index contiguous values directly, so the summation lanes vectorize.
+      if (stride == sizeof(T))
+        return sum_compensated<T>(
+          summation, stop - start, [ptr](size_t const i) { return ptr[i]; });
+      else
+        return sum_compensated<T>(
+          summation, stop - start,
+          [ptr, stride](size_t const i) { return *index(ptr, stride, i); });
+    },
+    [](Compensated<T> total, Compensated<T> const& part) {
+      total.add(part);
+      return total;
+    }).get();
+}
+
+
+template<class T>
+inline T
+dot(
+  Array<T> const& arr0,
+  Array<T> const& arr1,
+  T const init={})
+{
+  auto length = arr0.length();
+  assert(arr1.length() == length);  // ??
+  if (length == 0)
+    return init;
+
+  auto dot = init;
+  auto ptr0 = arr0.ptr();
+  auto ptr1 = arr1.ptr();
+  for (size_t i = 0;
+       i < length;
+       i++, 
+         ptr0 = advance(ptr0, arr0.stride()), 
+         ptr1 = advance(ptr1, arr1.stride()))
+    dot += *ptr0 * *ptr1;
+  return dot;
+}
+
+
+/*
+ * Computes the dot product with the given summation algorithm, in parallel on
+ * `pool` or serially if it is null.  As for `sum()`, the result is the same
+ * for any pool.
+ */
+template<class T>
+inline T
+dot(
+  Array<T> const& arr0,
+  Array<T> const& arr1,
+  T const init,
+  ThreadPool* const pool,
+  Summation const summation=Summation::NAIVE)
+{
+  assert(arr1.length() == arr0.length());
+  Compensated<T> total;
+  total.add(init);
+  return parallel_reduce(
+    pool, 0, arr0.length(), GRAIN, total,
+    [&arr0, &arr1, summation](size_t const start, size_t const stop) {
+      auto const ptr0 = index(const_cast<T*>(arr0.ptr()), arr0.stride(), start);
+      auto const ptr1 = index(const_cast<T*>(arr1.ptr()), arr1.stride(), start);
+      auto const stride0 = arr0.stride();
+      auto const stride1 = arr1.stride();
+      // Index contiguous values directly, so the summation lanes vectorize.
+      if (stride0 == sizeof(T) && stride1 == sizeof(T))
+        return sum_compensated<T>(
+          summation, stop - start,
+          [ptr0, ptr1](size_t const i) { return ptr0[i] * ptr1[i]; });
+      else
+        return sum_compensated<T>(
+          summation, stop - start,
+          [=](size_t const i) {
+            return *index(ptr0, stride0, i) * *index(ptr1, stride1, i);
+          });
+    },
+    [](Compensated<T> total, Compensated<T> const& part) {
+      total.add(part);
+      return total;
+    }).get();
+}
+
+
+template<class T>
+inline std::ostream&
+operator<<(
+  std::ostream& os,
+  Array<T> const& arr)
+{
+  os << '[';
+  auto ptr = arr.ptr();
+  auto length = arr.length();
+  for (size_t i = 0; i < length; ++i, ptr = advance(ptr, arr.stride())) {
+    if (i > 0)
+      os << ',' << ' ';
+    os << *ptr;
+  }
+  os << ']';
+  return os;
+}  
+
+
+/*
+ * Exports a contiguous array as an Arrow array, without copying.  `buffer`, if
+ * not null, is kept alive until the consumer releases it; otherwise, the
+ * array's memory must outlive it.
+ */
+template<class T>
+inline void
+export_arrow(
+  Array<T> const& arr,
+  std::shared_ptr<Buffer> buffer,
+  ArrowArray* const out_array,
+  ArrowSchema* const out_schema,
+  char const* const name="")
+{
+  assert(arr.stride() == sizeof(T));
+  export_arrow<T>(
+    arr.ptr(), arr.length(), std::move(buffer), out_array, out_schema, name);
+}
+
+
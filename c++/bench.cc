@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "array.hh"
+#include "array/typed.hh"
+#include "timer.hh"
+
+using array::TypedContigArray;
+
+//------------------------------------------------------------------------------
+// Kernels, from kernels.cc, compiled with and without vectorization.
+
+#define DECLARE_KERNELS(T, SUFFIX)                                            \
+extern "C" void fill_array_ ## T ## SUFFIX(Array<T>&, T);                     \
+extern "C" T sum_array_ ## T ## SUFFIX(Array<T> const&);                      \
+extern "C" T sum_pairwise_ ## T ## SUFFIX(Array<T> const&);                   \
+extern "C" T dot_array_ ## T ## SUFFIX(Array<T> const&, Array<T> const&);     \
+extern "C" void fill_typed_ ## T ## SUFFIX(TypedContigArray<T>&, T);          \
+extern "C" T sum_typed_ ## T ## SUFFIX(TypedContigArray<T>&);                 \
+extern "C" void fill_ptr_ ## T ## SUFFIX(T*, size_t, T);                      \
+extern "C" T sum_ptr_ ## T ## SUFFIX(T const*, size_t);                       \
+extern "C" T dot_ptr_ ## T ## SUFFIX(T const*, T const*, size_t);
+
+DECLARE_KERNELS(int32_t, )
+DECLARE_KERNELS(int64_t, )
+DECLARE_KERNELS(float, )
+DECLARE_KERNELS(double, )
+DECLARE_KERNELS(int32_t, _novec)
+DECLARE_KERNELS(int64_t, _novec)
+DECLARE_KERNELS(float, _novec)
+DECLARE_KERNELS(double, _novec)
+
+/*
+ * The kernels for one dtype, with or without vectorization.
+ */
+template<class T>
+struct Kernels
+{
+  void (*fill_array)(Array<T>&, T);
+  T (*sum_array)(Array<T> const&);
+  T (*sum_pairwise)(Array<T> const&);
+  T (*dot_array)(Array<T> const&, Array<T> const&);
+  void (*fill_typed)(TypedContigArray<T>&, T);
+  T (*sum_typed)(TypedContigArray<T>&);
+  void (*fill_ptr)(T*, size_t, T);
+  T (*sum_ptr)(T const*, size_t);
+  T (*dot_ptr)(T const*, T const*, size_t);
+};
+
+#define KERNELS(T, SUFFIX)                                                    \
+  Kernels<T>{                                                                 \
+    fill_array_ ## T ## SUFFIX, sum_array_ ## T ## SUFFIX,                    \
+    sum_pairwise_ ## T ## SUFFIX, dot_array_ ## T ## SUFFIX,                  \
+    fill_typed_ ## T ## SUFFIX, sum_typed_ ## T ## SUFFIX,                    \
+    fill_ptr_ ## T ## SUFFIX, sum_ptr_ ## T ## SUFFIX,                        \
+    dot_ptr_ ## T ## SUFFIX}
+
+//------------------------------------------------------------------------------
+
+/*
+ * Returns the size in bytes of this CPU's data cache at `level`, from sysfs,
+ * or 0 if unavailable.
+ */
+inline size_t
+get_cache_size(
+  int const level)
+{
+  for (int i = 0; ; ++i) {
+    auto const dir
+      = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(i) + "/";
+    std::ifstream level_file(dir + "level");
+    if (!level_file)
+      return 0;
+    int l;
+    std::string type;
+    level_file >> l;
+    std::ifstream(dir + "type") >> type;
+    if (l == level && type != "Instruction") {
+      std::string size;
+      std::ifstream(dir + "size") >> size;
+      size_t const scale
+        = size.back() == 'K' ? 1 << 10 : size.back() == 'M' ? 1 << 20 : 1;
+      return std::stoul(size) * scale;
+    }
+  }
+}
+
+
+template<class T>
+inline T
+median(
+  std::vector<T> vals)
+{
+  std::sort(vals.begin(), vals.end());
+  auto const n = vals.size();
+  return n % 2 == 1 ? vals[n / 2] : (vals[n / 2 - 1] + vals[n / 2]) / 2;
+}
+
+
+// Kernel results are accumulated here so they aren't optimized away.
+double volatile sink;
+
+// Minimum bytes to touch per timed sample, so small sizes aren't all timer.
+size_t constexpr MIN_SAMPLE_BYTES = 64 << 20;
+
+/*
+ * Returns the median time of `repeat` samples of `fn()`, each sample running
+ * it enough times to touch at least `MIN_SAMPLE_BYTES`.
+ */
+template<class FN>
+inline double
+time_kernel(
+  size_t const bytes,
+  size_t const repeat,
+  FN&& fn)
+{
+  size_t const count = std::max<size_t>(1, MIN_SAMPLE_BYTES / bytes);
+  // Untimed run, to warm the cache.
+  fn();
+
+  std::vector<double> elapsed;
+  for (size_t r = 0; r < repeat; ++r) {
+    auto const start = now();
+    for (size_t i = 0; i < count; ++i)
+      fn();
+    elapsed.push_back((now() - start) / count);
+  }
+  return median(elapsed);
+}
+
+
+//------------------------------------------------------------------------------
+
+struct Config
+{
+  size_t repeat;
+  // Theoretical peak memory bandwidth, in GB/s, or 0 if unknown.
+  double peak_gb_per_s;
+};
+
+
+/*
+ * Times a kernel with and without vectorization, and prints one JSON line.
+ * `bytes` is the number of bytes the kernel reads or writes.
+ */
+template<class VEC, class NOVEC>
+inline void
+bench(
+  Config const& config,
+  char const* const kernel_name,
+  char const* const dtype,
+  char const* const level,
+  size_t const stride,
+  size_t const length,
+  size_t const bytes,
+  VEC&& vec,
+  NOVEC&& novec)
+{
+  auto const vec_s = time_kernel(bytes, config.repeat, vec);
+  auto const novec_s = time_kernel(bytes, config.repeat, novec);
+  auto const gb_per_s = bytes / vec_s * 1E-9;
+
+  std::cout
+    << "{\"kernel\": \"" << kernel_name << "\""
+    << ", \"dtype\": \"" << dtype << "\""
+    << ", \"level\": \"" << level << "\""
+    << ", \"stride\": " << stride
+    << ", \"length\": " << length
+    << ", \"bytes\": " << bytes
+    << ", \"runs\": " << config.repeat
+    << ", \"median_s\": " << vec_s
+    << ", \"ns_per_elem\": " << vec_s / length * 1E+9
+    << ", \"gb_per_s\": " << gb_per_s
+    << ", \"peak_fraction\": ";
+  if (config.peak_gb_per_s > 0)
+    std::cout << gb_per_s / config.peak_gb_per_s;
+  else
+    std::cout << "null";
+  std::cout
+    << ", \"novec_gb_per_s\": " << bytes / novec_s * 1E-9
+    << ", \"vec_speedup\": " << novec_s / vec_s
+    << "}" << std::endl;
+}
+
+
+/*
+ * Benchmarks all kernels for dtype T, on arrays whose footprint is about
+ * `size` bytes.
+ */
+template<class T>
+void
+bench_dtype(
+  Config const& config,
+  char const* const dtype,
+  Kernels<T> const& vec,
+  Kernels<T> const& novec,
+  char const* const level,
+  size_t const size)
+{
+  size_t const n = size / sizeof(T);
+  std::vector<T> buf0(n, T{1});
+  std::vector<T> buf1(n, T{2});
+  T* const ptr0 = buf0.data();
+  T* const ptr1 = buf1.data();
+  size_t const bytes = n * sizeof(T);
+
+  // Plain pointer loops.
+  bench(
+    config, "fill_ptr", dtype, level, 1, n, bytes,
+    [&] { vec.fill_ptr(ptr0, n, T{1}); },
+    [&] { novec.fill_ptr(ptr0, n, T{1}); });
+  bench(
+    config, "sum_ptr", dtype, level, 1, n, bytes,
+    [&] { sink = sink + vec.sum_ptr(ptr0, n); },
+    [&] { sink = sink + novec.sum_ptr(ptr0, n); });
+  bench(
+    config, "dot_ptr", dtype, level, 1, n, 2 * bytes,
+    [&] { sink = sink + vec.dot_ptr(ptr0, ptr1, n); },
+    [&] { sink = sink + novec.dot_ptr(ptr0, ptr1, n); });
+
+  // TypedContigArray iterators.
+  TypedContigArray<T> typed(reinterpret_cast<array::byte_t*>(ptr0), n);
+  bench(
+    config, "fill_typed", dtype, level, 1, n, bytes,
+    [&] { vec.fill_typed(typed, T{1}); },
+    [&] { novec.fill_typed(typed, T{1}); });
+  bench(
+    config, "sum_typed", dtype, level, 1, n, bytes,
+    [&] { sink = sink + vec.sum_typed(typed); },
+    [&] { sink = sink + novec.sum_typed(typed); });
+
+  // Array kernels, over the same footprint at each stride, so the number of
+  // elements shrinks as the stride grows.
+  for (size_t const stride : {1, 2, 4}) {
+    auto const len = n / stride;
+    auto const b = len * sizeof(T);
+    Array<T> arr0(ptr0, len, stride * sizeof(T));
+    Array<T> arr1(ptr1, len, stride * sizeof(T));
+    bench(
+      config, "fill", dtype, level, stride, len, b,
+      [&] { vec.fill_array(arr0, T{1}); },
+      [&] { novec.fill_array(arr0, T{1}); });
+    bench(
+      config, "sum", dtype, level, stride, len, b,
+      [&] { sink = sink + vec.sum_array(arr0); },
+      [&] { sink = sink + novec.sum_array(arr0); });
+    bench(
+      config, "sum_pairwise", dtype, level, stride, len, b,
+      [&] { sink = sink + vec.sum_pairwise(arr0); },
+      [&] { sink = sink + novec.sum_pairwise(arr0); });
+    bench(
+      config, "dot", dtype, level, stride, len, 2 * b,
+      [&] { sink = sink + vec.dot_array(arr0, arr1); },
+      [&] { sink = sink + novec.dot_array(arr0, arr1); });
+  }
+}
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Benchmarks array kernels over dtypes, strides, and sizes resident in each
+ * level of the memory hierarchy, with and without vectorization, and prints
+ * results as JSON lines.
+ *
+ * Bandwidth is the bytes of elements read or written per second; for strided
+ * arrays, the memory traffic is higher.  If PEAK_GBS, the machine's
+ * theoretical memory bandwidth, is given, reports bandwidth as a fraction of
+ * it.
+ */
+int
+main(
+  int const argc,
+  char const* const* const argv)
+{
+  if (argc < 2 || argc > 3) {
+    std::cerr << "usage: " << argv[0] << " REPEAT [PEAK_GBS]\n";
+    return 2;
+  }
+  Config const config{
+    (size_t) atol(argv[1]),
+    argc < 3 ? 0 : atof(argv[2]),
+  };
+  assert(config.repeat > 0);
+
+  // Size each working set to half of its cache level, and DRAM to well past
+  // the last level.
+  auto const l1 = get_cache_size(1);
+  auto const l2 = get_cache_size(2);
+  auto const llc = std::max(get_cache_size(3), l2);
+  struct Level { char const* name; size_t size; };
+  std::vector<Level> levels;
+  if (l1 > 0)
+    levels.push_back({"L1", l1 / 2});
+  if (l2 > 0)
+    levels.push_back({"L2", l2 / 2});
+  if (llc > l2)
+    levels.push_back({"LLC", llc / 2});
+  levels.push_back({"DRAM", std::max<size_t>(4 * llc, 256 << 20)});
+
+  for (auto const& level : levels) {
+    bench_dtype(
+      config, "int32", KERNELS(int32_t, ), KERNELS(int32_t, _novec),
+      level.name, level.size);
+    bench_dtype(
+      config, "int64", KERNELS(int64_t, ), KERNELS(int64_t, _novec),
+      level.name, level.size);
+    bench_dtype(
+      config, "float32", KERNELS(float, ), KERNELS(float, _novec),
+      level.name, level.size);
+    bench_dtype(
+      config, "float64", KERNELS(double, ), KERNELS(double, _novec),
+      level.name, level.size);
+  }
+
+  return 0;
+}
+
+
@@ -0,0 +1,100 @@
+/*
+ * Out-of-line instances of the array kernels, for benchmarking and for
+ * inspecting generated code.
+ *
+ * This file is compiled twice: normally, and with auto-vectorization disabled
+ * and KERNEL_SUFFIX defined as `_novec`, so the benchmark can measure what
+ * vectorization is worth for each kernel.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+#include "array.hh"
+#include "array/typed.hh"
+
+#ifndef KERNEL_SUFFIX
+#define KERNEL_SUFFIX
+#endif
+
+#define KERNEL_CONCAT_(NAME, SUFFIX) NAME ## SUFFIX
+#define KERNEL_CONCAT(NAME, SUFFIX) KERNEL_CONCAT_(NAME, SUFFIX)
+#define KERNEL(NAME) KERNEL_CONCAT(NAME, KERNEL_SUFFIX)
+
+using array::TypedContigArray;
+
+//------------------------------------------------------------------------------
+
+#define DEFINE_KERNELS(T)                                                     \
+                                                                              \
+extern "C" __attribute((noinline)) void                                       \
+KERNEL(fill_array_ ## T)(Array<T>& arr, T const val)                          \
+{                                                                             \
+  fill(arr, val);                                                             \
+}                                                                             \
+                                                                              \
+extern "C" __attribute((noinline)) T                                          \
+KERNEL(sum_array_ ## T)(Array<T> const& arr)                                  \
+{                                                                             \
+  return sum(arr);                                                            \
+}                                                                             \
+                                                                              \
+extern "C" __attribute((noinline)) T                                          \
+KERNEL(sum_pairwise_ ## T)(Array<T> const& arr)                               \
+{                                                                             \
+  return sum(arr, T{0}, nullptr, Summation::PAIRWISE);                        \
+}                                                                             \
+                                                                              \
+extern "C" __attribute((noinline)) T                                          \
+KERNEL(dot_array_ ## T)(Array<T> const& arr0, Array<T> const& arr1)           \
+{                                                                             \
+  return dot(arr0, arr1);                                                     \
+}                                                                             \
+                                                                              \
+extern "C" __attribute((noinline)) void                                       \
+KERNEL(fill_typed_ ## T)(TypedContigArray<T>& arr, T const val)               \
+{                                                                             \
+  for (auto& i : arr)                                                         \
+    i = val;                                                                  \
+}                                                                             \
+                                                                              \
+extern "C" __attribute((noinline)) T                                          \
+KERNEL(sum_typed_ ## T)(TypedContigArray<T>& arr)                             \
+{                                                                             \
+  T sum = 0;                                                                  \
+  for (auto& i : arr)                                                         \
+    sum += i;                                                                 \
+  return sum;                                                                 \
+}                                                                             \
+                                                                              \
+extern "C" __attribute((noinline)) void                                       \
+KERNEL(fill_ptr_ ## T)(T* const ptr, size_t const length, T const val)        \
+{                                                                             \
+  for (size_t i = 0; i < length; ++i)                                         \
+    ptr[i] = val;                                                             \
+}                                                                             \
+                                                                              \
+extern "C" __attribute((noinline)) T                                          \
+KERNEL(sum_ptr_ ## T)(T const* const ptr, size_t const length)                \
+{                                                                             \
+  T sum = 0;                                                                  \
+  for (size_t i = 0; i < length; ++i)                                         \
+    sum += ptr[i];                                                            \
+  return sum;                                                                 \
+}                                                                             \
+                                                                              \
+extern "C" __attribute((noinline)) T                                          \
+KERNEL(dot_ptr_ ## T)(                                                        \
+  T const* const ptr0, T const* const ptr1, size_t const length)              \
+{                                                                             \
+  T dot = 0;                                                                  \
+  for (size_t i = 0; i < length; ++i)                                         \
+    dot += ptr0[i] * ptr1[i];                                                 \
+  return dot;                                                                 \
+}
+
+DEFINE_KERNELS(int32_t)
+DEFINE_KERNELS(int64_t)
+DEFINE_KERNELS(float)
+DEFINE_KERNELS(double)
+
@@ -0,0 +1,50 @@
+#include <iostream>
+#include <random>
+
+#include "rec.hh"
+#include "timer.hh"
+#include "writer.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * Appends random orders to a file, to measure write throughput.
+ */
+int
+main(
+  int const argc,
+  char const* const* const argv)
+{
+  if (argc < 3 || argc > 5) {
+    std::cerr << "usage: " << argv[0]
+              << " FILENAME COUNT [SYNC_RECORDS [SYNC_USEC]]\n";
+    return 2;
+  }
+  size_t const count = atol(argv[2]);
+  WriterOptions options;
+  options.sync_records = argc >= 4 ? atol(argv[3]) : 0;
+  options.sync_usec = argc >= 5 ? atol(argv[4]) : 0;
+  options.publish = true;
+
+  std::mt19937_64 gen;
+  std::uniform_int_distribution<Sid> sids(1000000, 2000000);
+  std::uniform_int_distribution<Size> sizes(-5, 5);
+  std::uniform_real_distribution<Price> prices(10, 400);
+
+  auto const start = now();
+  RecordWriter<Order> writer(argv[1], options);
+  Timestamp timestamp = start * 1E+9;
+  for (size_t i = 0; i < count; ++i) {
+    timestamp += gen() % 10000;
+    writer.append({timestamp, sids(gen), sizes(gen) * 100, prices(gen), 0});
+  }
+  writer.commit();
+  auto const elapsed = now() - start;
+
+  std::cout << "length = " << writer.length() << "\n";
+  std::cerr << "elapsed: " << elapsed << " = "
+            << count / elapsed / 1E+6 << " M rec/s\n";
+
+  return 0;
+}
+
@@ -0,0 +1,97 @@
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+
+#include "async.hh"
+#include "dataset.hh"
+#include "instrument.hh"
+#include "parallel.hh"
+#include "reader.hh"
+#include "rec.hh"
+#include "stats.hh"
+#include "timer.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * Scans a dataset of orders for total volume and stats by instrument, first
+ * with a thread pool, mapping a partition per thread at a time, then with a
+ * coroutine per partition.  Prints the results and elapsed times, which should
+ * agree and, for files not in the page cache, differ.
+ */
+int
+main(
+  int const argc,
+  char const* const* const argv)
+{
+  if (!(argc == 2 || argc == 3 || (argc >= 5 && argc <= 8))) {
+    std::cerr << "usage: " << argv[0]
+              << " DIR [BUCKETS [START_DATE END_DATE"
+              << " [THREADS [IO_THREADS [MAX_OPEN]]]]]\n";
+    return 2;
+  }
+
+  Dataset<Order> const dataset(argv[1], argc >= 3 ? atol(argv[2]) : 1);
+  // The date range is inclusive.
+  Timestamp const start
+    = argc >= 5 ? get_day_of_date(atol(argv[3])) * NS_PER_DAY : 0;
+  Timestamp const end
+    = argc >= 5 ? (get_day_of_date(atol(argv[4])) + 1) * NS_PER_DAY
+    : UINT64_MAX;
+  size_t const num_threads = argc >= 6 ? atol(argv[5]) : 0;
+  size_t const num_io_threads = argc >= 7 ? atol(argv[6]) : 8;
+  size_t const max_open = argc >= 8 ? atol(argv[7]) : 64;
+
+  std::cout << "partitions = " << dataset.select(start, end).size()
+            << " of " << dataset.partitions().size() << "\n";
+
+  auto const get_volume
+    = [](RecordBatch<Order> const& batch) { return get_total_volume(batch); };
+  auto const add = [](uint64_t const v0, uint64_t const v1) { return v0 + v1; };
+  auto const get_stats
+    = [](RecordBatch<Order> const& batch) { return get_order_stats(batch); };
+  auto const merge_stats = [](
+    std::map<Sid, OrderStats> stats, std::map<Sid, OrderStats> const& later) {
+    merge(stats, later);
+    return stats;
+  };
+
+  {
+    ThreadPool pool(num_threads);
+    auto t = now();
+    auto const volume
+      = scan(dataset, start, end, &pool, uint64_t{0}, get_volume, add);
+    auto const stats = scan(
+      dataset, start, end, &pool, std::map<Sid, OrderStats>{}, get_stats,
+      merge_stats);
+    t = now() - t;
+    std::cout << "pool: total volume = " << volume
+              << " instruments = " << stats.size()
+              << " elapsed = " << t << " s\n";
+  }
+
+  {
+    async::Scheduler scheduler(num_threads);
+    async::IoPool io(num_io_threads);
+    auto t = now();
+    auto const volume = async::scan(
+      dataset, start, end, scheduler, io, uint64_t{0}, get_volume, add,
+      max_open);
+    auto const stats = async::scan(
+      dataset, start, end, scheduler, io, std::map<Sid, OrderStats>{},
+      get_stats, merge_stats, max_open);
+    t = now() - t;
+    std::cout << "async: total volume = " << volume
+              << " instruments = " << stats.size()
+              << " elapsed = " << t << " s\n";
+  }
+
+#ifdef INSTRUMENT
+  std::cerr << get_instrument_totals();
+#endif
+
+  return 0;
+}
+
@@ -0,0 +1,907 @@
+#pragma once
+
+/*
+ * Asynchronous scans of datasets, with C++20 coroutines.
+ *
+ * Each partition is scanned by a coroutine, which reads its file in blocks,
+ * and suspends while the next block is being read instead of blocking its
+ * thread.  A `Scheduler` runs coroutines that are ready on a few threads, and
+ * an `IoPool` does the reads, so that many files can be scanned at once on
+ * fewer threads than files.
+ *
+ * This header requires C++20; the rest of the store builds as C++14.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <system_error>
+#include <sys/types.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "dataset.hh"
+#include "instrument.hh"
+#include "reader.hh"
+#include "recfile.hh"
+#include "rec.hh"
+
+namespace async {
+
+//------------------------------------------------------------------------------
+
+/*
+ * Runs coroutines that are ready to run, on a fixed set of threads.
+ */
+class Scheduler
+{
+public:
+
+  Scheduler(
+    size_t num_threads=0)
+  {
+    if (num_threads == 0)
+      num_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < num_threads; ++i)
+      threads_.emplace_back(&Scheduler::work, this);
+  }
+
+  Scheduler(Scheduler const&) = delete;
+  Scheduler& operator=(Scheduler const&) = delete;
+
+  ~Scheduler()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& thread : threads_)
+      thread.join();
+  }
+
+  size_t num_threads() const { return threads_.size(); }
+
+  /*
+   * Queues `handle` to be resumed on one of the scheduler's threads.
+   */
+  void
+  post(
+    std::coroutine_handle<> const handle)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ready_.push_back(handle);
+    }
+    cv_.notify_one();
+  }
+
+private:
+
+  void
+  work()
+  {
+    for (;;) {
+      std::coroutine_handle<> handle;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return stop_ || !ready_.empty(); });
+        if (ready_.empty())
+          return;
+        handle = ready_.front();
+        ready_.pop_front();
+      }
+      handle.resume();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::coroutine_handle<>> ready_;
+  bool stop_ = false;
+  std::vector<std::thread> threads_;
+
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * A lazily started coroutine that produces a T.  Awaiting the task runs it;
+ * when it finishes, the awaiting coroutine resumes on the same thread.  If
+ * the coroutine throws, awaiting it rethrows.
+ */
+template<class T>
+class Task
+{
+public:
+
+  struct promise_type
+  {
+    std::optional<T> result;
+    std::exception_ptr exception;
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+
+    Task get_return_object() { return Task(Handle::from_promise(*this)); }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    auto
+    final_suspend()
+      noexcept
+    {
+      struct Final
+      {
+        bool await_ready() noexcept { return false; }
+
+        std::coroutine_handle<>
+        await_suspend(
+          Handle const handle)
+          noexcept
+        {
+          return handle.promise().continuation;
+        }
+
+        void await_resume() noexcept {}
+      };
+      return Final{};
+    }
+
+    void return_value(T value) { result.emplace(std::move(value)); }
+    void unhandled_exception() { exception = std::current_exception(); }
+  };
+
+  using Handle = std::coroutine_handle<promise_type>;
+
+  Task(Task const&) = delete;
+  Task(Task&& task) : handle_(std::exchange(task.handle_, nullptr)) {}
+
+  ~Task()
+  {
+    if (handle_)
+      handle_.destroy();
+  }
+
+  auto
+  operator co_await()
+    noexcept
+  {
+    struct Awaiter
+    {
+      Handle handle;
+
+      bool await_ready() noexcept { return false; }
+
+      std::coroutine_handle<>
+      await_suspend(
+        std::coroutine_handle<> const continuation)
+        noexcept
+      {
+        handle.promise().continuation = continuation;
+        return handle;
+      }
+
+      T
+      await_resume()
+      {
+        auto& promise = handle.promise();
+        if (promise.exception)
+          std::rethrow_exception(promise.exception);
+        return std::move(*promise.result);
+      }
+    };
+    return Awaiter{handle_};
+  }
+
+private:
+
+  explicit Task(Handle const handle) : handle_(handle) {}
+
+  Handle handle_;
+
+};
+
+
+namespace detail {
+
+/*
+ * A coroutine that starts when posted to a scheduler and destroys itself
+ * when it finishes.
+ */
+struct Detached
+{
+  struct promise_type
+  {
+    Detached
+    get_return_object()
+    {
+      return {std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+
+/*
+ * Resumes a coroutine on a scheduler after `count` calls to `count_down()`.
+ */
+class Latch
+{
+public:
+
+  Latch(
+    Scheduler& scheduler,
+    size_t const count)
+  : scheduler_(scheduler),
+    // The awaiter counts down too, once it has stored its handle.
+    count_(count + 1)
+  {
+  }
+
+  void
+  count_down()
+  {
+    if (count_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      scheduler_.post(continuation_);
+  }
+
+  bool await_ready() noexcept { return false; }
+
+  bool
+  await_suspend(
+    std::coroutine_handle<> const continuation)
+    noexcept
+  {
+    continuation_ = continuation;
+    return count_.fetch_sub(1, std::memory_order_acq_rel) > 1;
+  }
+
+  void await_resume() noexcept {}
+
+private:
+
+  Scheduler& scheduler_;
+  std::atomic<size_t> count_;
+  std::coroutine_handle<> continuation_;
+
+};
+
+
+template<class T>
+Detached
+await_into(
+  Task<T>& task,
+  std::optional<T>& result,
+  std::exception_ptr& exception,
+  Latch& latch)
+{
+  try {
+    result.emplace(co_await task);
+  }
+  catch (...) {
+    exception = std::current_exception();
+  }
+  latch.count_down();
+}
+
+
+/*
+ * A flag a thread outside the scheduler can wait on.
+ */
+struct Event
+{
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool done = false;
+};
+
+
+template<class T>
+Detached
+await_and_notify(
+  Task<T>& task,
+  std::optional<T>& result,
+  std::exception_ptr& exception,
+  Event& event)
+{
+  try {
+    result.emplace(co_await task);
+  }
+  catch (...) {
+    exception = std::current_exception();
+  }
+  // Notify under the lock: once it is released, the waiter may return and
+  // destroy the event.
+  std::lock_guard<std::mutex> lock(event.mutex);
+  event.done = true;
+  event.cv.notify_one();
+}
+
+}  // namespace detail
+
+
+/*
+ * Runs `tasks` concurrently on `scheduler`, and produces their results, in
+ * the same order.  If any throw, rethrows the first one's exception, once all
+ * have finished.
+ */
+template<class T>
+Task<std::vector<T>>
+when_all(
+  Scheduler& scheduler,
+  std::vector<Task<T>> tasks)
+{
+  std::vector<std::optional<T>> results(tasks.size());
+  std::vector<std::exception_ptr> exceptions(tasks.size());
+  detail::Latch latch(scheduler, tasks.size());
+  for (size_t i = 0; i < tasks.size(); ++i)
+    scheduler.post(
+      detail::await_into(tasks[i], results[i], exceptions[i], latch).handle);
+  co_await latch;
+
+  for (auto const& exception : exceptions)
+    if (exception)
+      std::rethrow_exception(exception);
+  std::vector<T> values;
+  values.reserve(results.size());
+  for (auto& result : results)
+    values.push_back(std::move(*result));
+  co_return values;
+}
+
+
+/*
+ * Runs `task` on `scheduler`, blocking the calling thread, which must not be
+ * one of the scheduler's, until it finishes.  Rethrows if the task throws.
+ */
+template<class T>
+T
+run(
+  Scheduler& scheduler,
+  Task<T> task)
+{
+  std::optional<T> result;
+  std::exception_ptr exception;
+  detail::Event event;
+  scheduler.post(
+    detail::await_and_notify(task, result, exception, event).handle);
+  {
+    std::unique_lock<std::mutex> lock(event.mutex);
+    event.cv.wait(lock, [&] { return event.done; });
+  }
+  if (exception)
+    std::rethrow_exception(exception);
+  return std::move(*result);
+}
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Limits the number of coroutines in a section at once.  A coroutine that
+ * can't enter suspends, and is resumed on the scheduler when another leaves.
+ */
+class Semaphore
+{
+public:
+
+  Semaphore(
+    Scheduler& scheduler,
+    size_t const count)
+  : scheduler_(scheduler),
+    count_(count)
+  {
+    assert(count_ > 0);
+  }
+
+  auto
+  acquire()
+  {
+    struct Acquire
+    {
+      Semaphore& semaphore;
+
+      bool await_ready() noexcept { return false; }
+
+      bool
+      await_suspend(
+        std::coroutine_handle<> const handle)
+      {
+        std::lock_guard<std::mutex> lock(semaphore.mutex_);
+        if (semaphore.count_ > 0) {
+          --semaphore.count_;
+          return false;
+        }
+        semaphore.waiters_.push_back(handle);
+        return true;
+      }
+
+      void await_resume() noexcept {}
+    };
+    return Acquire{*this};
+  }
+
+  void
+  release()
+  {
+    std::coroutine_handle<> handle;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (waiters_.empty()) {
+        ++count_;
+        return;
+      }
+      // Hand our count directly to the next waiter.
+      handle = waiters_.front();
+      waiters_.pop_front();
+    }
+    scheduler_.post(handle);
+  }
+
+private:
+
+  Scheduler& scheduler_;
+  std::mutex mutex_;
+  size_t count_;
+  std::deque<std::coroutine_handle<>> waiters_;
+
+};
+
+
+//------------------------------------------------------------------------------
+
+class Read;
+
+/*
+ * Threads that do blocking reads for coroutines.  When a read completes, the
+ * coroutine awaiting it is resumed on its scheduler.
+ */
+class IoPool
+{
+public:
+
+  IoPool(
+    size_t const num_threads=4)
+  {
+    assert(num_threads > 0);
+    for (size_t i = 0; i < num_threads; ++i)
+      threads_.emplace_back(&IoPool::work, this);
+  }
+
+  IoPool(IoPool const&) = delete;
+  IoPool& operator=(IoPool const&) = delete;
+
+  ~IoPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& thread : threads_)
+      thread.join();
+  }
+
+private:
+
+  friend class Read;
+
+  void
+  submit(
+    Read* const read)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      reads_.push_back(read);
+    }
+    cv_.notify_one();
+  }
+
+  inline void work();
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Read*> reads_;
+  bool stop_ = false;
+  std::vector<std::thread> threads_;
+
+};
+
+
+/*
+ * A read of `size` bytes at `offset` of `fd`.  The read is submitted when
+ * constructed, so it proceeds while the coroutine does other work; awaiting it
+ * suspends until it completes, and produces the number of bytes read, fewer
+ * at the end of the file, or -errno if it fails.
+ *
+ * A read may not be destroyed until it has been awaited.
+ */
+class Read
+{
+public:
+
+  Read(
+    IoPool& io,
+    Scheduler& scheduler,
+    int const fd,
+    void* const buf,
+    size_t const size,
+    off_t const offset)
+  : scheduler_(scheduler),
+    fd_(fd),
+    buf_(buf),
+    size_(size),
+    offset_(offset)
+  {
+    io.submit(this);
+  }
+
+  Read(Read const&) = delete;
+  Read& operator=(Read const&) = delete;
+
+  auto
+  operator co_await()
+    noexcept
+  {
+    struct Awaiter
+    {
+      Read& read;
+
+      bool
+      await_ready()
+        const noexcept
+      {
+        return read.state_.load(std::memory_order_acquire) == DONE;
+      }
+
+      bool
+      await_suspend(
+        std::coroutine_handle<> const handle)
+        noexcept
+      {
+        read.handle_ = handle;
+        auto state = PENDING;
+        // If the read completed in the meantime, don't suspend.
+        return read.state_.compare_exchange_strong(
+          state, WAITING, std::memory_order_acq_rel);
+      }
+
+      ssize_t await_resume() const noexcept { return read.result_; }
+    };
+    return Awaiter{*this};
+  }
+
+private:
+
+  friend class IoPool;
+
+  enum State { PENDING, WAITING, DONE };
+
+  void
+  run()
+  {
+    ssize_t done = 0;
+    while ((size_t) done < size_) {
+      auto const n = pread(
+        fd_, (char*) buf_ + done, size_ - done, offset_ + done);
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n <= 0) {
+        if (n == -1)
+          done = -errno;
+        break;
+      }
+      done += n;
+    }
+    result_ = done;
+
+    if (state_.exchange(DONE, std::memory_order_acq_rel) == WAITING)
+      scheduler_.post(handle_);
+  }
+
+  Scheduler& scheduler_;
+  int const fd_;
+  void* const buf_;
+  size_t const size_;
+  off_t const offset_;
+  ssize_t result_ = 0;
+  std::atomic<State> state_{PENDING};
+  std::coroutine_handle<> handle_;
+
+};
+
+
+inline void
+IoPool::work()
+{
+  for (;;) {
+    Read* read;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return stop_ || !reads_.empty(); });
+      if (reads_.empty())
+        return;
+      read = reads_.front();
+      reads_.pop_front();
+    }
+    read->run();
+  }
+}
+
+
+//------------------------------------------------------------------------------
+
+// Bytes per block read by a partition scan.
+size_t constexpr SCAN_BLOCK_SIZE = 1 << 20;
+
+/*
+ * Throws if a read of `size` bytes of `partition` failed or was short.
+ */
+inline void
+check_read(
+  Partition const& partition,
+  size_t const size,
+  ssize_t const n)
+{
+  if (n < 0)
+    throw std::system_error(-n, std::generic_category(), partition.filename);
+  if ((size_t) n < size)
+    throw std::runtime_error(partition.filename + ": file truncated");
+}
+
+
+namespace detail {
+
+/*
+ * A partition file open for a scan, and the permit to open it.  Closes the
+ * file and releases the permit when destroyed, including when the scan
+ * throws.
+ */
+class OpenFile
+{
+public:
+
+  OpenFile(
+    Semaphore& permits)
+  : permits_(permits)
+  {
+  }
+
+  OpenFile(OpenFile const&) = delete;
+  OpenFile& operator=(OpenFile const&) = delete;
+
+  ~OpenFile()
+  {
+    if (fd != -1)
+      close(fd);
+    permits_.release();
+  }
+
+  int fd = -1;
+
+private:
+
+  Semaphore& permits_;
+
+};
+
+}  // namespace detail
+
+
+/*
+ * Returns the records of REC in `fd` of `partition`: their offset and length.
+ * For a record file, reads and checks the header, and throws
+ * `std::runtime_error` if it is not valid.
+ */
+template<class REC>
+Task<std::pair<off_t, size_t>>
+get_record_range(
+  IoPool& io,
+  Scheduler& scheduler,
+  Partition const& partition,
+  int const fd)
+{
+  struct stat file_info;
+  if (fstat(fd, &file_info) == -1)
+    throw std::system_error(errno, std::generic_category(), partition.filename);
+  size_t const size = file_info.st_size;
+  if (!partition.recfile)
+    co_return std::make_pair(off_t{0}, size / sizeof(REC));
+
+  FileHeader header{};
+  if (size >= sizeof(header))
+    check_read(
+      partition, sizeof(header),
+      co_await Read(io, scheduler, fd, &header, sizeof(header), 0));
+  // Read the whole header, but at least as much as check_header() examines
+  // before it checks the header size.
+  std::vector<char> buf(std::min<size_t>(
+    std::max<size_t>(header.header_size, sizeof(header)), size));
+  check_read(
+    partition, buf.size(),
+    co_await Read(io, scheduler, fd, buf.data(), buf.size(), 0));
+  auto const error = check_header(buf.data(), size);
+  if (error != nullptr)
+    throw std::runtime_error(partition.filename + ": " + error);
+  if (header.record_size != sizeof(REC))
+    throw std::runtime_error(partition.filename + ": wrong record size");
+  co_return std::make_pair((off_t) header.header_size, (size_t) header.length);
+}
+
+
+/*
+ * Scans the records of `partition` in [start, end), like `scan_partition()`,
+ * but reads the file in blocks instead of mapping it.  Computes `map(batch)`
+ * for each block and folds the results with `combine`, starting with `init`.
+ *
+ * The next block is read while the current one is scanned.  The scan suspends
+ * only while waiting for a block.
+ *
+ * Throws `std::system_error` if the file can't be opened or read, and
+ * `std::runtime_error` if it isn't valid.  Exceptions from `map` and `combine`
+ * propagate too.
+ */
+template<class REC, class T, class MAP, class COMBINE>
+Task<T>
+scan_partition(
+  IoPool& io,
+  Scheduler& scheduler,
+  Semaphore& open_files,
+  Partition const& partition,
+  Timestamp const start,
+  Timestamp const end,
+  T init,
+  MAP const& map,
+  COMBINE const& combine)
+{
+  co_await open_files.acquire();
+  detail::OpenFile file(open_files);
+  file.fd = [&] {
+    INSTRUMENT_STAGE(OPEN);
+    return open(partition.filename.c_str(), O_RDONLY);
+  }();
+  if (file.fd == -1)
+    throw std::system_error(errno, std::generic_category(), partition.filename);
+  auto const fd = file.fd;
+  auto const range
+    = co_await get_record_range<REC>(io, scheduler, partition, fd);
+  auto const offset = range.first;
+  auto const length = range.second;
+
+  size_t const block_length
+    = std::max<size_t>(SCAN_BLOCK_SIZE / sizeof(REC), 1);
+  size_t const num_blocks = (length + block_length - 1) / block_length;
+  std::unique_ptr<REC[]> bufs[2];
+  // Reads issued and not yet awaited.
+  std::optional<Read> reads[2];
+  auto const issue = [&](size_t const b) {
+    auto& buf = bufs[b % 2];
+    if (!buf)
+      buf.reset(new REC[block_length]);
+    auto const len = std::min(block_length, length - b * block_length);
+    reads[b % 2].emplace(
+      io, scheduler, fd, buf.get(), len * sizeof(REC),
+      offset + b * block_length * sizeof(REC));
+  };
+
+  auto result = std::move(init);
+  std::exception_ptr exception;
+  try {
+    if (num_blocks > 0)
+      issue(0);
+    for (size_t b = 0; b < num_blocks; ++b) {
+      auto const n = co_await *reads[b % 2];
+      reads[b % 2].reset();
+      auto const len = std::min(block_length, length - b * block_length);
+      check_read(partition, len * sizeof(REC), n);
+      RecordBatch<REC> const block(bufs[b % 2].get(), len);
+
+      // Stop at the end of the range, but only after the read in flight, if
+      // any, completes.
+      bool const last
+        = b + 1 == num_blocks
+          || (partition.end() > end && block.get(len - 1).timestamp >= end);
+      if (!last)
+        issue(b + 1);
+
+      if (partition.start() < start && block.get(len - 1).timestamp < start)
+        // Entirely before the range.
+        INSTRUMENT_COUNT(BLOCKS_SKIPPED, 1);
+      else {
+        auto const i0
+          = start <= partition.start() ? 0
+          : lower_bound_timestamp(block, start, 0, len);
+        auto const i1
+          = partition.end() <= end ? len
+          : lower_bound_timestamp(block, end, i0, len);
+        result = combine(std::move(result), map(get_batch(block, i0, i1)));
+      }
+
+      if (last)
+        break;
+    }
+  }
+  catch (...) {
+    exception = std::current_exception();
+  }
+
+  if (exception) {
+    // A read in flight still fills its buffer and resumes this coroutine, so
+    // await it before the frame, and the buffer, are destroyed.
+    for (auto& read : reads)
+      if (read)
+        co_await *read;
+    std::rethrow_exception(exception);
+  }
+  co_return result;
+}
+
+
+template<class T, class COMBINE>
+Task<T>
+fold(
+  Task<std::vector<T>> results,
+  T init,
+  COMBINE const& combine)
+{
+  auto result = std::move(init);
+  for (auto& partial : co_await results)
+    result = combine(std::move(result), partial);
+  co_return result;
+}
+
+
+/*
+ * Scans the partitions of `dataset` that may contain records in [start, end),
+ * like `::scan()`, but with a coroutine per partition.  Up to `max_open`
+ * partitions are scanned at once, on the threads of `scheduler`, while their
+ * blocks are read by `io`.  The results are folded in partition order, so
+ * they don't depend on the number of threads.
+ */
+template<class REC, class T, class MAP, class COMBINE>
+inline T
+scan(
+  Dataset<REC> const& dataset,
+  Timestamp const start,
+  Timestamp const end,
+  Scheduler& scheduler,
+  IoPool& io,
+  T init,
+  MAP&& map,
+  COMBINE&& combine,
+  size_t const max_open=64)
+{
+  auto const partitions = dataset.select(start, end);
+  Semaphore open_files(scheduler, max_open);
+  std::vector<Task<T>> tasks;
+  for (auto const& partition : partitions)
+    tasks.push_back(scan_partition<REC>(
+      io, scheduler, open_files, partition, start, end, init, map, combine));
+  return run(
+    scheduler, fold(when_all(scheduler, std::move(tasks)), init, combine));
+}
+
+
+}  // namespace async
+
@@ -0,0 +1,40 @@
+#include <iostream>
+
+#include "bars.hh"
+#include "reader.hh"
+#include "rec.hh"
+#include "timer.hh"
+
+//------------------------------------------------------------------------------
+
+int
+main(
+  int const argc,
+  char const* const* const argv)
+{
+  if (argc < 2 || argc > 4) {
+    std::cerr << "usage: " << argv[0] << " FILENAME [SECONDS [THREADS]]\n";
+    return 2;
+  }
+  Timestamp const interval = (argc >= 3 ? atof(argv[2]) : 60) * 1E+9;
+  size_t const num_threads = argc >= 4 ? atol(argv[3]) : 1;
+
+  MmapReader<Order> reader(argv[1]);
+
+  auto const start = now();
+  auto bars = get_bars(reader, interval, num_threads);
+  auto const elapsed = now() - start;
+
+  auto volume = as_array(bars.volume);
+  int64_t total_volume = 0;
+  for (auto const v : volume)
+    total_volume += v;
+  std::cout << bars.length() << " bars, total volume = " << total_volume
+            << "\n";
+
+  std::cerr << "elapsed: " << elapsed << " = "
+            << elapsed / reader.length() / 1E-6 << " µs/rec\n";
+
+  return 0;
+}
+
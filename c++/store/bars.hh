@@ -0,0 +1,256 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "array/typed.hh"
+#include "reader.hh"
+#include "rec.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * Returns a typed array view of a vector's contents.  The view is invalidated
+ * if the vector is resized.
+ */
+template<class T>
+inline array::TypedContigArray<T>
+as_array(
+  std::vector<T>& vec)
+{
+  // Make sure data() is not null, even if the vector is empty.
+  vec.reserve(1);
+  return {reinterpret_cast<array::byte_t*>(vec.data()), (array::index_t) vec.size()};
+}
+
+
+//------------------------------------------------------------------------------
+
+struct Bar
+{
+  Sid instrument;
+  Timestamp start;
+  Price open;
+  Price high;
+  Price low;
+  Price close;
+  int64_t volume;
+  double notional;
+  uint32_t count;
+};
+
+
+/*
+ * Bars stored by column.
+ */
+struct BarColumns
+{
+  std::vector<Sid>          instrument;
+  std::vector<Timestamp>    start;
+  std::vector<Price>        open;
+  std::vector<Price>        high;
+  std::vector<Price>        low;
+  std::vector<Price>        close;
+  std::vector<int64_t>      volume;
+  std::vector<double>       vwap;
+  std::vector<uint32_t>     count;
+
+  size_t length() const { return instrument.size(); }
+
+  void
+  append(
+    Bar const& bar)
+  {
+    instrument.push_back(bar.instrument);
+    start.push_back(bar.start);
+    open.push_back(bar.open);
+    high.push_back(bar.high);
+    low.push_back(bar.low);
+    close.push_back(bar.close);
+    volume.push_back(bar.volume);
+    vwap.push_back(bar.volume == 0 ? 0 : bar.notional / bar.volume);
+    count.push_back(bar.count);
+  }
+
+  void
+  extend(
+    BarColumns const& other)
+  {
+    extend(instrument, other.instrument);
+    extend(start, other.start);
+    extend(open, other.open);
+    extend(high, other.high);
+    extend(low, other.low);
+    extend(close, other.close);
+    extend(volume, other.volume);
+    extend(vwap, other.vwap);
+    extend(count, other.count);
+  }
+
+private:
+
+  template<class T>
+  static void
+  extend(
+    std::vector<T>& col,
+    std::vector<T> const& other)
+  {
+    col.insert(col.end(), other.begin(), other.end());
+  }
+
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Builds fixed-interval bars from orders sorted by timestamp.
+ *
+ * Only the bars of the current interval are held open, one per instrument that
+ * has an order in it; when an order arrives in a later interval, they are
+ * appended to the output in instrument order.  An instrument with no orders in
+ * an interval has no bar for it.
+ */
+class BarBuilder
+{
+public:
+
+  BarBuilder(
+    Timestamp const interval,
+    BarColumns& out)
+  : interval_(interval),
+    out_(out)
+  {
+    assert(interval_ > 0);
+  }
+
+  BarBuilder(BarBuilder const&) = delete;
+  BarBuilder(BarBuilder&&) = delete;
+
+  ~BarBuilder() { flush(); }
+
+  void
+  push(
+    Order const& order)
+  {
+    auto const start = order.timestamp - order.timestamp % interval_;
+    if (start != start_) {
+      assert(start > start_);
+      flush();
+      start_ = start;
+    }
+
+    auto const volume = std::abs(order.size);
+    auto const i = open_.find(order.instrument);
+    if (i == open_.end())
+      open_.emplace(
+        order.instrument,
+        Bar{order.instrument, start, order.price, order.price, order.price,
+            order.price, volume, (double) volume * order.price, 1});
+    else {
+      auto& bar = i->second;
+      bar.high = std::max(bar.high, order.price);
+      bar.low = std::min(bar.low, order.price);
+      bar.close = order.price;
+      bar.volume += volume;
+      bar.notional += (double) volume * order.price;
+      ++bar.count;
+    }
+  }
+
+  /*
+   * Closes and appends all open bars.
+   */
+  void
+  flush()
+  {
+    if (open_.empty())
+      return;
+
+    closed_.clear();
+    for (auto const& i : open_)
+      closed_.push_back(i.second);
+    std::sort(
+      closed_.begin(), closed_.end(),
+      [](Bar const& b0, Bar const& b1) {
+        return b0.instrument < b1.instrument;
+      });
+    for (auto const& bar : closed_)
+      out_.append(bar);
+
+    open_.clear();
+  }
+
+private:
+
+  Timestamp const interval_;
+  BarColumns& out_;
+  Timestamp start_ = 0;
+  std::unordered_map<Sid, Bar> open_;
+  std::vector<Bar> closed_;
+
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Builds bars from orders sorted by timestamp, in a single pass.
+ *
+ * With `num_partitions` > 1, splits the records into time partitions on
+ * interval boundaries, so that no bar spans two partitions, and builds each
+ * partition's bars in its own thread.
+ */
+template<class READER>
+BarColumns
+get_bars(
+  READER const& reader,
+  Timestamp const interval,
+  size_t const num_partitions=1)
+{
+  assert(num_partitions > 0);
+  auto const length = reader.length();
+
+  auto const build = [&reader, interval](
+    size_t const start, size_t const end, BarColumns& bars) {
+    BarBuilder builder(interval, bars);
+    for (size_t i = start; i < end; ++i)
+      builder.push(reader.get(i));
+  };
+
+  if (num_partitions == 1 || length < num_partitions) {
+    BarColumns bars;
+    build(0, length, bars);
+    return bars;
+  }
+
+  // Choose split points, moved back to the start of their intervals.
+  std::vector<size_t> splits{0};
+  for (size_t p = 1; p < num_partitions; ++p) {
+    auto const timestamp = reader.get(p * length / num_partitions).timestamp;
+    auto const split = lower_bound_timestamp(
+      reader, timestamp - timestamp % interval, splits.back(), length);
+    splits.push_back(split);
+  }
+  splits.push_back(length);
+
+  std::vector<BarColumns> parts(num_partitions);
+  std::vector<std::thread> threads;
+  for (size_t p = 0; p < num_partitions; ++p)
+    threads.emplace_back(build, splits[p], splits[p + 1], std::ref(parts[p]));
+  for (auto& thread : threads)
+    thread.join();
+
+  BarColumns bars;
+  for (auto const& part : parts)
+    bars.extend(part);
+  return bars;
+}
+
+
@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+#include "reader.hh"
+#include "rec.hh"
+#include "stats.hh"
+#include "tail.hh"
+#include "timer.hh"
+#include "writer.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * Hardware cache miss counter for this thread, if perf_event is available.
+ */
+class CacheMissCounter
+{
+public:
+
+  CacheMissCounter()
+  {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+
+  ~CacheMissCounter()
+  {
+    if (fd_ != -1)
+      close(fd_);
+  }
+
+  bool available() const { return fd_ != -1; }
+
+  void
+  start()
+  {
+    if (fd_ != -1) {
+      ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+
+  /*
+   * Returns the count since start(), or -1 if unavailable.
+   */
+  long long
+  stop()
+  {
+    if (fd_ == -1)
+      return -1;
+    ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+    long long count;
+    return read(fd_, &count, sizeof(count)) == sizeof(count) ? count : -1;
+  }
+
+private:
+
+  int fd_;
+
+};
+
+
+inline long
+get_page_faults()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_minflt + usage.ru_majflt;
+}
+
+
+/*
+ * Evicts a file from the page cache, as far as possible.
+ */
+inline void
+evict(
+  char const* const filename)
+{
+  int const fd = open(filename, O_RDONLY);
+  assert(fd != -1);
+  fdatasync(fd);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+}
+
+
+//------------------------------------------------------------------------------
+
+struct Sample
+{
+  double elapsed;
+  long page_faults;
+  long long cache_misses;
+};
+
+
+// Kernel results are accumulated here so they aren't optimized away.
+uint64_t volatile sink;
+
+/*
+ * Opens `filename` with READER and runs a kernel on it, once.  Opening the
+ * reader is included in the time, since for some readers that's the scan.
+ */
+template<class READER, class KERNEL>
+Sample
+run_once(
+  char const* const filename,
+  bool const cold,
+  KERNEL const& kernel,
+  CacheMissCounter& counter)
+{
+  if (cold)
+    evict(filename);
+
+  auto const page_faults = get_page_faults();
+  counter.start();
+  auto const start = now();
+  {
+    READER reader(filename);
+    sink = sink + kernel(reader);
+  }
+  auto const elapsed = now() - start;
+  auto const cache_misses = counter.stop();
+  return {elapsed, get_page_faults() - page_faults, cache_misses};
+}
+
+
+template<class T>
+inline T
+median(
+  std::vector<T> vals)
+{
+  std::sort(vals.begin(), vals.end());
+  auto const n = vals.size();
+  return n % 2 == 1 ? vals[n / 2] : (vals[n / 2 - 1] + vals[n / 2]) / 2;
+}
+
+
+/*
+ * Runs a benchmark `repeat` times and prints one JSON line of results.
+ */
+template<class READER, class KERNEL>
+void
+bench(
+  char const* const reader_name,
+  char const* const kernel_name,
+  KERNEL const& kernel,
+  char const* const filename,
+  size_t const length,
+  bool const cold,
+  size_t const repeat,
+  CacheMissCounter& counter)
+{
+  // Untimed run, to warm the cache and fault in code.
+  if (!cold)
+    run_once<READER>(filename, false, kernel, counter);
+
+  std::vector<double> elapsed;
+  std::vector<long> page_faults;
+  std::vector<long long> cache_misses;
+  for (size_t i = 0; i < repeat; ++i) {
+    auto const sample = run_once<READER>(filename, cold, kernel, counter);
+    elapsed.push_back(sample.elapsed);
+    page_faults.push_back(sample.page_faults);
+    cache_misses.push_back(sample.cache_misses);
+  }
+
+  double mean = 0;
+  for (auto const e : elapsed)
+    mean += e;
+  mean /= repeat;
+  double var = 0;
+  for (auto const e : elapsed)
+    var += (e - mean) * (e - mean);
+  var = repeat > 1 ? var / (repeat - 1) : 0;
+
+  auto const med = median(elapsed);
+  auto const size = length * sizeof(Order);
+  std::cout
+    << "{\"reader\": \"" << reader_name << "\""
+    << ", \"kernel\": \"" << kernel_name << "\""
+    << ", \"cache\": \"" << (cold ? "cold" : "warm") << "\""
+    << ", \"length\": " << length
+    << ", \"bytes\": " << size
+    << ", \"runs\": " << repeat
+    << ", \"median_s\": " << med
+    << ", \"stddev_s\": " << std::sqrt(var)
+    << ", \"ns_per_rec\": " << med / length * 1E+9
+    << ", \"gb_per_s\": " << size / med * 1E-9
+    << ", \"page_faults\": " << median(page_faults)
+    << ", \"cache_misses\": ";
+  if (counter.available())
+    std::cout << median(cache_misses);
+  else
+    std::cout << "null";
+  std::cout << "}" << std::endl;
+}
+
+
+template<class READER>
+void
+bench_reader(
+  char const* const reader_name,
+  char const* const filename,
+  size_t const length,
+  size_t const repeat,
+  CacheMissCounter& counter)
+{
+  auto const volume = [](READER const& reader) {
+    return get_total_volume(reader);
+  };
+  auto const stats = [](READER const& reader) {
+    return get_order_stats(reader).size();
+  };
+
+  for (auto const cold : {false, true}) {
+    bench<READER>(
+      reader_name, "volume", volume, filename, length, cold, repeat, counter);
+    bench<READER>(
+      reader_name, "stats", stats, filename, length, cold, repeat, counter);
+  }
+}
+
+
+/*
+ * Writes the first `length` records of `filename` to a new file.
+ */
+inline std::string
+write_prefix(
+  char const* const filename,
+  size_t const length)
+{
+  auto const prefix_filename
+    = std::string(filename) + ".bench." + std::to_string(length);
+  unlink(prefix_filename.c_str());
+
+  MmapReader<Order> reader(filename);
+  RecordWriter<Order> writer(prefix_filename.c_str());
+  for (size_t i = 0; i < length; ++i)
+    writer.append(reader.get(i));
+  return prefix_filename;
+}
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Benchmarks each reader with each scan kernel, on warm and cold cache, and
+ * prints results as JSON lines.  With LENGTHs, benchmarks on copies of the
+ * first LENGTH records of the file; otherwise, on the whole file.
+ */
+int
+main(
+  int const argc,
+  char const* const* const argv)
+{
+  if (argc < 3) {
+    std::cerr << "usage: " << argv[0] << " FILENAME REPEAT [LENGTH ...]\n";
+    return 2;
+  }
+  char const* const filename = argv[1];
+  size_t const repeat = atol(argv[2]);
+  assert(repeat > 0);
+
+  std::vector<size_t> lengths;
+  for (int i = 3; i < argc; ++i)
+    lengths.push_back(atol(argv[i]));
+  size_t length;
+  {
+    MmapReader<Order> reader(filename);
+    length = reader.length();
+  }
+  if (lengths.empty())
+    lengths.push_back(length);
+
+  CacheMissCounter counter;
+  for (auto const l : lengths) {
+    assert(l <= length);
+    auto const bench_filename
+      = l == length ? std::string(filename) : write_prefix(filename, l);
+    auto const name = bench_filename.c_str();
+
+    bench_reader<MmapReader<Order>>("mmap", name, l, repeat, counter);
+    bench_reader<BufferReader<Order>>("buffer", name, l, repeat, counter);
+    bench_reader<TailReader<Order>>("tail", name, l, repeat, counter);
+
+    if (bench_filename != filename)
+      unlink(name);
+  }
+
+  return 0;
+}
+
@@ -0,0 +1,471 @@
+#pragma once
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <list>
+#include <map>
+#include <string>
+#include <sys/stat.h>
+#include <system_error>
+#include <type_traits>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+
+#include "file.hh"
+#include "hash.hh"
+
+//------------------------------------------------------------------------------
+// Serialization of results
+
+/*
+ * Converts results to and from bytes.  Specialize for result types that
+ * aren't trivially copyable.
+ */
+template<class T>
+struct Serializer
+{
+  static_assert(
+    std::is_trivially_copyable<T>::value, "specialize Serializer for T");
+
+  static std::string
+  dump(
+    T const& val)
+  {
+    return std::string(reinterpret_cast<char const*>(&val), sizeof(T));
+  }
+
+  static bool
+  load(
+    std::string const& bytes,
+    T& val)
+  {
+    if (bytes.size() != sizeof(T))
+      return false;
+    memcpy(&val, bytes.data(), sizeof(T));
+    return true;
+  }
+};
+
+
+template<class K, class V>
+struct Serializer<std::map<K, V>>
+{
+  static_assert(
+    std::is_trivially_copyable<K>::value
+    && std::is_trivially_copyable<V>::value,
+    "specialize Serializer for map");
+
+  static size_t constexpr ENTRY_SIZE = sizeof(K) + sizeof(V);
+
+  static std::string
+  dump(
+    std::map<K, V> const& map)
+  {
+    std::string bytes;
+    bytes.reserve(map.size() * ENTRY_SIZE);
+    for (auto const& i : map) {
+      bytes.append(reinterpret_cast<char const*>(&i.first), sizeof(K));
+      bytes.append(reinterpret_cast<char const*>(&i.second), sizeof(V));
+    }
+    return bytes;
+  }
+
+  static bool
+  load(
+    std::string const& bytes,
+    std::map<K, V>& map)
+  {
+    if (bytes.size() % ENTRY_SIZE != 0)
+      return false;
+    map.clear();
+    for (size_t i = 0; i < bytes.size(); i += ENTRY_SIZE) {
+      K key;
+      V val;
+      memcpy(&key, bytes.data() + i, sizeof(K));
+      memcpy(&val, bytes.data() + i + sizeof(K), sizeof(V));
+      map.emplace_hint(map.end(), key, val);
+    }
+    return true;
+  }
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Identifies the contents of a file.  If the file changes, including by
+ * growing, its version changes.
+ */
+struct FileVersion
+{
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t size;
+  uint64_t mtime_ns;
+};
+
+
+/*
+ * Returns a string prefix for keys of a file, for any version.
+ */
+inline std::string
+get_file_str(
+  FileVersion const& file)
+{
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%" PRIx64 ":%" PRIx64 ":", file.dev, file.ino);
+  return buf;
+}
+
+
+/*
+ * Returns a string prefix for keys of a version of a file.
+ */
+inline std::string
+get_version_str(
+  FileVersion const& file)
+{
+  char buf[64];
+  snprintf(
+    buf, sizeof(buf), "%" PRIx64 ":%" PRIx64 ":", file.size, file.mtime_ns);
+  return get_file_str(file) + buf;
+}
+
+
+inline FileVersion
+get_file_version(
+  char const* const filename)
+{
+  struct stat file_info;
+  if (stat(filename, &file_info) == -1)
+    throw std::system_error(errno, std::generic_category(), filename);
+  return {
+    (uint64_t) file_info.st_dev,
+    (uint64_t) file_info.st_ino,
+    (uint64_t) file_info.st_size,
+    (uint64_t) file_info.st_mtim.tv_sec * 1000000000ull
+      + file_info.st_mtim.tv_nsec};
+}
+
+
+/*
+ * Cache key for a kernel's result over records [start, stop) of a file.
+ * `kernel` names the kernel and its parameters.
+ */
+struct CacheKey
+{
+  FileVersion file;
+  uint64_t start;
+  uint64_t stop;
+  std::string kernel;
+
+  std::string
+  str()
+    const
+  {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%" PRIx64 ":%" PRIx64 ":", start, stop);
+    return get_version_str(file) + buf + kernel;
+  }
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * A cache of kernel results over file ranges.
+ *
+ * Results are kept in memory, up to `capacity` bytes, and evicted least
+ * recently used first.  If `dirname` is given, results are also stored there,
+ * one file per result, and found there on a miss in memory; that directory
+ * isn't bounded.  With a capacity of zero, only the disk tier is used, which
+ * is all that helps a cache that lives for a single run.
+ *
+ * A key includes the file's version, so a result is never returned for a
+ * file that has changed since.  When a lookup sees a new version of a file,
+ * results for older versions are dropped, from memory and disk.
+ */
+class ResultCache
+{
+public:
+
+  ResultCache(
+    size_t const capacity,
+    std::string const& dirname="")
+  : capacity_(capacity),
+    dirname_(dirname)
+  {
+    if (!dirname_.empty() && mkdir(dirname_.c_str(), 0755) == -1
+        && errno != EEXIST)
+      throw std::system_error(errno, std::generic_category(), dirname_);
+  }
+
+  ResultCache(ResultCache const&) = delete;
+  ResultCache& operator=(ResultCache const&) = delete;
+
+  size_t size() const { return size_; }
+  size_t num_hits() const { return num_hits_; }
+  size_t num_misses() const { return num_misses_; }
+
+  /*
+   * Looks up a result.  Returns true and sets `bytes` on a hit.
+   */
+  bool
+  get(
+    CacheKey const& key,
+    std::string& bytes)
+  {
+    invalidate_stale(key.file);
+    auto const str = key.str();
+
+    auto const i = index_.find(str);
+    if (i != index_.end()) {
+      // Move to the front.
+      entries_.splice(entries_.begin(), entries_, i->second);
+      bytes = i->second->second;
+      ++num_hits_;
+      return true;
+    }
+
+    if (!dirname_.empty() && load(key, str, bytes)) {
+      insert(str, bytes);
+      ++num_hits_;
+      return true;
+    }
+
+    ++num_misses_;
+    return false;
+  }
+
+  /*
+   * Stores a result.  Throws `std::system_error` if it can't be saved to disk.
+   */
+  void
+  put(
+    CacheKey const& key,
+    std::string const& bytes)
+  {
+    invalidate_stale(key.file);
+    auto const str = key.str();
+    insert(str, bytes);
+    if (!dirname_.empty())
+      save(key, str, bytes);
+  }
+
+private:
+
+  using Entry = std::pair<std::string, std::string>;
+
+  void
+  insert(
+    std::string const& str,
+    std::string const& bytes)
+  {
+    auto const i = index_.find(str);
+    if (i != index_.end())
+      erase(i);
+    if (bytes.size() > capacity_)
+      return;
+    entries_.emplace_front(str, bytes);
+    index_[str] = entries_.begin();
+    size_ += bytes.size();
+    while (size_ > capacity_)
+      erase(index_.find(entries_.back().first));
+  }
+
+  using Index = std::unordered_map<std::string, std::list<Entry>::iterator>;
+
+  void
+  erase(
+    Index::iterator const i)
+  {
+    size_ -= i->second->second.size();
+    entries_.erase(i->second);
+    index_.erase(i);
+  }
+
+  /*
+   * Drops results for versions of `file` other than this one.
+   */
+  void
+  invalidate_stale(
+    FileVersion const& file)
+  {
+    auto const id = std::make_pair(file.dev, file.ino);
+    auto const v = versions_.find(id);
+    if (v != versions_.end()
+        && v->second.first == file.size && v->second.second == file.mtime_ns)
+      return;
+    versions_[id] = {file.size, file.mtime_ns};
+
+    auto const file_str = get_file_str(file);
+    auto const version_str = get_version_str(file);
+    for (auto e = entries_.begin(); e != entries_.end(); ) {
+      auto const& str = (e++)->first;
+      if (str.compare(0, file_str.size(), file_str) == 0
+          && str.compare(0, version_str.size(), version_str) != 0)
+        erase(index_.find(str));
+    }
+
+    if (!dirname_.empty())
+      remove_stale_files(file);
+  }
+
+  //----------------------------------------------------------------------------
+  // Disk tier
+  //
+  // Results for a file are stored in a subdirectory named by device and inode,
+  // in files named by the version and the hash of the key.  Each file holds
+  // the full key, so a hash collision is detected.  Files are written to
+  // temporary files whose names start with a dot, and renamed into place.
+
+  std::string
+  get_file_dirname(
+    FileVersion const& file)
+    const
+  {
+    char name[64];
+    snprintf(
+      name, sizeof(name), "/%" PRIx64 "-%" PRIx64, file.dev, file.ino);
+    return dirname_ + name;
+  }
+
+  std::string
+  get_version_prefix(
+    FileVersion const& file)
+    const
+  {
+    char name[64];
+    snprintf(
+      name, sizeof(name), "%" PRIx64 "-%" PRIx64 "-", file.size,
+      file.mtime_ns);
+    return name;
+  }
+
+  std::string
+  get_filename(
+    CacheKey const& key,
+    std::string const& str)
+    const
+  {
+    uint64_t hash = 0;
+    for (auto const c : str)
+      hash = mix_hash(hash ^ (unsigned char) c);
+    char name[32];
+    snprintf(name, sizeof(name), "%016" PRIx64, hash);
+    return get_file_dirname(key.file) + "/" + get_version_prefix(key.file)
+           + name;
+  }
+
+  bool
+  load(
+    CacheKey const& key,
+    std::string const& str,
+    std::string& bytes)
+    const
+  {
+    int const fd = open(get_filename(key, str).c_str(), O_RDONLY);
+    if (fd == -1)
+      return false;
+    struct stat file_info;
+    std::string contents;
+    bool ok = fstat(fd, &file_info) == 0;
+    if (ok) {
+      contents.resize(file_info.st_size);
+      ok = read(fd, &contents[0], contents.size()) == (ssize_t) contents.size();
+    }
+    close(fd);
+
+    // The file contains the key, a newline, and the result.
+    auto const nl = contents.find('\n');
+    if (!ok || nl == std::string::npos || contents.compare(0, nl, str) != 0)
+      return false;
+    bytes = contents.substr(nl + 1);
+    return true;
+  }
+
+  void
+  save(
+    CacheKey const& key,
+    std::string const& str,
+    std::string const& bytes)
+    const
+  {
+    auto const file_dirname = get_file_dirname(key.file);
+    if (mkdir(file_dirname.c_str(), 0755) == -1 && errno != EEXIST)
+      throw std::system_error(errno, std::generic_category(), file_dirname);
+
+    // Replace, so a concurrent reader never sees a partial result.
+    replace_file(get_filename(key, str), str + "\n" + bytes);
+  }
+
+  void
+  remove_stale_files(
+    FileVersion const& file)
+    const
+  {
+    auto const file_dirname = get_file_dirname(file);
+    auto const prefix = get_version_prefix(file);
+    DIR* const dir = opendir(file_dirname.c_str());
+    if (dir == nullptr)
+      return;
+    while (auto const entry = readdir(dir)) {
+      std::string const name = entry->d_name;
+      // Skip temporary files, which may be being written.
+      if (name[0] != '.' && name.compare(0, prefix.size(), prefix) != 0)
+        unlink((file_dirname + "/" + name).c_str());
+    }
+    closedir(dir);
+  }
+
+  size_t const capacity_;
+  std::string const dirname_;
+
+  // Most recently used first.
+  std::list<Entry> entries_;
+  Index index_;
+  size_t size_ = 0;
+
+  // Last seen version, as (size, mtime), by (device, inode).
+  std::map<std::pair<uint64_t, uint64_t>, std::pair<uint64_t, uint64_t>>
+    versions_;
+
+  size_t num_hits_ = 0;
+  size_t num_misses_ = 0;
+
+};
+
+
+/*
+ * Returns the result of `compute()`, the kernel named `kernel` over records
+ * [start, stop) of `filename`, from `cache` if there, or else computes it
+ * and caches it.
+ */
+template<class T, class FN>
+inline T
+cached(
+  ResultCache& cache,
+  char const* const filename,
+  size_t const start,
+  size_t const stop,
+  std::string const& kernel,
+  FN&& compute)
+{
+  CacheKey const key{get_file_version(filename), start, stop, kernel};
+  std::string bytes;
+  T result;
+  if (cache.get(key, bytes) && Serializer<T>::load(bytes, result))
+    return result;
+  result = compute();
+  cache.put(key, Serializer<T>::dump(result));
+  return result;
+}
+
+
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "file.hh"
+#include "hash.hh"
+#include "parallel.hh"
+#include "reader.hh"
+#include "rec.hh"
+#include "stats.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * Order stats materialized over the first `length` records of a file.
+ */
+struct StatsCheckpoint
+{
+  // Identity of the record file the stats are for.
+  uint64_t dev = 0;
+  uint64_t ino = 0;
+  // Number of records covered.
+  uint64_t length = 0;
+  // Hash of the last records covered, to detect a file rewritten in place.
+  uint64_t tail_hash = 0;
+  std::map<Sid, OrderStats> stats;
+};
+
+
+/*
+ * Returns the name of the checkpoint file for a record file.
+ */
+inline std::string
+get_checkpoint_filename(
+  char const* const filename)
+{
+  return std::string(filename) + ".stats";
+}
+
+
+namespace checkpoint {
+
+uint64_t constexpr MAGIC = 0x7374617473636552ull;  // "RecStats"
+uint32_t constexpr VERSION = 2;
+
+// Number of records at the end of a checkpoint whose hash is checked.
+size_t constexpr TAIL_LENGTH = 1024;
+
+/*
+ * On disk, a checkpoint is a header followed by `num_entries` entries.
+ */
+struct Header
+{
+  uint64_t magic;
+  uint32_t version;
+  uint32_t record_size;
+  // Entries are written as is, so a change to their layout invalidates them.
+  uint32_t entry_size;
+  uint32_t entry_layout;
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t length;
+  uint64_t tail_hash;
+  uint64_t num_entries;
+  // Hash of the entries.
+  uint64_t checksum;
+};
+
+struct Entry
+{
+  Sid sid;
+  OrderStats stats;
+};
+
+
+// The header is written as is, so it mustn't have padding.
+static_assert(sizeof(Header) == 72, "padding in checkpoint::Header");
+
+
+/*
+ * Returns a hash of the offsets and sizes of the fields of an entry.
+ */
+inline uint32_t
+get_entry_layout()
+{
+  size_t constexpr STATS = offsetof(Entry, stats);
+  uint64_t const layout[] = {
+    offsetof(Entry, sid), sizeof(Sid),
+    STATS + offsetof(OrderStats, count), sizeof(OrderStats::count),
+    STATS + offsetof(OrderStats, net_size), sizeof(OrderStats::net_size),
+    STATS + offsetof(OrderStats, volume), sizeof(OrderStats::volume),
+    STATS + offsetof(OrderStats, vwp), sizeof(OrderStats::vwp),
+    STATS + offsetof(OrderStats, last_price), sizeof(OrderStats::last_price),
+  };
+  return hash_bytes(layout, sizeof(layout));
+}
+
+
+/*
+ * Returns an entry with its padding zeroed, so that saved checkpoints, and
+ * their checksums, depend only on the stats.
+ */
+inline Entry
+make_entry(
+  Sid const sid,
+  OrderStats const& stats)
+{
+  Entry entry;
+  memset(static_cast<void*>(&entry), 0, sizeof(entry));
+  // Assign field by field; copying the struct may copy padding.
+  entry.sid = sid;
+  entry.stats.count = stats.count;
+  entry.stats.net_size = stats.net_size;
+  entry.stats.volume = stats.volume;
+  entry.stats.vwp = stats.vwp;
+  entry.stats.last_price = stats.last_price;
+  return entry;
+}
+
+
+/*
+ * Returns the hash of the last records of the first `length` of `reader`.
+ */
+template<class READER>
+inline uint64_t
+get_tail_hash(
+  READER const& reader,
+  size_t const length)
+{
+  auto const batch
+    = get_batch(reader, length - std::min(length, TAIL_LENGTH), length);
+  return hash_bytes(batch.begin(), batch.size());
+}
+
+}  // namespace checkpoint
+
+
+/*
+ * Loads the checkpoint for `filename`.  Returns false if there is none, or it
+ * is not valid.
+ */
+inline bool
+load_checkpoint(
+  char const* const filename,
+  StatsCheckpoint& checkpoint)
+{
+  using namespace checkpoint;
+
+  int const fd = open(get_checkpoint_filename(filename).c_str(), O_RDONLY);
+  if (fd == -1)
+    return false;
+
+  struct stat file_info;
+  Header header;
+  std::vector<Entry> entries;
+  bool valid
+    = fstat(fd, &file_info) == 0
+      && read(fd, &header, sizeof(header)) == sizeof(header)
+      && header.magic == MAGIC
+      && header.version == VERSION
+      && header.record_size == sizeof(Order)
+      && header.entry_size == sizeof(Entry)
+      && header.entry_layout == get_entry_layout()
+      && (size_t) file_info.st_size
+         == sizeof(header) + header.num_entries * sizeof(Entry);
+  if (valid) {
+    entries.resize(header.num_entries);
+    auto const size = entries.size() * sizeof(Entry);
+    valid
+      = read(fd, entries.data(), size) == (ssize_t) size
+        && hash_bytes(entries.data(), size) == header.checksum;
+  }
+  close(fd);
+  if (!valid)
+    return false;
+
+  checkpoint.dev = header.dev;
+  checkpoint.ino = header.ino;
+  checkpoint.length = header.length;
+  checkpoint.tail_hash = header.tail_hash;
+  checkpoint.stats.clear();
+  for (auto const& entry : entries)
+    checkpoint.stats.emplace_hint(
+      checkpoint.stats.end(), entry.sid, entry.stats);
+  return true;
+}
+
+
+/*
+ * Saves the checkpoint for `filename`.  The checkpoint file is replaced
+ * atomically, so a reader sees either the old or new checkpoint.  Throws
+ * `std::system_error` if it can't be written.
+ */
+inline void
+save_checkpoint(
+  char const* const filename,
+  StatsCheckpoint const& checkpoint)
+{
+  using namespace checkpoint;
+
+  std::vector<Entry> entries;
+  entries.reserve(checkpoint.stats.size());
+  for (auto const& i : checkpoint.stats)
+    entries.push_back(make_entry(i.first, i.second));
+  auto const size = entries.size() * sizeof(Entry);
+  Header const header{
+    MAGIC, VERSION, sizeof(Order), sizeof(Entry), get_entry_layout(),
+    checkpoint.dev, checkpoint.ino, checkpoint.length, checkpoint.tail_hash,
+    entries.size(), hash_bytes(entries.data(), size)};
+
+  std::string contents(reinterpret_cast<char const*>(&header), sizeof(header));
+  contents.append(reinterpret_cast<char const*>(entries.data()), size);
+  replace_file(get_checkpoint_filename(filename), contents);
+}
+
+
+/*
+ * Brings the checkpointed order stats for an append-only record file up to
+ * date, scanning only the records appended since the checkpoint, in parallel
+ * on `pool` if not null.  If the checkpoint is missing, or is for a different
+ * file, or the checkpointed records have changed, scans the whole file.  If
+ * `save`, saves the new checkpoint, and throws `std::system_error` if it
+ * can't.
+ *
+ * Only the last `checkpoint::TAIL_LENGTH` checkpointed records are compared,
+ * so a rewrite that leaves them as they were isn't detected.
+ *
+ * Returns the number of records scanned.
+ */
+inline size_t
+refresh_order_stats(
+  char const* const filename,
+  StatsCheckpoint& checkpoint,
+  ThreadPool* const pool=nullptr,
+  bool const save=true)
+{
+  MmapReader<Order> reader(filename);
+  auto const length = reader.length();
+
+  // The status of the file mapped, not whatever has the name now.
+  auto const& file_info = reader.file_info();
+  if (checkpoint.dev != (uint64_t) file_info.st_dev
+      || checkpoint.ino != (uint64_t) file_info.st_ino
+      || checkpoint.length > length
+      || checkpoint.tail_hash
+         != checkpoint::get_tail_hash(reader, checkpoint.length)) {
+    // Not the file we checkpointed, or it was truncated or rewritten; start
+    // over.
+    checkpoint.dev = file_info.st_dev;
+    checkpoint.ino = file_info.st_ino;
+    checkpoint.length = 0;
+    checkpoint.tail_hash = checkpoint::get_tail_hash(reader, 0);
+    checkpoint.stats.clear();
+  }
+
+  auto const start = checkpoint.length;
+  if (start < length) {
+    auto const batch = get_batch(reader, start, length);
+    merge(checkpoint.stats, get_order_stats(batch, pool));
+    checkpoint.length = length;
+    checkpoint.tail_hash = checkpoint::get_tail_hash(reader, length);
+    if (save)
+      save_checkpoint(filename, checkpoint);
+  }
+  return length - start;
+}
+
+
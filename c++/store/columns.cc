@@ -0,0 +1,107 @@
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "columns.hh"
+#include "parallel.hh"
+#include "reader.hh"
+#include "rec.hh"
+#include "timer.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * Runs `fn` `repeat` times, and prints the best throughput over `size` bytes.
+ */
+template<class FN>
+void
+time(
+  char const* const name,
+  size_t const size,
+  size_t const repeat,
+  FN&& fn)
+{
+  double best = 0;
+  for (size_t i = 0; i < repeat; ++i) {
+    auto const start = now();
+    fn();
+    auto const elapsed = now() - start;
+    if (i == 0 || elapsed < best)
+      best = elapsed;
+  }
+  std::cout << name << ": " << best << " s  "
+            << size / best * 1E-9 << " GB/s\n";
+}
+
+
+/*
+ * Transposes the orders in a file to columns and back, with the field-by-field
+ * and SIMD kernels, checks the results agree, and prints throughput.  For
+ * reference, also times a copy of the same bytes.
+ */
+int
+main(
+  int const argc,
+  char const* const* const argv)
+{
+  if (argc < 2 || argc > 4) {
+    std::cerr << "usage: " << argv[0] << " FILENAME [REPEAT [THREADS]]\n";
+    return 2;
+  }
+  char const* const filename = argv[1];
+  size_t const repeat = argc >= 3 ? atol(argv[2]) : 5;
+  assert(repeat > 0);
+  std::unique_ptr<ThreadPool> pool;
+  if (argc >= 4)
+    pool.reset(new ThreadPool(atol(argv[3])));
+
+  MmapReader<Order> reader(filename);
+  auto const length = reader.length();
+  auto const size = length * sizeof(Order);
+  auto const data = &reader.get(0);
+
+  // Fault everything in first.
+  std::vector<Order> copy(length);
+  Columns<Order> fields(length);
+  Columns<Order> simd(length);
+  std::vector<Order> records(length);
+  memcpy(copy.data(), data, size);
+  transpose<MmapReader<Order>, false>(reader, 0, length, fields);
+  transpose(reader, 0, length, simd);
+  interleave(simd, 0, length, records.data());
+
+  time("copy", size, repeat, [&] {
+    memcpy(copy.data(), data, size);
+  });
+  time("transpose fields", size, repeat, [&] {
+    transpose<MmapReader<Order>, false>(
+      reader, 0, length, fields, 0, pool.get());
+  });
+  time("transpose simd", size, repeat, [&] {
+    transpose(reader, 0, length, simd, 0, pool.get());
+  });
+  time("interleave fields", size, repeat, [&] {
+    interleave<Order, false>(fields, 0, length, records.data(), pool.get());
+  });
+  time("interleave simd", size, repeat, [&] {
+    interleave(simd, 0, length, records.data(), pool.get());
+  });
+
+  for (size_t i = 0; i < length; ++i) {
+    auto const& order = reader.get(i);
+    assert(simd.get<0>()[i] == order.timestamp);
+    assert(simd.get<1>()[i] == order.instrument);
+    assert(simd.get<2>()[i] == order.size);
+    assert(memcmp(&simd.get<3>()[i], &order.price, sizeof(Price)) == 0);
+    assert(simd.get<4>()[i] == order.type);
+    assert(fields.get<0>()[i] == order.timestamp);
+    assert(fields.get<4>()[i] == order.type);
+  }
+  bool const ok = memcmp(records.data(), data, size) == 0;
+  std::cout << "round trip: " << (ok ? "ok" : "MISMATCH") << "\n";
+
+  return ok ? 0 : 1;
+}
+
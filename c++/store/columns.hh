@@ -0,0 +1,456 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "array/typed.hh"
+#include "instrument.hh"
+#include "parallel.hh"
+#include "reader.hh"
+#include "rec.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * The column arrays for a record layout: one `OwnedArray` per field.
+ */
+template<class LAYOUT> struct ColumnArrays;
+
+template<class... FIELDS>
+struct ColumnArrays<RecordLayout<FIELDS...>>
+{
+  using type = std::tuple<array::OwnedArray<typename FIELDS::type>...>;
+};
+
+
+/*
+ * The fields of `length` records of REC, stored as one array per field, in
+ * the order of `Layout<REC>`.
+ */
+template<class REC>
+class Columns
+{
+public:
+
+  using value_type = REC;
+  using layout = typename Layout<REC>::type;
+  static size_t constexpr num_fields = layout::num_fields;
+
+  template<size_t I>
+  using field_type = typename FieldAt<layout, I>::type::type;
+
+  Columns(
+    size_t const length)
+  : Columns(length, std::make_index_sequence<num_fields>())
+  {
+  }
+
+  Columns(Columns const&) = delete;
+  Columns& operator=(Columns const&) = delete;
+
+  size_t length() const { return length_; }
+
+  template<size_t I>
+  array::OwnedArray<field_type<I>>&
+  get()
+  {
+    return std::get<I>(arrays_);
+  }
+
+  template<size_t I>
+  array::OwnedArray<field_type<I>> const&
+  get()
+    const
+  {
+    return std::get<I>(arrays_);
+  }
+
+  /*
+   * Returns pointers to the values at `pos` of each column.
+   */
+  void
+  get_ptrs(
+    size_t const pos,
+    char** const ptrs)
+    const
+  {
+    get_ptrs(pos, ptrs, std::make_index_sequence<num_fields>());
+  }
+
+private:
+
+  template<size_t... I>
+  Columns(
+    size_t const length,
+    std::index_sequence<I...>)
+  : length_(length),
+    arrays_(((void) I, length)...)
+  {
+  }
+
+  template<size_t... I>
+  void
+  get_ptrs(
+    size_t const pos,
+    char** const ptrs,
+    std::index_sequence<I...>)
+    const
+  {
+    assert(pos <= length_);
+    int const _[] = {
+      (ptrs[I]
+         = reinterpret_cast<char*>(std::get<I>(arrays_).begin_ptr() + pos),
+       0)...};
+    (void) _;
+  }
+
+  size_t const length_;
+  typename ColumnArrays<layout>::type arrays_;
+
+};
+
+
+template<class REC>
+size_t constexpr Columns<REC>::num_fields;
+
+
+//------------------------------------------------------------------------------
+
+namespace columns {
+
+/*
+ * Records are transposed in blocks of this many, small enough that a block
+ * stays in L1 while each of its fields is copied out.
+ */
+size_t constexpr BLOCK_LENGTH = 1024;
+
+/*
+ * Copies field F of `length` records at `src` to `dst`, and back.  The
+ * stride and offset are constants, so these compile to tight loops.
+ */
+template<class REC, class F>
+inline void
+split_field(
+  REC const* const src,
+  size_t const length,
+  char* const dst)
+{
+  using T = typename F::type;
+  auto const s = reinterpret_cast<char const*>(src) + F::offset;
+  auto const d = reinterpret_cast<T*>(dst);
+  for (size_t i = 0; i < length; ++i)
+    memcpy(d + i, s + i * sizeof(REC), sizeof(T));
+}
+
+
+template<class REC, class F>
+inline void
+join_field(
+  char const* const src,
+  size_t const length,
+  REC* const dst)
+{
+  using T = typename F::type;
+  auto const s = reinterpret_cast<T const*>(src);
+  auto const d = reinterpret_cast<char*>(dst) + F::offset;
+  for (size_t i = 0; i < length; ++i)
+    memcpy(d + i * sizeof(REC), s + i, sizeof(T));
+}
+
+
+template<class... FIELDS>
+constexpr size_t
+get_fields_size(
+  RecordLayout<FIELDS...>)
+{
+  size_t size = 0;
+  for (auto const s : {(size_t) 0, sizeof(typename FIELDS::type)...})
+    size += s;
+  return size;
+}
+
+
+/*
+ * Field-by-field transpose, for any layout.
+ */
+template<class REC, class LAYOUT>
+struct FieldTranspose
+{
+  template<class... FIELDS>
+  static void
+  split(
+    RecordLayout<FIELDS...>,
+    REC const* const src,
+    size_t const length,
+    char* const* const dst)
+  {
+    size_t i = 0;
+    int const _[] = {(split_field<REC, FIELDS>(src, length, dst[i++]), 0)...};
+    (void) _;
+  }
+
+  template<class... FIELDS>
+  static void
+  join(
+    RecordLayout<FIELDS...>,
+    char const* const* const src,
+    size_t const length,
+    REC* const dst)
+  {
+    // Zero padding, so that no uninitialized bytes are written out.
+    if (get_fields_size(LAYOUT()) != sizeof(REC))
+      memset((void*) dst, 0, length * sizeof(REC));
+    size_t i = 0;
+    int const _[] = {(join_field<REC, FIELDS>(src[i++], length, dst), 0)...};
+    (void) _;
+  }
+
+  static void
+  split(
+    REC const* const src,
+    size_t const length,
+    char* const* const dst)
+  {
+    split(LAYOUT(), src, length, dst);
+  }
+
+  static void
+  join(
+    char const* const* const src,
+    size_t const length,
+    REC* const dst)
+  {
+    join(LAYOUT(), src, length, dst);
+  }
+
+};
+
+
+/*
+ * Transpose for a record layout.  Specialize for layouts with a faster
+ * kernel.
+ */
+template<class REC, class LAYOUT, class ENABLE=void>
+struct Transpose
+: FieldTranspose<REC, LAYOUT>
+{
+};
+
+
+#ifdef __SSE2__
+
+/*
+ * Shuffle transpose for 24-byte records of one 8-byte and four 4-byte fields,
+ * packed in that order, such as `Order`.  Four records are six 16-byte
+ * vectors, which eight shuffles turn into two vectors of the 8-byte field and
+ * one of each 4-byte field.  The loads and stores are unaligned, so records
+ * and columns may start anywhere.
+ */
+template<class REC, class T0, class T1, class T2, class T3, class T4>
+struct Transpose<
+  REC,
+  RecordLayout<
+    FieldLayout<T0, 0>, FieldLayout<T1, 8>, FieldLayout<T2, 12>,
+    FieldLayout<T3, 16>, FieldLayout<T4, 20>>,
+  typename std::enable_if<
+    sizeof(REC) == 24 && sizeof(T0) == 8 && sizeof(T1) == 4
+    && sizeof(T2) == 4 && sizeof(T3) == 4 && sizeof(T4) == 4>::type>
+{
+  using Scalar = FieldTranspose<REC, typename Layout<REC>::type>;
+
+  static void
+  split(
+    REC const* const src,
+    size_t const length,
+    char* const* const dst)
+  {
+    auto s = reinterpret_cast<double const*>(src);
+    auto d0 = reinterpret_cast<double*>(dst[0]);
+    auto d1 = reinterpret_cast<float*>(dst[1]);
+    auto d2 = reinterpret_cast<float*>(dst[2]);
+    auto d3 = reinterpret_cast<float*>(dst[3]);
+    auto d4 = reinterpret_cast<float*>(dst[4]);
+
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+      // Records r0..r3 as 4-byte words t t a b c d.
+      auto const v0 = _mm_loadu_pd(s +  0);     // t0 t0 a0 b0
+      auto const v1 = _mm_loadu_pd(s +  2);     // c0 d0 t1 t1
+      auto const v2 = _mm_loadu_pd(s +  4);     // a1 b1 c1 d1
+      auto const v3 = _mm_loadu_pd(s +  6);     // t2 t2 a2 b2
+      auto const v4 = _mm_loadu_pd(s +  8);     // c2 d2 t3 t3
+      auto const v5 = _mm_loadu_pd(s + 10);     // a3 b3 c3 d3
+
+      auto const t01 = _mm_shuffle_pd(v0, v1, 2);
+      auto const t23 = _mm_shuffle_pd(v3, v4, 2);
+      auto const ab01 = _mm_castpd_ps(_mm_shuffle_pd(v0, v2, 1));
+      auto const ab23 = _mm_castpd_ps(_mm_shuffle_pd(v3, v5, 1));
+      auto const cd01 = _mm_castpd_ps(_mm_shuffle_pd(v1, v2, 2));
+      auto const cd23 = _mm_castpd_ps(_mm_shuffle_pd(v4, v5, 2));
+
+      _mm_storeu_pd(d0, t01);
+      _mm_storeu_pd(d0 + 2, t23);
+      _mm_storeu_ps(d1, _mm_shuffle_ps(ab01, ab23, _MM_SHUFFLE(2, 0, 2, 0)));
+      _mm_storeu_ps(d2, _mm_shuffle_ps(ab01, ab23, _MM_SHUFFLE(3, 1, 3, 1)));
+      _mm_storeu_ps(d3, _mm_shuffle_ps(cd01, cd23, _MM_SHUFFLE(2, 0, 2, 0)));
+      _mm_storeu_ps(d4, _mm_shuffle_ps(cd01, cd23, _MM_SHUFFLE(3, 1, 3, 1)));
+
+      s += 12;
+      d0 += 4;
+      d1 += 4;
+      d2 += 4;
+      d3 += 4;
+      d4 += 4;
+    }
+
+    // The tail.
+    char* const tail[] = {
+      (char*) d0, (char*) d1, (char*) d2, (char*) d3, (char*) d4};
+    Scalar::split(src + i, length - i, tail);
+  }
+
+  static void
+  join(
+    char const* const* const src,
+    size_t const length,
+    REC* const dst)
+  {
+    auto s0 = reinterpret_cast<double const*>(src[0]);
+    auto s1 = reinterpret_cast<float const*>(src[1]);
+    auto s2 = reinterpret_cast<float const*>(src[2]);
+    auto s3 = reinterpret_cast<float const*>(src[3]);
+    auto s4 = reinterpret_cast<float const*>(src[4]);
+    auto d = reinterpret_cast<double*>(dst);
+
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+      auto const t01 = _mm_loadu_pd(s0);
+      auto const t23 = _mm_loadu_pd(s0 + 2);
+      auto const a = _mm_loadu_ps(s1);
+      auto const b = _mm_loadu_ps(s2);
+      auto const c = _mm_loadu_ps(s3);
+      auto const e = _mm_loadu_ps(s4);
+
+      auto const ab01 = _mm_castps_pd(_mm_unpacklo_ps(a, b));
+      auto const ab23 = _mm_castps_pd(_mm_unpackhi_ps(a, b));
+      auto const cd01 = _mm_castps_pd(_mm_unpacklo_ps(c, e));
+      auto const cd23 = _mm_castps_pd(_mm_unpackhi_ps(c, e));
+
+      _mm_storeu_pd(d +  0, _mm_shuffle_pd(t01, ab01, 0));
+      _mm_storeu_pd(d +  2, _mm_shuffle_pd(cd01, t01, 2));
+      _mm_storeu_pd(d +  4, _mm_shuffle_pd(ab01, cd01, 3));
+      _mm_storeu_pd(d +  6, _mm_shuffle_pd(t23, ab23, 0));
+      _mm_storeu_pd(d +  8, _mm_shuffle_pd(cd23, t23, 2));
+      _mm_storeu_pd(d + 10, _mm_shuffle_pd(ab23, cd23, 3));
+
+      s0 += 4;
+      s1 += 4;
+      s2 += 4;
+      s3 += 4;
+      s4 += 4;
+      d += 12;
+    }
+
+    char const* const tail[] = {
+      (char const*) s0, (char const*) s1, (char const*) s2, (char const*) s3,
+      (char const*) s4};
+    Scalar::join(tail, length - i, dst + i);
+  }
+
+};
+
+#endif  // __SSE2__
+
+}  // namespace columns
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Transposes records [start, stop) of `reader`, whose records must be
+ * contiguous, into `columns` starting at `pos`.  Runs in parallel on `pool`,
+ * if not null.
+ *
+ * If SIMD is true, uses a shuffle kernel for the record layout, if there is
+ * one; otherwise copies field by field.
+ */
+template<class READER, bool SIMD=true>
+inline void
+transpose(
+  READER const& reader,
+  size_t const start,
+  size_t const stop,
+  Columns<typename READER::value_type>& columns,
+  size_t const pos=0,
+  ThreadPool* const pool=nullptr)
+{
+  using REC = typename READER::value_type;
+  using LAYOUT = typename Columns<REC>::layout;
+  using Transpose = typename std::conditional<
+    SIMD,
+    columns::Transpose<REC, LAYOUT>,
+    columns::FieldTranspose<REC, LAYOUT>>::type;
+  assert(start <= stop && stop <= reader.length());
+  assert(pos + (stop - start) <= columns.length());
+  INSTRUMENT_COUNT(RECORDS_SCANNED, stop - start);
+  INSTRUMENT_COUNT(BYTES_SCANNED, (stop - start) * sizeof(REC));
+
+  auto const batch = get_batch(reader, start, stop);
+  auto const run = [&](size_t const i0, size_t const i1) {
+    char* ptrs[Columns<REC>::num_fields];
+    for (size_t i = i0; i < i1; i += columns::BLOCK_LENGTH) {
+      auto const length = std::min(i1 - i, columns::BLOCK_LENGTH);
+      columns.get_ptrs(pos + i, ptrs);
+      Transpose::split(batch.begin() + i, length, ptrs);
+    }
+  };
+  if (pool == nullptr)
+    run(0, batch.length());
+  else
+    pool->parallel_for(0, batch.length(), 64 * columns::BLOCK_LENGTH, run);
+}
+
+
+/*
+ * Interleaves columns [start, stop) back into records at `dst`.
+ */
+template<class REC, bool SIMD=true>
+inline void
+interleave(
+  Columns<REC> const& columns,
+  size_t const start,
+  size_t const stop,
+  REC* const dst,
+  ThreadPool* const pool=nullptr)
+{
+  using LAYOUT = typename Columns<REC>::layout;
+  using Transpose = typename std::conditional<
+    SIMD,
+    columns::Transpose<REC, LAYOUT>,
+    columns::FieldTranspose<REC, LAYOUT>>::type;
+  assert(start <= stop && stop <= columns.length());
+
+  auto const run = [&](size_t const i0, size_t const i1) {
+    char* ptrs[Columns<REC>::num_fields];
+    for (size_t i = i0; i < i1; i += columns::BLOCK_LENGTH) {
+      auto const length = std::min(i1 - i, columns::BLOCK_LENGTH);
+      columns.get_ptrs(start + i, ptrs);
+      Transpose::join(ptrs, length, dst + i);
+    }
+  };
+  if (pool == nullptr)
+    run(0, stop - start);
+  else
+    pool->parallel_for(0, stop - start, 64 * columns::BLOCK_LENGTH, run);
+}
+
+
@@ -0,0 +1,108 @@
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sys/stat.h>
+#include <vector>
+
+#include "dataset.hh"
+#include "instrument.hh"
+#include "parallel.hh"
+#include "reader.hh"
+#include "rec.hh"
+#include "stats.hh"
+#include "writer.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * Splits a file of orders into a dataset, by day and instrument bucket.
+ */
+void
+split(
+  char const* const filename,
+  std::string const& dirname,
+  uint32_t const num_buckets)
+{
+  mkdir(dirname.c_str(), 0755);
+  MmapReader<Order> reader(filename);
+
+  uint32_t day = 0;
+  std::vector<std::unique_ptr<RecordWriter<Order>>> writers(num_buckets);
+  size_t num_files = 0;
+  for (auto const& order : reader) {
+    if (get_day(order.timestamp) != day) {
+      day = get_day(order.timestamp);
+      for (auto& writer : writers)
+        writer.reset();
+    }
+    auto const bucket
+      = num_buckets == 1 ? 0 : get_bucket(order.instrument, num_buckets);
+    auto& writer = writers[bucket];
+    if (!writer) {
+      auto const name
+        = dirname + "/" 
+          + get_partition_filename(day, num_buckets == 1 ? -1 : (int) bucket);
+      unlink(name.c_str());
+      writer.reset(new RecordWriter<Order>(name.c_str()));
+      ++num_files;
+    }
+    writer->append(order);
+  }
+  std::cout << "wrote " << num_files << " files\n";
+}
+
+
+int
+main(
+  int const argc,
+  char const* const* const argv)
+{
+  if (argc >= 4 && argc <= 5 && strcmp(argv[1], "split") == 0) {
+    split(argv[2], argv[3], argc == 5 ? atol(argv[4]) : 1);
+    return 0;
+  }
+  if (!(argc >= 3 && argc <= 7 && strcmp(argv[1], "scan") == 0)) {
+    std::cerr << "usage: " << argv[0] << " split ORDERS DIR [BUCKETS]\n"
+              << "       " << argv[0]
+              << " scan DIR [BUCKETS [START_DATE END_DATE [THREADS]]]\n";
+    return 2;
+  }
+
+  Dataset<Order> const dataset(argv[2], argc >= 4 ? atol(argv[3]) : 1);
+  // The date range is inclusive.
+  Timestamp const start
+    = argc >= 6 ? get_day_of_date(atol(argv[4])) * NS_PER_DAY : 0;
+  Timestamp const end
+    = argc >= 6 ? (get_day_of_date(atol(argv[5])) + 1) * NS_PER_DAY
+    : UINT64_MAX;
+  std::unique_ptr<ThreadPool> pool;
+  if (argc == 7)
+    pool.reset(new ThreadPool(atol(argv[6])));
+
+  std::cout << "partitions = " << dataset.select(start, end).size()
+            << " of " << dataset.partitions().size() << "\n";
+
+  auto const volume = scan(
+    dataset, start, end, pool.get(), uint64_t{0},
+    [](RecordBatch<Order> const& batch) { return get_total_volume(batch); },
+    [](uint64_t const v0, uint64_t const v1) { return v0 + v1; });
+  std::cout << "total volume = " << volume << "\n";
+
+  auto const stats = scan(
+    dataset, start, end, pool.get(), std::map<Sid, OrderStats>{},
+    [](RecordBatch<Order> const& batch) { return get_order_stats(batch); },
+    [](std::map<Sid, OrderStats> stats,
+       std::map<Sid, OrderStats> const& later) {
+      merge(stats, later);
+      return stats;
+    });
+  std::cout << "instruments = " << stats.size() << "\n";
+
+#ifdef INSTRUMENT
+  std::cerr << get_instrument_totals();
+#endif
+
+  return 0;
+}
+
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <dirent.h>
+#include <string>
+#include <time.h>
+#include <vector>
+
+#include "hash.hh"
+#include "instrument.hh"
+#include "parallel.hh"
+#include "reader.hh"
+#include "recfile.hh"
+#include "rec.hh"
+
+//------------------------------------------------------------------------------
+
+uint64_t constexpr NS_PER_DAY = 86400ull * 1000000000ull;
+
+/*
+ * Returns the UTC day number since the epoch of a timestamp.
+ */
+inline uint32_t
+get_day(
+  Timestamp const timestamp)
+{
+  return timestamp / NS_PER_DAY;
+}
+
+
+/*
+ * Converts between day numbers and YYYYMMDD dates.
+ */
+inline uint32_t
+get_date(
+  uint32_t const day)
+{
+  time_t const t = (time_t) day * 86400;
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  return (tm.tm_year + 1900) * 10000 + (tm.tm_mon + 1) * 100 + tm.tm_mday;
+}
+
+
+inline uint32_t
+get_day_of_date(
+  uint32_t const date)
+{
+  struct tm tm = {};
+  tm.tm_year = date / 10000 - 1900;
+  tm.tm_mon = date / 100 % 100 - 1;
+  tm.tm_mday = date % 100;
+  return timegm(&tm) / 86400;
+}
+
+
+/*
+ * The instrument hash bucket of `sid`, for a dataset with `num_buckets`.
+ */
+inline uint32_t
+get_bucket(
+  Sid const sid,
+  uint32_t const num_buckets)
+{
+  return mix_hash(sid) % num_buckets;
+}
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * One file of a dataset: the records of one day, and optionally of one
+ * instrument hash bucket.
+ */
+struct Partition
+{
+  std::string filename;
+  uint32_t day;
+  // Instrument hash bucket, or -1 if the partition has all instruments.
+  int bucket;
+  // True for a record file, false for raw records.
+  bool recfile;
+
+  Timestamp start() const { return day * NS_PER_DAY; }
+  Timestamp end() const { return (day + 1) * NS_PER_DAY; }
+};
+
+
+/*
+ * Returns the file name, within a dataset directory, of a partition.
+ */
+inline std::string
+get_partition_filename(
+  uint32_t const day,
+  int const bucket=-1,
+  bool const recfile=false)
+{
+  char name[32];
+  if (bucket == -1)
+    snprintf(name, sizeof(name), "%08u", get_date(day));
+  else
+    snprintf(name, sizeof(name), "%08u-%d", get_date(day), bucket);
+  return std::string(name) + (recfile ? ".rec" : ".dat");
+}
+
+
+/*
+ * A directory of record files, partitioned by date and optionally by
+ * instrument hash bucket.
+ *
+ * Files are named `YYYYMMDD.dat`, or `YYYYMMDD-B.dat` for bucket B of
+ * `num_buckets`, by UTC date.  Files named `.rec` are record files.  Records
+ * in each file are sorted by timestamp.  Other files are ignored.
+ */
+template<class REC>
+class Dataset
+{
+public:
+
+  using value_type = REC;
+
+  Dataset(
+    std::string const& dirname,
+    uint32_t const num_buckets=1)
+  : dirname_(dirname),
+    num_buckets_(num_buckets)
+  {
+    assert(num_buckets_ > 0);
+
+    DIR* const dir = opendir(dirname.c_str());
+    assert(dir != nullptr);
+    while (auto const entry = readdir(dir)) {
+      unsigned date;
+      int bucket = -1;
+      char ext[8];
+      int end = 0;
+      auto const name = entry->d_name;
+      if (!((sscanf(name, "%8u-%d.%3[a-z]%n", &date, &bucket, ext, &end) == 3
+             && name[end] == '\0')
+            || (sscanf(name, "%8u.%3[a-z]%n", &date, ext, &end) == 2
+                && name[end] == '\0')))
+        continue;
+      std::string const extension = ext;
+      if (extension != "dat" && extension != "rec")
+        continue;
+      assert(bucket < (int) num_buckets_);
+      partitions_.push_back({
+        dirname_ + "/" + name, get_day_of_date(date), bucket,
+        extension == "rec"});
+    }
+    closedir(dir);
+
+    std::sort(
+      partitions_.begin(), partitions_.end(),
+      [](Partition const& p0, Partition const& p1) {
+        return p0.day < p1.day || (p0.day == p1.day && p0.bucket < p1.bucket);
+      });
+  }
+
+  std::vector<Partition> const& partitions() const { return partitions_; }
+  uint32_t num_buckets() const { return num_buckets_; }
+
+  /*
+   * Returns the partitions that may contain records in [start, end), and if
+   * `sid` is not null, with that instrument.
+   */
+  std::vector<Partition>
+  select(
+    Timestamp const start,
+    Timestamp const end,
+    Sid const* const sid=nullptr)
+    const
+  {
+    std::vector<Partition> selected;
+    for (auto const& partition : partitions_)
+      if (partition.end() <= start || end <= partition.start())
+        INSTRUMENT_COUNT(BLOCKS_SKIPPED, 1);
+      else if (sid != nullptr && partition.bucket != -1
+               && (uint32_t) partition.bucket
+                  != get_bucket(*sid, num_buckets_))
+        INSTRUMENT_COUNT(BLOCKS_SKIPPED, 1);
+      else
+        selected.push_back(partition);
+    return selected;
+  }
+
+private:
+
+  std::string const dirname_;
+  uint32_t const num_buckets_;
+  std::vector<Partition> partitions_;
+
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Invokes `fn(batch)` with the records of `partition` in [start, end), as a
+ * `RecordBatch<REC>`.  The file is mapped only for the duration of the call.
+ */
+template<class REC, class FN>
+inline auto
+scan_partition(
+  Partition const& partition,
+  Timestamp const start,
+  Timestamp const end,
+  FN&& fn)
+  -> decltype(fn(RecordBatch<REC>(nullptr, 0)))
+{
+  auto const scan = [&](RecordBatch<REC> const& batch) {
+    // Only the first and last days of the range need trimming.
+    auto const i0
+      = start <= partition.start() ? 0
+      : lower_bound_timestamp(batch, start, 0, batch.length());
+    auto const i1
+      = partition.end() <= end ? batch.length()
+      : lower_bound_timestamp(batch, end, i0, batch.length());
+    return fn(get_batch(batch, i0, i1));
+  };
+
+  if (partition.recfile) {
+    RecordFile file(partition.filename.c_str());
+    return scan(file.get_records<REC>());
+  }
+  else {
+    MmapReader<REC> reader(partition.filename.c_str());
+    return scan(get_batch(reader, 0, reader.length()));
+  }
+}
+
+
+/*
+ * Scans the partitions of `dataset` that may contain records in [start, end)
+ * in parallel on `pool`, or serially if it is null.  Computes `map(batch)` for
+ * each partition and folds the results in partition order with `combine`,
+ * starting with `init`.
+ *
+ * Each file is mapped only while it is scanned, so at most one per thread is
+ * mapped at a time.
+ */
+template<class REC, class T, class MAP, class COMBINE>
+inline T
+scan(
+  Dataset<REC> const& dataset,
+  Timestamp const start,
+  Timestamp const end,
+  ThreadPool* const pool,
+  T init,
+  MAP&& map,
+  COMBINE&& combine)
+{
+  auto const partitions = dataset.select(start, end);
+  return parallel_reduce(
+    pool, 0, partitions.size(), 1, init,
+    [&](size_t const i0, size_t const i1) {
+      auto result = init;
+      for (size_t i = i0; i < i1; ++i)
+        result = combine(
+          result, scan_partition<REC>(partitions[i], start, end, map));
+      return result;
+    },
+    combine);
+}
+
+
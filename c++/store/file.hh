@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+//------------------------------------------------------------------------------
+
+/*
+ * Writes `size` bytes at `data` to `fd`, retrying short and interrupted
+ * writes.  Throws `std::system_error` if a write fails.
+ */
+inline void
+write_all(
+  int const fd,
+  void const* const data,
+  size_t const size)
+{
+  auto const ptr = static_cast<char const*>(data);
+  for (size_t written = 0; written < size; ) {
+    auto const rval = write(fd, ptr + written, size - written);
+    if (rval == -1 && errno == EINTR)
+      continue;
+    if (rval == -1)
+      throw std::system_error(errno, std::generic_category(), "write");
+    // write() returns 0 only if it can make no progress.
+    if (rval == 0)
+      throw std::system_error(EIO, std::generic_category(), "write");
+    written += rval;
+  }
+}
+
+
+/*
+ * Writes `size` bytes at `data` to `fd` at `offset`, retrying short and
+ * interrupted writes.  Throws `std::system_error` if a write fails.  Since the
+ * offset is explicit, a retry overwrites whatever part was written.
+ */
+inline void
+pwrite_all(
+  int const fd,
+  void const* const data,
+  size_t const size,
+  off_t const offset)
+{
+  auto const ptr = static_cast<char const*>(data);
+  for (size_t written = 0; written < size; ) {
+    auto const rval
+      = pwrite(fd, ptr + written, size - written, offset + written);
+    if (rval == -1 && errno == EINTR)
+      continue;
+    if (rval == -1)
+      throw std::system_error(errno, std::generic_category(), "pwrite");
+    if (rval == 0)
+      throw std::system_error(EIO, std::generic_category(), "pwrite");
+    written += rval;
+  }
+}
+
+
+/*
+ * Replaces `filename` with `contents` atomically.  Writes them to a temporary
+ * file with a unique name, starting with a dot, in the same directory, syncs
+ * it, and renames it over `filename`.  Readers see either the old or the new
+ * file, and concurrent writers don't interfere; the last to rename wins.
+ *
+ * Throws `std::system_error` on failure, leaving `filename` as it was.
+ */
+inline void
+replace_file(
+  std::string const& filename,
+  std::string const& contents)
+{
+  auto const slash = filename.rfind('/');
+  auto const dir_length = slash == std::string::npos ? 0 : slash + 1;
+  auto tmp_filename
+    = filename.substr(0, dir_length) + "." + filename.substr(dir_length)
+      + ".XXXXXX";
+  int const fd = mkstemp(&tmp_filename[0]);
+  if (fd == -1)
+    throw std::system_error(errno, std::generic_category(), tmp_filename);
+
+  try {
+    // mkstemp() makes the file readable by its owner only.
+    if (fchmod(fd, 0644) == -1)
+      throw std::system_error(errno, std::generic_category(), "fchmod");
+    write_all(fd, contents.data(), contents.size());
+    if (fdatasync(fd) == -1)
+      throw std::system_error(errno, std::generic_category(), "fdatasync");
+    if (rename(tmp_filename.c_str(), filename.c_str()) == -1)
+      throw std::system_error(errno, std::generic_category(), filename);
+  }
+  catch (std::system_error const&) {
+    close(fd);
+    unlink(tmp_filename.c_str());
+    throw;
+  }
+  close(fd);
+}
+
+
@@ -1,18 +1,23 @@
 import math
 import random
 import struct
+import sys
 import time
 
 NS = 1E+9
 ORDER_FORMAT = "=QLlfL"
 assert struct.calcsize(ORDER_FORMAT) == 24
+TRADE_FORMAT = "=QLlf4x"
+assert struct.calcsize(TRADE_FORMAT) == 24
+
+count = int(sys.argv[1]) if len(sys.argv) > 1 else 10000000
 
 sids = [ random.randint(1000000, 2000000) for _ in range(5000) ]
 prices = { s: math.exp(2 + 4 * random.random()) for s in sids }
 timestamp = int(time.time() * NS)
 
-with open("orders.dat", "wb") as file:
-    for _ in range(10000000):
+with open("orders.dat", "wb") as file, open("trades.dat", "wb") as trades:
+    for _ in range(count):
         timestamp += int(random.random() * 10 * NS)
         instrument = random.choice(sids)
         order_type = 0  # flags
@@ -30,3 +35,9 @@ with open("orders.dat", "wb") as file:
 
         file.write(rec)
 
+        # Some orders trade, at least partially.
+        if random.random() < 0.3:
+            trade_size = int(size * random.random() / 100) * 100 or size
+            trades.write(struct.pack(
+                TRADE_FORMAT, timestamp, instrument, trade_size, price))
+
@@ -0,0 +1,86 @@
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "reader.hh"
+#include "rec.hh"
+#include "stats.hh"
+#include "table.hh"
+#include "timer.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * Groups order stats by KEY with each prefetch strategy, and prints timings.
+ * The table is sized up front, so the times are for lookups and not growth.
+ */
+template<class KEY, Prefetch PREFETCH>
+void
+run(
+  char const* const name,
+  MmapReader<Order> const& reader,
+  size_t const repeat)
+{
+  using Table = HashTable<typename KEY::type, OrderStats>;
+  double best = 0;
+  size_t size = 0;
+  size_t num_slots = 0;
+  uint64_t volume = 0;
+  for (size_t r = 0; r < repeat; ++r) {
+    Table table(reader.length());
+    auto const start = now();
+    group_order_stats<KEY, PREFETCH>(reader, table);
+    auto const elapsed = now() - start;
+    if (r == 0 || elapsed < best)
+      best = elapsed;
+
+    size = table.size();
+    num_slots = table.num_slots();
+    volume = 0;
+    table.for_each([&](typename KEY::type, OrderStats const& s) {
+      volume += s.volume;
+    });
+  }
+
+  std::cout << name
+            << ": groups=" << size
+            << " table=" << num_slots * sizeof(typename Table::Slot) / 1E+6
+            << " MB volume=" << volume
+            << " " << best / reader.length() * 1E+9 << " ns/rec\n";
+}
+
+
+int
+main(
+  int const argc,
+  char const* const* const argv)
+{
+  if (argc < 2 || argc > 4) {
+    std::cerr << "usage: " << argv[0] << " FILENAME [sid|minute [REPEAT]]\n";
+    return 2;
+  }
+  char const* const filename = argv[1];
+  std::string const key = argc >= 3 ? argv[2] : "minute";
+  size_t const repeat = argc >= 4 ? atol(argv[3]) : 3;
+  assert(repeat > 0);
+
+  MmapReader<Order> reader(filename);
+  if (key == "sid") {
+    run<BySid, Prefetch::NONE>("none", reader, repeat);
+    run<BySid, Prefetch::GROUP>("group", reader, repeat);
+    run<BySid, Prefetch::AHEAD>("ahead", reader, repeat);
+  }
+  else if (key == "minute") {
+    run<BySidMinute, Prefetch::NONE>("none", reader, repeat);
+    run<BySidMinute, Prefetch::GROUP>("group", reader, repeat);
+    run<BySidMinute, Prefetch::AHEAD>("ahead", reader, repeat);
+  }
+  else {
+    std::cerr << "unknown key: " << key << "\n";
+    return 2;
+  }
+
+  return 0;
+}
+
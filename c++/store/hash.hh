@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+//------------------------------------------------------------------------------
+
+/*
+ * Mixes the bits of `x`, so that every bit of the result depends on every bit
+ * of the key.  Keys like instrument ids differ only in their low bits; mixed,
+ * any bits of the hash can pick a bucket, partition, or filter bit.
+ */
+inline uint64_t
+mix_hash(
+  uint64_t x)
+{
+  // Murmur3 finalizer.
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdull;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ull;
+  x ^= x >> 33;
+  return x;
+}
+
+
+/*
+ * Hashes `size` bytes at `data`, eight at a time, as a checksum of file
+ * contents.
+ */
+inline uint64_t
+hash_bytes(
+  void const* const data,
+  size_t const size,
+  uint64_t hash=0)
+{
+  auto const bytes = static_cast<char const*>(data);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, bytes + i, 8);
+    // Add a constant, so that runs of zeros don't hash to zero.
+    hash = mix_hash(hash ^ word) + 0x9e3779b97f4a7c15ull;
+  }
+  uint64_t word = 0;
+  if (i < size)
+    memcpy(&word, bytes + i, size - i);
+  // The length distinguishes trailing zeros.
+  return mix_hash(hash ^ word) ^ size;
+}
+
+
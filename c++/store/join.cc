@@ -0,0 +1,57 @@
+#include <iostream>
+
+#include "join.hh"
+#include "reader.hh"
+#include "rec.hh"
+#include "timer.hh"
+
+//------------------------------------------------------------------------------
+
+int
+main(
+  int const argc,
+  char const* const* const argv)
+{
+  if (argc != 3) {
+    std::cerr << "usage: " << argv[0] << " ORDERS TRADES\n";
+    return 2;
+  }
+
+  MmapReader<Order> orders(argv[1]);
+  MmapReader<Trade> trades(argv[2]);
+
+  // Match each order to the trades it produced.
+  auto start = now();
+  HashJoin<MmapReader<Trade>> join(trades);
+  uint64_t traded = 0;
+  auto const num_matches = join.probe(
+    orders,
+    [&traded](Order const& order, Trade const& trade) {
+      traded += std::abs(trade.size);
+    });
+  auto elapsed = now() - start;
+  std::cout << "hash join: " << num_matches << " matches, "
+            << traded << " traded\n";
+  std::cerr << "elapsed: " << elapsed << " = "
+            << elapsed / (orders.length() + trades.length()) / 1E-6
+            << " µs/rec\n";
+
+  // Match each trade to the latest order for its instrument.
+  start = now();
+  uint64_t num_same_price = 0;
+  auto const num_asof = asof_join(
+    trades, orders,
+    [&num_same_price](Trade const& trade, Order const* const order) {
+      if (order != nullptr && order->price == trade.price)
+        ++num_same_price;
+    });
+  elapsed = now() - start;
+  std::cout << "as-of join: " << num_asof << " of " << trades.length()
+            << " matched, " << num_same_price << " at order price\n";
+  std::cerr << "elapsed: " << elapsed << " = "
+            << elapsed / (orders.length() + trades.length()) / 1E-6
+            << " µs/rec\n";
+
+  return 0;
+}
+
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "hash.hh"
+#include "rec.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * Join key on instrument only.
+ */
+struct SidKey
+{
+  template<class REC>
+  static uint64_t
+  hash(
+    REC const& rec)
+  {
+    return mix_hash(rec.instrument);
+  }
+
+  template<class REC0, class REC1>
+  static bool
+  equal(
+    REC0 const& rec0,
+    REC1 const& rec1)
+  {
+    return rec0.instrument == rec1.instrument;
+  }
+};
+
+
+/*
+ * Join key on instrument and timestamp, e.g. an order and the trade it
+ * produced.
+ */
+struct SidTimeKey
+{
+  template<class REC>
+  static uint64_t
+  hash(
+    REC const& rec)
+  {
+    return mix_hash(rec.timestamp ^ ((uint64_t) rec.instrument << 32));
+  }
+
+  template<class REC0, class REC1>
+  static bool
+  equal(
+    REC0 const& rec0,
+    REC1 const& rec1)
+  {
+    return
+      rec0.instrument == rec1.instrument
+      && rec0.timestamp == rec1.timestamp;
+  }
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Hash join, with a hash table built over one reader.
+ *
+ * The table holds record positions only; build records are accessed in place,
+ * so a `MmapReader` build side is not copied.  The reader must outlive the
+ * join.
+ */
+template<class BUILD, class KEY=SidTimeKey>
+class HashJoin
+{
+public:
+
+  using value_type = typename BUILD::value_type;
+
+  static size_t constexpr BATCH_SIZE = 1024;
+
+  HashJoin(
+    BUILD const& build)
+  : build_(build)
+  {
+    auto const length = build_.length();
+    assert(length < NONE);
+
+    size_t num_buckets = 16;
+    while (num_buckets < 2 * length)
+      num_buckets *= 2;
+    mask_ = num_buckets - 1;
+    heads_.assign(num_buckets, NONE);
+    next_.resize(length);
+
+    // Insert in reverse, so that each chain is in file order.
+    for (size_t i = length; i-- > 0; ) {
+      auto& head = heads_[KEY::hash(build_.get(i)) & mask_];
+      next_[i] = head;
+      head = i;
+    }
+  }
+
+  HashJoin(HashJoin const&) = delete;
+  HashJoin(HashJoin&&) = delete;
+
+  /*
+   * Streams records from `probe` through the table in batches, and invokes
+   * `fn(probe_rec, build_rec)` for each matching pair.  Returns the number of
+   * matches.
+   */
+  template<class PROBE, class FN>
+  size_t
+  probe(
+    PROBE const& probe,
+    FN&& fn)
+    const
+  {
+    size_t num_matches = 0;
+    uint32_t buckets[BATCH_SIZE];
+    auto const length = probe.length();
+
+    for (size_t start = 0; start < length; start += BATCH_SIZE) {
+      auto const batch = std::min(BATCH_SIZE, length - start);
+
+      // Hash the batch first, and prefetch the bucket heads.
+      for (size_t j = 0; j < batch; ++j) {
+        buckets[j] = KEY::hash(probe.get(start + j)) & mask_;
+        __builtin_prefetch(&heads_[buckets[j]]);
+      }
+
+      for (size_t j = 0; j < batch; ++j) {
+        auto const& rec = probe.get(start + j);
+        for (auto i = heads_[buckets[j]]; i != NONE; i = next_[i]) {
+          auto const& build_rec = build_.get(i);
+          if (KEY::equal(rec, build_rec)) {
+            fn(rec, build_rec);
+            ++num_matches;
+          }
+        }
+      }
+    }
+
+    return num_matches;
+  }
+
+private:
+
+  static uint32_t constexpr NONE = UINT32_MAX;
+
+  BUILD const& build_;
+  size_t mask_;
+  std::vector<uint32_t> heads_;
+  std::vector<uint32_t> next_;
+
+};
+
+
+template<class BUILD, class KEY>
+size_t constexpr HashJoin<BUILD, KEY>::BATCH_SIZE;
+
+template<class BUILD, class KEY>
+uint32_t constexpr HashJoin<BUILD, KEY>::NONE;
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * As-of join: for each record in `left`, finds the latest record in `right`
+ * with the same instrument and a timestamp at or before it.
+ *
+ * Both readers must be sorted by timestamp; the join is a single merge pass
+ * over both.  Invokes `fn(left_rec, right_ptr)` for each left record, where
+ * `right_ptr` is null if there is no earlier right record for the instrument.
+ * Returns the number of left records that matched.
+ */
+template<class LEFT, class RIGHT, class FN>
+size_t
+asof_join(
+  LEFT const& left,
+  RIGHT const& right,
+  FN&& fn)
+{
+  using Right = typename RIGHT::value_type;
+
+  std::unordered_map<Sid, Right const*> latest;
+  size_t num_matches = 0;
+  size_t r = 0;
+  auto const right_length = right.length();
+
+  for (auto const& rec : left) {
+    // Advance the right side up to this record's timestamp.
+    for (; r < right_length; ++r) {
+      auto const& right_rec = right.get(r);
+      if (right_rec.timestamp > rec.timestamp)
+        break;
+      assert(r == 0 || right.get(r - 1).timestamp <= right_rec.timestamp);
+      latest[right_rec.instrument] = &right_rec;
+    }
+
+    auto const i = latest.find(rec.instrument);
+    if (i == latest.end())
+      fn(rec, (Right const*) nullptr);
+    else {
+      fn(rec, i->second);
+      ++num_matches;
+    }
+  }
+
+  return num_matches;
+}
+
+
@@ -0,0 +1,1133 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "columns.hh"
+#include "instrument.hh"
+#include "parallel.hh"
+#include "reader.hh"
+#include "rec.hh"
+#include "reflect.hh"
+#include "sum.hh"
+
+/*
+ * A push-based query pipeline over batches of columns.
+ *
+ * A query is a source followed by operators, for example,
+ *
+ *     auto const volume_by_sid = pipeline::run(
+ *       pipeline::scan(reader),
+ *       pipeline::where<2>(std::greater<>(), 0),
+ *       pipeline::group_by<1>(pipeline::Sum<2>()));
+ *
+ * The source pushes batches of up to `BATCH_LENGTH` rows, each field in its
+ * own column, into the first operator, which pushes its output into the next.
+ * Columns are numbered as the fields of the record; `project` appends a
+ * column after them.  A filter doesn't move data, but attaches a selection of
+ * the rows that pass.
+ *
+ * Operators are templates on the batch type and on the next operator, so the
+ * whole pipeline is one type and operators inline into each other.  Per row
+ * work runs in loops over a batch's columns, which the compiler can
+ * vectorize.
+ */
+
+namespace pipeline {
+
+/*
+ * Rows per batch.  Small enough that a batch's columns stay in L1.
+ */
+size_t constexpr BATCH_LENGTH = 2048;
+
+//------------------------------------------------------------------------------
+
+/*
+ * A batch of rows, as one column of each type T.  Columns aren't owned.
+ */
+template<class... T>
+struct Batch
+{
+  using types = std::tuple<T...>;
+  static size_t constexpr num_columns = sizeof...(T);
+
+  template<size_t I>
+  using type = typename std::tuple_element<I, types>::type;
+
+  // Number of rows in each column.
+  size_t length;
+  // Positions of the selected rows in order, or null if all rows are.
+  uint32_t const* sel;
+  size_t num_selected;
+  std::tuple<T const*...> columns;
+
+  template<size_t I>
+  type<I> const*
+  get()
+    const
+  {
+    return std::get<I>(columns);
+  }
+
+  /*
+   * Invokes `fn(i)` for the position of each selected row.
+   */
+  template<class FN>
+  void
+  for_each(
+    FN&& fn)
+    const
+  {
+    if (sel == nullptr)
+      for (size_t i = 0; i < length; ++i)
+        fn(i);
+    else
+      for (size_t j = 0; j < num_selected; ++j)
+        fn(sel[j]);
+  }
+};
+
+
+/*
+ * Returns the value in column I of row `i` of `batch`.
+ */
+template<size_t I, class BATCH>
+inline typename BATCH::template type<I>
+value(
+  BATCH const& batch,
+  size_t const i)
+{
+  return batch.template get<I>()[i];
+}
+
+
+template<class LAYOUT> struct BatchOf;
+
+template<class... FIELDS>
+struct BatchOf<RecordLayout<FIELDS...>>
+{
+  using type = Batch<typename FIELDS::type...>;
+};
+
+
+template<class BATCH, class T> struct Append;
+
+template<class... T, class U>
+struct Append<Batch<T...>, U>
+{
+  using type = Batch<T..., U>;
+};
+
+
+//------------------------------------------------------------------------------
+// Building and running pipelines
+//
+// An operator is described by an object with
+//
+//     template<class BATCH> using output = ...;
+//     template<class BATCH, class SINK> auto bind(SINK) const;
+//
+// where `bind` returns the operator for input batches of BATCH, pushing
+// batches of `output<BATCH>` into SINK.  The last operator has instead
+//
+//     template<class BATCH> auto bind() const;
+//
+// A bound operator has `push(batch)`, `finish()`, and `result()`, which
+// returns the query result.
+
+template<class BATCH, class OP>
+inline auto
+bind(
+  OP const& op)
+{
+  return op.template bind<BATCH>();
+}
+
+
+template<class BATCH, class OP, class NEXT, class... OPS>
+inline auto
+bind(
+  OP const& op,
+  NEXT const& next,
+  OPS const&... ops)
+{
+  return op.template bind<BATCH>(
+    bind<typename OP::template output<BATCH>>(next, ops...));
+}
+
+
+/*
+ * Runs a query, and returns the result of its last operator.
+ */
+template<class SOURCE, class... OPS>
+inline auto
+run(
+  SOURCE const& source,
+  OPS const&... ops)
+{
+  auto sink = bind<typename SOURCE::batch_type>(ops...);
+  source.run(sink);
+  return sink.result();
+}
+
+
+/*
+ * Base of operators that push into another.
+ */
+template<class SINK>
+class Stage
+{
+public:
+
+  Stage(SINK sink) : sink_(std::move(sink)) {}
+
+  void finish() { sink_.finish(); }
+  auto result() { return sink_.result(); }
+
+protected:
+
+  SINK sink_;
+
+};
+
+
+//------------------------------------------------------------------------------
+// Sources
+
+/*
+ * Scans records [start, stop) of a reader whose records are contiguous,
+ * transposing them into batches of columns.
+ */
+template<class READER>
+class Scan
+{
+public:
+
+  using REC = typename READER::value_type;
+  using layout = typename Layout<REC>::type;
+  using batch_type = typename BatchOf<layout>::type;
+
+  Scan(
+    READER const& reader,
+    size_t const start,
+    size_t const stop)
+  : reader_(reader),
+    start_(start),
+    stop_(stop)
+  {
+    assert(start_ <= stop_ && stop_ <= reader_.length());
+  }
+
+  template<class SINK>
+  void
+  run(
+    SINK& sink)
+    const
+  {
+    INSTRUMENT_STAGE(SCAN);
+    INSTRUMENT_COUNT(RECORDS_SCANNED, stop_ - start_);
+    INSTRUMENT_COUNT(BYTES_SCANNED, (stop_ - start_) * sizeof(REC));
+    Columns<REC> columns(BATCH_LENGTH);
+    char* ptrs[layout::num_fields];
+    columns.get_ptrs(0, ptrs);
+    for (size_t i = start_; i < stop_; i += BATCH_LENGTH) {
+      auto const length = std::min(stop_ - i, BATCH_LENGTH);
+      auto const batch = ::get_batch(reader_, i, i + length);
+      columns::Transpose<REC, layout>::split(batch.begin(), length, ptrs);
+      sink.push(
+        make_batch(
+          length, ptrs, std::make_index_sequence<layout::num_fields>()));
+    }
+    sink.finish();
+  }
+
+private:
+
+  template<size_t... I>
+  static batch_type
+  make_batch(
+    size_t const length,
+    char* const* const ptrs,
+    std::index_sequence<I...>)
+  {
+    return {
+      length, nullptr, length,
+      std::make_tuple(
+        reinterpret_cast<typename batch_type::template type<I> const*>(
+          ptrs[I])...)};
+  }
+
+  READER const& reader_;
+  size_t const start_;
+  size_t const stop_;
+
+};
+
+
+template<class READER>
+inline Scan<READER>
+scan(
+  READER const& reader)
+{
+  return {reader, 0, reader.length()};
+}
+
+
+template<class READER>
+inline Scan<READER>
+scan(
+  READER const& reader,
+  size_t const start,
+  size_t const stop)
+{
+  return {reader, start, stop};
+}
+
+
+//------------------------------------------------------------------------------
+// Operators
+
+/*
+ * Selects rows for which `pred(batch, i)` is true.
+ */
+template<class PRED>
+struct FilterOp
+{
+  PRED pred;
+
+  template<class BATCH>
+  using output = BATCH;
+
+  template<class BATCH, class SINK>
+  class Operator
+  : public Stage<SINK>
+  {
+  public:
+
+    Operator(PRED const& pred, SINK sink)
+    : Stage<SINK>(std::move(sink)),
+      pred_(pred),
+      sel_(BATCH_LENGTH)
+    {
+    }
+
+    void
+    push(
+      BATCH const& batch)
+    {
+      // Write every position, and advance past it if it's selected.
+      auto const sel = sel_.data();
+      size_t n = 0;
+      batch.for_each([&](size_t const i) {
+        sel[n] = i;
+        n += pred_(batch, i) ? 1 : 0;
+      });
+      if (n > 0) {
+        auto out = batch;
+        out.sel = sel;
+        out.num_selected = n;
+        this->sink_.push(out);
+      }
+    }
+
+  private:
+
+    PRED const pred_;
+    std::vector<uint32_t> sel_;
+
+  };
+
+  template<class BATCH, class SINK>
+  Operator<BATCH, SINK>
+  bind(
+    SINK sink)
+    const
+  {
+    return {pred, std::move(sink)};
+  }
+};
+
+
+template<class PRED>
+inline FilterOp<PRED>
+filter(
+  PRED pred)
+{
+  return {pred};
+}
+
+
+/*
+ * Selects rows for which `cmp(value<I>(batch, i), val)` is true.
+ */
+template<size_t I, class CMP, class T>
+inline auto
+where(
+  CMP const cmp,
+  T const val)
+{
+  return filter([cmp, val](auto const& batch, size_t const i) {
+    return cmp(value<I>(batch, i), val);
+  });
+}
+
+
+/*
+ * Appends a column of `fn(batch, i)`.
+ */
+template<class FN>
+struct ProjectOp
+{
+  FN fn;
+
+  template<class BATCH>
+  using result_type = typename std::decay<
+    decltype(std::declval<FN>()(std::declval<BATCH const&>(), 0))>::type;
+
+  template<class BATCH>
+  using output = typename Append<BATCH, result_type<BATCH>>::type;
+
+  template<class BATCH, class SINK>
+  class Operator
+  : public Stage<SINK>
+  {
+  public:
+
+    Operator(FN const& fn, SINK sink)
+    : Stage<SINK>(std::move(sink)),
+      fn_(fn),
+      values_(BATCH_LENGTH)
+    {
+    }
+
+    void
+    push(
+      BATCH const& batch)
+    {
+      auto const values = values_.data();
+      batch.for_each([&](size_t const i) { values[i] = fn_(batch, i); });
+      this->sink_.push(output<BATCH>{
+        batch.length, batch.sel, batch.num_selected,
+        std::tuple_cat(batch.columns, std::make_tuple(values))});
+    }
+
+  private:
+
+    FN const fn_;
+    std::vector<result_type<BATCH>> values_;
+
+  };
+
+  template<class BATCH, class SINK>
+  Operator<BATCH, SINK>
+  bind(
+    SINK sink)
+    const
+  {
+    return {fn, std::move(sink)};
+  }
+};
+
+
+template<class FN>
+inline ProjectOp<FN>
+project(
+  FN fn)
+{
+  return {fn};
+}
+
+
+/*
+ * Keeps columns I..., in that order.
+ */
+template<size_t... I>
+struct SelectOp
+{
+  template<class BATCH>
+  using output = Batch<typename BATCH::template type<I>...>;
+
+  template<class BATCH, class SINK>
+  class Operator
+  : public Stage<SINK>
+  {
+  public:
+
+    using Stage<SINK>::Stage;
+
+    void
+    push(
+      BATCH const& batch)
+    {
+      this->sink_.push(output<BATCH>{
+        batch.length, batch.sel, batch.num_selected,
+        std::make_tuple(batch.template get<I>()...)});
+    }
+
+  };
+
+  template<class BATCH, class SINK>
+  Operator<BATCH, SINK>
+  bind(
+    SINK sink)
+    const
+  {
+    return {std::move(sink)};
+  }
+};
+
+
+template<size_t... I>
+inline SelectOp<I...>
+select()
+{
+  return {};
+}
+
+
+/*
+ * Passes the first `limit` selected rows.
+ */
+struct LimitOp
+{
+  size_t limit;
+
+  template<class BATCH>
+  using output = BATCH;
+
+  template<class BATCH, class SINK>
+  class Operator
+  : public Stage<SINK>
+  {
+  public:
+
+    Operator(size_t const limit, SINK sink)
+    : Stage<SINK>(std::move(sink)),
+      remaining_(limit)
+    {
+    }
+
+    void
+    push(
+      BATCH const& batch)
+    {
+      if (remaining_ == 0)
+        return;
+      auto out = batch;
+      if (out.sel == nullptr)
+        out.length = out.num_selected = std::min(out.length, remaining_);
+      else
+        out.num_selected = std::min(out.num_selected, remaining_);
+      remaining_ -= out.num_selected;
+      this->sink_.push(out);
+    }
+
+  private:
+
+    size_t remaining_;
+
+  };
+
+  template<class BATCH, class SINK>
+  Operator<BATCH, SINK>
+  bind(
+    SINK sink)
+    const
+  {
+    return {limit, std::move(sink)};
+  }
+};
+
+
+inline LimitOp
+limit(
+  size_t const limit)
+{
+  return {limit};
+}
+
+
+/*
+ * Sorts rows by column I, stably, and ascending or descending.  Buffers all
+ * rows until the input is finished, then pushes them in batches.
+ */
+template<size_t I, bool DESCENDING=false>
+struct SortOp
+{
+  template<class BATCH>
+  using output = BATCH;
+
+  template<class BATCH, class SINK>
+  class Operator;
+
+  template<class... T, class SINK>
+  class Operator<Batch<T...>, SINK>
+  : public Stage<SINK>
+  {
+  public:
+
+    using BATCH = Batch<T...>;
+    using Stage<SINK>::Stage;
+
+    void
+    push(
+      BATCH const& batch)
+    {
+      append(batch, std::index_sequence_for<T...>());
+    }
+
+    void
+    finish()
+    {
+      auto const& keys = std::get<I>(rows_);
+      std::vector<uint32_t> order(keys.size());
+      std::iota(order.begin(), order.end(), 0);
+      std::stable_sort(
+        order.begin(), order.end(),
+        [&keys](uint32_t const i0, uint32_t const i1) {
+          return DESCENDING ? keys[i1] < keys[i0] : keys[i0] < keys[i1];
+        });
+
+      std::tuple<std::vector<T>...> out{std::vector<T>(BATCH_LENGTH)...};
+      for (size_t i = 0; i < order.size(); i += BATCH_LENGTH) {
+        auto const length = std::min(order.size() - i, BATCH_LENGTH);
+        this->sink_.push(
+          gather(&order[i], length, out, std::index_sequence_for<T...>()));
+      }
+      this->sink_.finish();
+    }
+
+  private:
+
+    template<size_t... J>
+    void
+    append(
+      BATCH const& batch,
+      std::index_sequence<J...>)
+    {
+      batch.for_each([&](size_t const i) {
+        int const _[] = {
+          (std::get<J>(rows_).push_back(batch.template get<J>()[i]), 0)...};
+        (void) _;
+      });
+    }
+
+    template<size_t... J>
+    BATCH
+    gather(
+      uint32_t const* const order,
+      size_t const length,
+      std::tuple<std::vector<T>...>& out,
+      std::index_sequence<J...>)
+    {
+      for (size_t i = 0; i < length; ++i) {
+        int const _[] = {
+          (std::get<J>(out)[i] = std::get<J>(rows_)[order[i]], 0)...};
+        (void) _;
+      }
+      return {
+        length, nullptr, length, std::make_tuple(std::get<J>(out).data()...)};
+    }
+
+    std::tuple<std::vector<T>...> rows_;
+
+  };
+
+  template<class BATCH, class SINK>
+  Operator<BATCH, SINK>
+  bind(
+    SINK sink)
+    const
+  {
+    return {std::move(sink)};
+  }
+};
+
+
+template<size_t I, bool DESCENDING=false>
+inline SortOp<I, DESCENDING>
+sort()
+{
+  return {};
+}
+
+
+//------------------------------------------------------------------------------
+// Aggregators
+//
+// An aggregator has, for input batches of BATCH,
+//
+//     template<class BATCH> using value_type = ...;
+//     template<class BATCH> static value_type<BATCH> init();
+//     template<class BATCH>
+//       static void update(value_type<BATCH>&, BATCH const&, size_t i);
+//     template<class T> static void merge(T&, T const& later);
+//
+// `merge` combines the aggregate of later rows into an earlier one, so that
+// chunks of rows can be aggregated in parallel.
+
+struct Count
+{
+  template<class BATCH> using value_type = uint64_t;
+
+  template<class BATCH> static uint64_t init() { return 0; }
+
+  template<class BATCH>
+  static void update(uint64_t& acc, BATCH const&, size_t) { ++acc; }
+
+  static void merge(uint64_t& acc, uint64_t const later) { acc += later; }
+};
+
+
+template<size_t I>
+struct Sum
+{
+  template<class BATCH>
+  using value_type = SumType<typename BATCH::template type<I>>;
+
+  template<class BATCH> static value_type<BATCH> init() { return 0; }
+
+  template<class BATCH>
+  static void
+  update(
+    value_type<BATCH>& acc,
+    BATCH const& batch,
+    size_t const i)
+  {
+    acc += value<I>(batch, i);
+  }
+
+  template<class T> static void merge(T& acc, T const later) { acc += later; }
+};
+
+
+/*
+ * Compensated sum of column I, for floating point values.
+ */
+template<size_t I>
+struct KahanSum
+{
+  template<class BATCH>
+  using value_type = Compensated<double>;
+
+  template<class BATCH> static Compensated<double> init() { return {}; }
+
+  template<class BATCH>
+  static void
+  update(
+    Compensated<double>& acc,
+    BATCH const& batch,
+    size_t const i)
+  {
+    acc.add(value<I>(batch, i));
+  }
+
+  static void
+  merge(
+    Compensated<double>& acc,
+    Compensated<double> const& later)
+  {
+    acc.add(later);
+  }
+};
+
+
+template<size_t I>
+struct Min
+{
+  template<class BATCH>
+  using value_type = typename BATCH::template type<I>;
+
+  template<class BATCH>
+  static value_type<BATCH>
+  init()
+  {
+    using limits = std::numeric_limits<value_type<BATCH>>;
+    return limits::has_infinity ? limits::infinity() : limits::max();
+  }
+
+  template<class BATCH>
+  static void
+  update(
+    value_type<BATCH>& acc,
+    BATCH const& batch,
+    size_t const i)
+  {
+    acc = std::min(acc, value<I>(batch, i));
+  }
+
+  template<class T>
+  static void merge(T& acc, T const later) { acc = std::min(acc, later); }
+};
+
+
+template<size_t I>
+struct Max
+{
+  template<class BATCH>
+  using value_type = typename BATCH::template type<I>;
+
+  template<class BATCH>
+  static value_type<BATCH>
+  init()
+  {
+    using limits = std::numeric_limits<value_type<BATCH>>;
+    return limits::has_infinity ? -limits::infinity() : limits::lowest();
+  }
+
+  template<class BATCH>
+  static void
+  update(
+    value_type<BATCH>& acc,
+    BATCH const& batch,
+    size_t const i)
+  {
+    acc = std::max(acc, value<I>(batch, i));
+  }
+
+  template<class T>
+  static void merge(T& acc, T const later) { acc = std::max(acc, later); }
+};
+
+
+template<size_t I>
+struct Last
+{
+  template<class BATCH>
+  using value_type = typename BATCH::template type<I>;
+
+  template<class BATCH> static value_type<BATCH> init() { return {}; }
+
+  template<class BATCH>
+  static void
+  update(
+    value_type<BATCH>& acc,
+    BATCH const& batch,
+    size_t const i)
+  {
+    acc = value<I>(batch, i);
+  }
+
+  // Chunks with no rows don't produce an aggregate to merge.
+  template<class T> static void merge(T& acc, T const later) { acc = later; }
+};
+
+
+//------------------------------------------------------------------------------
+// Terminal operators
+
+/*
+ * Aggregates all selected rows with AGGS..., and returns a tuple of their
+ * values.
+ */
+template<class... AGGS>
+struct AggregateOp
+{
+  template<class BATCH>
+  class Operator
+  {
+  public:
+
+    using Values = std::tuple<typename AGGS::template value_type<BATCH>...>;
+
+    void
+    push(
+      BATCH const& batch)
+    {
+      batch.for_each([&](size_t const i) {
+        update(batch, i, std::index_sequence_for<AGGS...>());
+      });
+    }
+
+    void finish() {}
+    Values result() { return values_; }
+
+    /*
+     * Merges `later`, the values of later rows, into `values`.
+     */
+    static void
+    merge(
+      Values& values,
+      Values const& later)
+    {
+      merge(values, later, std::index_sequence_for<AGGS...>());
+    }
+
+  private:
+
+    template<size_t... J>
+    static void
+    merge(
+      Values& values,
+      Values const& later,
+      std::index_sequence<J...>)
+    {
+      int const _[] = {
+        (AGGS::merge(std::get<J>(values), std::get<J>(later)), 0)...};
+      (void) _;
+    }
+
+    template<size_t... J>
+    void
+    update(
+      BATCH const& batch,
+      size_t const i,
+      std::index_sequence<J...>)
+    {
+      int const _[] = {
+        (AGGS::template update<BATCH>(std::get<J>(values_), batch, i), 0)...};
+      (void) _;
+    }
+
+    Values values_{AGGS::template init<BATCH>()...};
+
+  };
+
+  template<class BATCH>
+  Operator<BATCH>
+  bind()
+    const
+  {
+    return {};
+  }
+};
+
+
+template<class... AGGS>
+inline AggregateOp<AGGS...>
+aggregate(
+  AGGS...)
+{
+  return {};
+}
+
+
+/*
+ * Aggregates selected rows with AGGS..., grouped by column KEY, and returns a
+ * map from key to a tuple of their values.
+ */
+template<size_t KEY, class... AGGS>
+struct GroupByOp
+{
+  template<class BATCH>
+  class Operator
+  {
+  public:
+
+    using Key = typename BATCH::template type<KEY>;
+    using Values = std::tuple<typename AGGS::template value_type<BATCH>...>;
+
+    void
+    push(
+      BATCH const& batch)
+    {
+      auto const keys = batch.template get<KEY>();
+      batch.for_each([&](size_t const i) {
+        auto j = table_.find(keys[i]);
+        if (j == table_.end())
+          j = table_.emplace(keys[i], init()).first;
+        update(j->second, batch, i, std::index_sequence_for<AGGS...>());
+      });
+    }
+
+    void finish() {}
+
+    std::map<Key, Values>
+    result()
+    {
+      return {table_.begin(), table_.end()};
+    }
+
+    /*
+     * Merges `later`, the groups of later rows, into `groups`.
+     */
+    static void
+    merge(
+      std::map<Key, Values>& groups,
+      std::map<Key, Values> const& later)
+    {
+      INSTRUMENT_STAGE(MERGE);
+      for (auto const& i : later) {
+        auto const j = groups.insert(i);
+        if (!j.second)
+          AggregateOp<AGGS...>::template Operator<BATCH>::merge(
+            j.first->second, i.second);
+      }
+    }
+
+  private:
+
+    static Values init() { return Values{AGGS::template init<BATCH>()...}; }
+
+    template<size_t... J>
+    static void
+    update(
+      Values& values,
+      BATCH const& batch,
+      size_t const i,
+      std::index_sequence<J...>)
+    {
+      int const _[] = {
+        (AGGS::template update<BATCH>(std::get<J>(values), batch, i), 0)...};
+      (void) _;
+    }
+
+    std::unordered_map<Key, Values> table_;
+
+  };
+
+  template<class BATCH>
+  Operator<BATCH>
+  bind()
+    const
+  {
+    return {};
+  }
+};
+
+
+template<size_t KEY, class... AGGS>
+inline GroupByOp<KEY, AGGS...>
+group_by(
+  AGGS...)
+{
+  return {};
+}
+
+
+/*
+ * Collects selected rows, as tuples.
+ */
+struct CollectOp
+{
+  template<class BATCH>
+  class Operator;
+
+  template<class... T>
+  class Operator<Batch<T...>>
+  {
+  public:
+
+    using BATCH = Batch<T...>;
+
+    void
+    push(
+      BATCH const& batch)
+    {
+      batch.for_each([&](size_t const i) {
+        rows_.push_back(get_row(batch, i, std::index_sequence_for<T...>()));
+      });
+    }
+
+    void finish() {}
+    std::vector<std::tuple<T...>> result() { return std::move(rows_); }
+
+  private:
+
+    template<size_t... J>
+    static std::tuple<T...>
+    get_row(
+      BATCH const& batch,
+      size_t const i,
+      std::index_sequence<J...>)
+    {
+      return std::make_tuple(batch.template get<J>()[i]...);
+    }
+
+    std::vector<std::tuple<T...>> rows_;
+
+  };
+
+  template<class BATCH>
+  Operator<BATCH>
+  bind()
+    const
+  {
+    return {};
+  }
+};
+
+
+inline CollectOp
+collect()
+{
+  return {};
+}
+
+
+//------------------------------------------------------------------------------
+// Parallel queries
+
+// Number of records per task.  Group-by tasks are larger, to amortize building
+// a hash table for each.
+size_t constexpr AGGREGATE_GRAIN = 64 * 1024;
+size_t constexpr GROUP_BY_GRAIN = 256 * 1024;
+
+/*
+ * Aggregates the records of `reader` with AGGS..., like
+ *
+ *     run(scan(reader), aggregate(aggs...))
+ *
+ * but scans in parallel on `pool`, or serially if it is null, in fixed chunks
+ * merged in order.
+ */
+template<class READER, class... AGGS>
+inline auto
+parallel_aggregate(
+  READER const& reader,
+  ThreadPool* const pool,
+  AGGS... aggs)
+{
+  using Op = typename AggregateOp<AGGS...>::template Operator<
+    typename Scan<READER>::batch_type>;
+  using Values = typename Op::Values;
+  return parallel_reduce(
+    pool, 0, reader.length(), AGGREGATE_GRAIN, Op().result(),
+    [&](size_t const start, size_t const stop) {
+      return run(scan(reader, start, stop), aggregate(aggs...));
+    },
+    [](Values values, Values const& later) {
+      Op::merge(values, later);
+      return values;
+    });
+}
+
+
+/*
+ * Aggregates the records of `reader` with AGGS..., grouped by column KEY,
+ * like `group_by<KEY>(aggs...)`, but in parallel, as `parallel_aggregate()`.
+ */
+template<size_t KEY, class READER, class... AGGS>
+inline auto
+parallel_group_by(
+  READER const& reader,
+  ThreadPool* const pool,
+  AGGS... aggs)
+{
+  using Op = typename GroupByOp<KEY, AGGS...>::template Operator<
+    typename Scan<READER>::batch_type>;
+  using Groups = decltype(Op().result());
+  return parallel_reduce(
+    pool, 0, reader.length(), GROUP_BY_GRAIN, Groups{},
+    [&](size_t const start, size_t const stop) {
+      return run(scan(reader, start, stop), group_by<KEY>(aggs...));
+    },
+    [](Groups groups, Groups const& later) {
+      Op::merge(groups, later);
+      return groups;
+    });
+}
+
+
+}  // namespace pipeline
+
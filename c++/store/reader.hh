@@ -0,0 +1,426 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "instrument.hh"
+
+//------------------------------------------------------------------------------
+
+template<class REC>
+class MmapReader
+{
+public:
+
+  using value_type = REC;
+
+  // FIXME: Iterator may not outlive container.
+  class Iterator
+  {
+  public:
+
+    Iterator(
+      MmapReader const* const file,
+      size_t const pos)
+    : file_(file),
+      pos_(pos)
+    {
+      assert(0 <= pos_);
+      assert(pos_ <= file->length());
+    }
+
+    ~Iterator() = default;
+
+    bool operator==(Iterator const& other) const { return other.pos_ == pos_; }
+    bool operator!=(Iterator const& other) const { return ! operator==(other); }
+    void operator++() { ++pos_; }
+
+    REC const& operator->() { return file_->get(pos_); }
+    REC const& operator*() { return file_->get(pos_); }
+
+  private:
+
+    MmapReader const* const file_;
+    size_t pos_;
+
+  };
+
+  MmapReader(
+    char const* const filename)
+  {
+    INSTRUMENT_STAGE(OPEN);
+    int const fd = open(filename, O_RDONLY);
+    assert(fd != -1);
+
+    int const rval = fstat(fd, &file_info_);
+    assert(rval == 0);
+    size_ = file_info_.st_size;
+    length_ = file_info_.st_size / sizeof(REC);
+
+    // The mapping doesn't need the file descriptor.  An empty file can't be
+    // mapped.
+    void const* data
+      = size_ == 0 ? nullptr
+      : mmap(nullptr, size_, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0);
+    assert(data != MAP_FAILED);
+    close(fd);
+    data_ = reinterpret_cast<REC const*>(data);
+    INSTRUMENT_COUNT(FILES_MAPPED, 1);
+    INSTRUMENT_COUNT(BYTES_MAPPED, size_);
+  }
+
+  MmapReader(MmapReader const&) = delete;
+  MmapReader(MmapReader&&) = delete;
+
+  ~MmapReader()
+  {
+    if (data_ != nullptr) {
+      int const rval = munmap((void*) data_, size_);
+      assert(rval == 0);
+    }
+  }
+
+  size_t size() const { return size_; }
+  size_t length() const { return length_; }
+
+  /*
+   * The status of the mapped file, as of when it was mapped.
+   */
+  struct stat const& file_info() const { return file_info_; }
+
+  REC const& get(
+    size_t const pos)
+    const
+  {
+    assert(0 <= pos);
+    assert(pos < length_);
+    return data_[pos];
+  }
+
+  Iterator begin() const { return {this, 0}; }
+  Iterator end() const { return {this, length_}; }
+  
+private:
+
+  struct stat file_info_;
+  size_t size_;
+  size_t length_;
+  REC const* data_;
+
+};
+
+
+//------------------------------------------------------------------------------
+
+template<class REC>
+class BufferReader
+{
+public:
+
+  using value_type = REC;
+
+  // FIXME: Iterator may not outlive container.
+  class Iterator
+  {
+  public:
+
+    Iterator(
+      BufferReader const* const reader,
+      size_t const pos)
+    : reader_(reader),
+      pos_(pos)
+    {
+      assert(0 <= pos_);
+      assert(pos_ <= reader->length());
+    }
+
+    ~Iterator() = default;
+
+    bool operator==(Iterator const& other) const { return other.pos_ == pos_; }
+    bool operator!=(Iterator const& other) const { return ! operator==(other); }
+    void operator++() { ++pos_; }
+
+    REC const& operator->() { return reader_->get(pos_); }
+    REC const& operator*() { return reader_->get(pos_); }
+
+  private:
+
+    BufferReader const* const reader_;
+    size_t pos_;
+
+  };
+
+  BufferReader(
+    char const* const filename)
+  {
+    INSTRUMENT_STAGE(OPEN);
+    int const fd = open(filename, O_RDONLY);
+    assert(fd != -1);
+
+    struct stat file_info;
+    auto const rval = fstat(fd, &file_info);
+    assert(rval == 0);
+    size_ = file_info.st_size;
+    length_ = size_ / sizeof(REC);
+
+    data_ = new REC[length_];
+    auto const read_size = read(fd, data_, size_);
+    assert(read_size == (ssize_t) size_);
+    close(fd);
+  }
+
+  BufferReader(BufferReader const&) = delete;
+  BufferReader(BufferReader&&) = delete;
+
+  ~BufferReader()
+  {
+    delete[] data_;
+  }
+
+  size_t size() const { return size_; }
+  size_t length() const { return length_; }
+
+  REC const& get(
+    size_t const pos)
+    const
+  {
+    assert(0 <= pos);
+    assert(pos < length_);
+    return data_[pos];
+  }
+
+  Iterator begin() const { return {this, 0}; }
+  Iterator end() const { return {this, length_}; }
+  
+private:
+
+  size_t size_;
+  size_t length_;
+  REC* data_;
+
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * A view of contiguous records in memory.  Supports the same scans as the
+ * readers.
+ */
+template<class REC>
+class RecordBatch
+{
+public:
+
+  using value_type = REC;
+
+  RecordBatch(
+    REC const* const data,
+    size_t const length)
+  : data_(data),
+    length_(length)
+  {
+  }
+
+  size_t size() const { return length_ * sizeof(REC); }
+  size_t length() const { return length_; }
+  bool empty() const { return length_ == 0; }
+
+  REC const& get(
+    size_t const pos)
+    const
+  {
+    assert(pos < length_);
+    return data_[pos];
+  }
+
+  REC const* begin() const { return data_; }
+  REC const* end() const { return data_ + length_; }
+
+private:
+
+  REC const* data_;
+  size_t length_;
+
+};
+
+
+/*
+ * Returns a batch of records [start, stop) from a reader whose records are
+ * contiguous in memory.
+ */
+template<class READER>
+inline RecordBatch<typename READER::value_type>
+get_batch(
+  READER const& reader,
+  size_t const start,
+  size_t const stop)
+{
+  assert(start <= stop && stop <= reader.length());
+  return {start == stop ? nullptr : &reader.get(start), stop - start};
+}
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * A span of exactly N contiguous records.  Since the length is a constant,
+ * loops over a span can be unrolled and vectorized, and need no bounds checks.
+ */
+template<class REC, size_t N>
+class RecordSpan
+{
+public:
+
+  using value_type = REC;
+
+  explicit RecordSpan(REC const* const data) : data_(data) {}
+
+  static constexpr size_t length() { return N; }
+  static constexpr size_t size() { return N * sizeof(REC); }
+
+  REC const& get(size_t const pos) const { return data_[pos]; }
+  REC const& operator[](size_t const pos) const { return data_[pos]; }
+
+  REC const* begin() const { return data_; }
+  REC const* end() const { return data_ + N; }
+
+private:
+
+  REC const* data_;
+
+};
+
+
+/*
+ * The records of a reader, whose records are contiguous, as spans of N
+ * records, followed by a tail of fewer than N.
+ */
+template<class REC, size_t N>
+class RecordSpans
+{
+public:
+
+  using Span = RecordSpan<REC, N>;
+
+  class Iterator
+  {
+  public:
+
+    explicit Iterator(REC const* const ptr) : ptr_(ptr) {}
+
+    bool operator==(Iterator const& other) const { return other.ptr_ == ptr_; }
+    bool operator!=(Iterator const& other) const { return ! operator==(other); }
+    void operator++() { ptr_ += N; }
+
+    Span operator*() const { return Span(ptr_); }
+
+  private:
+
+    REC const* ptr_;
+
+  };
+
+  explicit RecordSpans(
+    RecordBatch<REC> const& batch)
+  : batch_(batch),
+    num_spans_(batch.length() / N)
+  {
+  }
+
+  // Number of full spans.
+  size_t size() const { return num_spans_; }
+
+  Span
+  operator[](
+    size_t const i)
+    const
+  {
+    assert(i < num_spans_);
+    return Span(batch_.begin() + i * N);
+  }
+
+  Iterator begin() const { return Iterator(batch_.begin()); }
+  Iterator end() const { return Iterator(batch_.begin() + num_spans_ * N); }
+
+  /*
+   * The records after the last full span.
+   */
+  RecordBatch<REC>
+  tail()
+    const
+  {
+    auto const start = num_spans_ * N;
+    return {batch_.begin() + start, batch_.length() - start};
+  }
+
+private:
+
+  RecordBatch<REC> batch_;
+  size_t num_spans_;
+
+};
+
+
+template<size_t N, class READER>
+inline RecordSpans<typename READER::value_type, N>
+get_spans(
+  READER const& reader)
+{
+  return RecordSpans<typename READER::value_type, N>(
+    get_batch(reader, 0, reader.length()));
+}
+
+
+/*
+ * Invokes `fn(span)` for each full `RecordSpan` of N records of `reader`, then
+ * `fn(batch)` with the remaining records as a `RecordBatch`, if any.
+ */
+template<size_t N, class READER, class FN>
+inline void
+for_each_span(
+  READER const& reader,
+  FN&& fn)
+{
+  auto const spans = get_spans<N>(reader);
+  for (auto const span : spans)
+    fn(span);
+  auto const tail = spans.tail();
+  if (!tail.empty())
+    fn(tail);
+}
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Returns the position of the first record in [start, end) with timestamp at
+ * or after `timestamp`.  The records must be sorted by timestamp.
+ */
+template<class READER>
+size_t
+lower_bound_timestamp(
+  READER const& reader,
+  uint64_t const timestamp,
+  size_t start,
+  size_t end)
+{
+  assert(start <= end);
+  assert(end <= reader.length());
+  while (start < end) {
+    auto const mid = start + (end - start) / 2;
+    if (reader.get(mid).timestamp < timestamp)
+      start = mid + 1;
+    else
+      end = mid;
+  }
+  return start;
+}
+
+
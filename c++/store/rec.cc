@@ -1,277 +1,152 @@
 #include <cassert>
 #include <cstring>
-#include <fcntl.h>
 #include <iostream>
 #include <map>
-#include <sys/mman.h>
-#include <sys/stat.h>
+#include <memory>
+#include <string>
 #include <sys/time.h>
-#include <sys/types.h>
-#include <unistd.h>
 
+#include "cache.hh"
+#include "instrument.hh"
+#include "pipeline.hh"
+#include "reader.hh"
 #include "rec.hh"
+#include "stats.hh"
 
 unsigned int constexpr GiB = 1024 * 1024 * 1024;
 
 //------------------------------------------------------------------------------
 
-template<class REC>
-class MmapReader
-{
-public:
-
-  // FIXME: Iterator may not outlive container.
-  class Iterator
-  {
-  public:
-
-    Iterator(
-      MmapReader const* const file,
-      size_t const pos)
-    : file_(file),
-      pos_(pos)
-    {
-      assert(0 <= pos_);
-      assert(pos_ <= file->length());
-    }
-
-    ~Iterator() = default;
-
-    bool operator==(Iterator const& other) const { return other.pos_ == pos_; }
-    bool operator!=(Iterator const& other) const { return ! operator==(other); }
-    void operator++() { ++pos_; }
-
-    REC const& operator->() { return file_->get(pos_); }
-    REC const& operator*() { return file_->get(pos_); }
-
-  private:
-
-    MmapReader const* const file_;
-    size_t pos_;
-
-  };
-
-  MmapReader(
-    char const* const filename)
-  {
-    fd_ = open(filename, O_RDONLY);
-    assert(fd_ != -1);
-
-    struct stat file_info;
-    int const rval = fstat(fd_, &file_info);
-    assert(rval == 0);
-    size_ = file_info.st_size;
-    length_ = file_info.st_size / sizeof(REC);
-
-    void const* data 
-      = mmap(nullptr, size_, PROT_READ, MAP_FILE | MAP_SHARED, fd_, 0);
-    assert(data != nullptr);
-    data_ = reinterpret_cast<REC const*>(data);
-  }
-
-  MmapReader(MmapReader const&) = delete;
-  MmapReader(MmapReader&&) = delete;
-
-  ~MmapReader()
-  {
-    int const rval = munmap((void*) data_, size_);
-    assert(rval == 0);
-  }
-
-  size_t size() const { return size_; }
-  size_t length() const { return length_; }
-
-  REC const& get(
-    size_t const pos)
-    const
-  {
-    assert(0 <= pos);
-    assert(pos < length_);
-    return data_[pos];
-  }
-
-  Iterator begin() const { return {this, 0}; }
-  Iterator end() const { return {this, length_}; }
-  
-private:
-
-  int fd_;
-  size_t size_;
-  size_t length_;
-  REC const* data_;
-
-};
-
-
-//------------------------------------------------------------------------------
-
-template<class REC>
-class BufferReader
-{
-public:
-
-  // FIXME: Iterator may not outlive container.
-  class Iterator
-  {
-  public:
-
-    Iterator(
-      BufferReader const* const reader,
-      size_t const pos)
-    : reader_(reader),
-      pos_(pos)
-    {
-      assert(0 <= pos_);
-      assert(pos_ <= reader->length());
-    }
-
-    ~Iterator() = default;
-
-    bool operator==(Iterator const& other) const { return other.pos_ == pos_; }
-    bool operator!=(Iterator const& other) const { return ! operator==(other); }
-    void operator++() { ++pos_; }
-
-    REC const& operator->() { return reader_->get(pos_); }
-    REC const& operator*() { return reader_->get(pos_); }
-
-  private:
-
-    BufferReader const* const reader_;
-    size_t pos_;
-
-  };
-
-  BufferReader(
-    char const* const filename)
-  {
-    int const fd = open(filename, O_RDONLY);
-    assert(fd != -1);
-
-    struct stat file_info;
-    auto const rval = fstat(fd, &file_info);
-    assert(rval == 0);
-    size_ = file_info.st_size;
-    length_ = size_ / sizeof(REC);
-
-    data_ = new REC[length_];
-    auto const read_size = read(fd, data_, size_);
-    assert(read_size == size_);
-  }
-
-  BufferReader(BufferReader const&) = delete;
-  BufferReader(BufferReader&&) = delete;
-
-  ~BufferReader()
-  {
-    delete[] data_;
-  }
-
-  size_t size() const { return size_; }
-  size_t length() const { return length_; }
-
-  REC const& get(
-    size_t const pos)
-    const
-  {
-    assert(0 <= pos);
-    assert(pos < length_);
-    return data_[pos];
-  }
-
-  Iterator begin() const { return {this, 0}; }
-  Iterator end() const { return {this, length_}; }
-  
-private:
-
-  size_t size_;
-  size_t length_;
-  REC* data_;
-
-};
-
-
-//------------------------------------------------------------------------------
-
-struct OrderStats
-{
-  uint32_t count;
-  Size net_size;
-  Size volume;
-  float vwp;
-  Price last_price;
-};
-
-
+/*
+ * Order stats, computed by a query pipeline.
+ */
 template<class READER>
 std::map<Sid, OrderStats>
-get_order_stats(
-  READER const& reader) 
+get_order_stats_pipeline(
+  READER const& reader)
 {
+  namespace pl = pipeline;
+  size_t constexpr INSTRUMENT_FIELD = get_field_index<Order>("instrument");
+  size_t constexpr SIZE = get_field_index<Order>("size");
+  size_t constexpr PRICE = get_field_index<Order>("price");
+  // Projected columns follow the fields.
+  size_t constexpr VOLUME = get_num_fields<Order>();
+  size_t constexpr VWP = VOLUME + 1;
+
+  auto const groups = pl::run(
+    pl::scan(reader),
+    pl::project([](auto const& batch, size_t const i) {
+      return std::abs(pl::value<SIZE>(batch, i));
+    }),
+    pl::project([](auto const& batch, size_t const i) {
+      return (double) pl::value<VOLUME>(batch, i) * pl::value<PRICE>(batch, i);
+    }),
+    pl::group_by<INSTRUMENT_FIELD>(
+      pl::Count(), pl::Sum<SIZE>(), pl::Sum<VOLUME>(), pl::KahanSum<VWP>(),
+      pl::Last<PRICE>()));
+
   std::map<Sid, OrderStats> stats;
-  for (auto const& order : reader) {
-    // std::cout << order << "\n";
-    auto iter = stats.find(order.instrument);
-    if (iter == stats.end())
-      stats[order.instrument] = 
-        {1, order.size, std::abs(order.size), 
-         std::abs(order.size) * order.price, order.price};
-    else {
-      OrderStats& s = iter->second;
-      ++s.count;
-      s.net_size += order.size;
-      s.volume += std::abs(order.size);
-      s.vwp += std::abs(order.size) * order.price;
-      s.last_price = order.price;
-    }
-  }
+  for (auto const& g : groups)
+    stats.emplace_hint(stats.end(), g.first, OrderStats{
+      (uint32_t) std::get<0>(g.second), (Size) std::get<1>(g.second),
+      (Size) std::get<2>(g.second), std::get<3>(g.second),
+      std::get<4>(g.second)});
   return stats;
 }
 
 
-template<class READER>
-uint64_t
-get_total_volume(
-  READER const& reader)
-{
-  uint64_t volume = 0;
-  for (auto const& order : reader)
-    volume += std::abs(order.size);
-  return volume;
-}
-
-
-//------------------------------------------------------------------------------
-
 int
 main(
   int const argc,
   char const* const* const argv)
 {
-  if (argc != 2) {
-    std::cerr << "usage: " << argv[0] << " FILENAME\n";
+  if (argc < 2 || argc > 5) {
+    std::cerr << "usage: " << argv[0]
+              << " FILENAME [THREADS [MODE [CACHE_DIR]]]\n"
+              << "modes: volume stats partitioned pipeline distribution\n";
     return 2;
   }
   char const* const filename = argv[1];
+  // Scan serially unless a number of threads is given.
+  std::unique_ptr<ThreadPool> pool;
+  if (argc >= 3 && atol(argv[2]) > 0)
+    pool.reset(new ThreadPool(atol(argv[2])));
+  std::string const mode = argc >= 4 ? argv[3] : "volume";
+  // Cache results on disk, if a directory is given.  The cache lasts only for
+  // this run, so keeping results in memory as well would never hit.
+  ResultCache cache(0, argc >= 5 ? argv[4] : "");
 
   struct timeval start_time;
   gettimeofday(&start_time, nullptr);
 
   MmapReader<Order> reader(filename);
-  // BufferReader<Order> reader(filename);
-  // auto const stats = get_total_stats(reader);
-  auto const total_volume = get_total_volume(reader);
+  std::map<Sid, OrderStats> stats;
+  std::map<Sid, OrderDistribution> dists;
+  uint64_t total_volume = 0;
+  if (mode == "volume")
+    total_volume = cached<uint64_t>(
+      cache, filename, 0, reader.length(), "total_volume",
+      [&] { return get_total_volume(reader, pool.get()); });
+  else if (mode == "distribution")
+    // Sketches aren't trivially copyable, so aren't cached.
+    dists = get_order_distributions(reader, pool.get());
+  else if (mode == "pipeline")
+    stats = cached<std::map<Sid, OrderStats>>(
+      cache, filename, 0, reader.length(), "order_stats_pipeline",
+      [&] { return get_order_stats_pipeline(reader); });
+  else
+    stats = cached<std::map<Sid, OrderStats>>(
+      cache, filename, 0, reader.length(), "order_stats",
+      [&] {
+        if (!(mode == "partitioned" && pool))
+          return get_order_stats(reader, pool.get());
+        // The partitions are merged in parallel; only this union is serial.
+        std::map<Sid, OrderStats> stats;
+        for (auto const& part : get_order_stats_partitioned(reader, *pool))
+          stats.insert(part.begin(), part.end());
+        return stats;
+      });
+  if (mode != "volume")
+    for (auto const& s : stats)
+      total_volume += s.second.volume;
 
   struct timeval end_time;
   gettimeofday(&end_time, nullptr);
 
+  {
+    INSTRUMENT_STAGE(OUTPUT);
 #if 0
-  for (auto i = stats.begin(); i != stats.end(); ++i) 
-    std::cout << i->first << ": " << i->second.count 
-              << " volume=" << i->second.volume
-              << " last=" << i->second.last_price
-              << " vwap=" << i->second.vwp / i->second.volume << "\n";
+    for (auto i = stats.begin(); i != stats.end(); ++i) 
+      std::cout << i->first << ": " << i->second.count 
+                << " volume=" << i->second.volume
+                << " last=" << i->second.last_price
+                << " vwap=" << i->second.vwap() << "\n";
 #endif
-  std::cout << "total volume = " << total_volume << "\n";
+    if (mode == "distribution") {
+      uint64_t num_orders = 0;
+      for (auto const& d : dists)
+        num_orders += d.second.volume.count();
+      std::cout << "instruments = " << dists.size() << "\n"
+                << "orders = " << num_orders << "\n";
+      // Show a few.
+      size_t n = 0;
+      for (auto i = dists.begin(); i != dists.end() && n < 4; ++i, ++n) {
+        auto const& d = i->second;
+        std::cout << i->first << ": price p50=" << d.price.get_quantile(0.5)
+                  << " p99=" << d.price.get_quantile(0.99)
+                  << " volume p50=" << d.volume.get_quantile(0.5)
+                  << " p99=" << d.volume.get_quantile(0.99)
+                  << " largest=";
+        for (auto const& order : d.largest.get())
+          std::cout << order.size << " ";
+        std::cout << "\n";
+      }
+    }
+    else if (mode != "volume")
+      std::cout << "instruments = " << stats.size() << "\n";
+    if (mode != "distribution")
+      std::cout << "total volume = " << total_volume << "\n";
+  }
 
   auto const elapsed 
     = end_time.tv_sec + end_time.tv_usec * 1E-6
@@ -281,6 +156,10 @@ main(
             << (double) reader.size() / GiB * 8 / elapsed << " Gib/s"
             << "\n";
 
+#ifdef INSTRUMENT
+  std::cerr << get_instrument_totals();
+#endif
+
   return 0;
 }
 
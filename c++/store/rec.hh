@@ -1,5 +1,9 @@
+#pragma once
+
+#include <cstddef>
 #include <cstdint>
 #include <iostream>
+#include <tuple>
 
 using Timestamp     = uint64_t;
 using Sid           = uint32_t;
@@ -24,6 +28,98 @@ struct Order
   OrderType     type;           // 20
 };
 
+//------------------------------------------------------------------------------
+
+/*
+ * Compile-time description of one field of a record: its type and byte
+ * offset.
+ */
+template<class T, size_t OFFSET>
+struct FieldLayout
+{
+  using type = T;
+  static size_t constexpr offset = OFFSET;
+};
+
+template<class T, size_t OFFSET>
+size_t constexpr FieldLayout<T, OFFSET>::offset;
+
+
+/*
+ * Compile-time description of a record's fields, in order.
+ */
+template<class... FIELDS>
+struct RecordLayout
+{
+  static size_t constexpr num_fields = sizeof...(FIELDS);
+};
+
+template<class... FIELDS>
+size_t constexpr RecordLayout<FIELDS...>::num_fields;
+
+
+/*
+ * The `FieldLayout` of field I of a record layout.
+ */
+template<class LAYOUT, size_t I> struct FieldAt;
+
+template<class... FIELDS, size_t I>
+struct FieldAt<RecordLayout<FIELDS...>, I>
+{
+  using type = typename std::tuple_element<I, std::tuple<FIELDS...>>::type;
+};
+
+
+/*
+ * The layout of REC, and the names of its fields.  Specialize for each record
+ * type.
+ */
+template<class REC> struct Layout;
+
+template<>
+struct Layout<Trade>
+{
+  using type = RecordLayout<
+    FieldLayout<Timestamp,  offsetof(Trade, timestamp)>,
+    FieldLayout<Sid,        offsetof(Trade, instrument)>,
+    FieldLayout<Size,       offsetof(Trade, size)>,
+    FieldLayout<Price,      offsetof(Trade, price)>>;
+
+  static constexpr char const*
+  get_name(
+    size_t const i)
+  {
+    char const* const names[] = {"timestamp", "instrument", "size", "price"};
+    return names[i];
+  }
+};
+
+template<>
+struct Layout<Order>
+{
+  using type = RecordLayout<
+    FieldLayout<Timestamp,  offsetof(Order, timestamp)>,
+    FieldLayout<Sid,        offsetof(Order, instrument)>,
+    FieldLayout<Size,       offsetof(Order, size)>,
+    FieldLayout<Price,      offsetof(Order, price)>,
+    FieldLayout<OrderType,  offsetof(Order, type)>>;
+
+  static constexpr char const*
+  get_name(
+    size_t const i)
+  {
+    char const* const names[]
+      = {"timestamp", "instrument", "size", "price", "type"};
+    return names[i];
+  }
+};
+
+static_assert(sizeof(Trade) == 24, "unexpected Trade layout");
+static_assert(sizeof(Order) == 24, "unexpected Order layout");
+static_assert(offsetof(Order, type) == 20, "unexpected Order layout");
+
+//------------------------------------------------------------------------------
+
 inline std::ostream&
 operator<<(
   std::ostream& os,
@@ -0,0 +1,80 @@
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include "reader.hh"
+#include "recfile.hh"
+#include "rec.hh"
+#include "stats.hh"
+
+//------------------------------------------------------------------------------
+
+int
+main(
+  int const argc,
+  char const* const* const argv)
+try {
+  if (argc == 4 && strcmp(argv[1], "convert") == 0) {
+    // Convert a raw file of orders to a record file.
+    MmapReader<Order> reader(argv[2]);
+    RecordFileWriter<Order> writer(argv[3]);
+    for (auto const& order : reader)
+      writer.append(order);
+    std::cout << "length = " << writer.length() << "\n";
+  }
+
+  else if (argc == 3 && strcmp(argv[1], "describe") == 0) {
+    RecordFile file(argv[2]);
+    std::cout << "length = " << file.length() << "\n" << file.schema();
+  }
+
+  else if (argc == 3 && strcmp(argv[1], "volume") == 0) {
+    // Sum order sizes, by field and by record.
+    RecordFile file(argv[2]);
+    uint64_t volume = 0;
+    for (auto const size : file.get_field<Size>("size"))
+      volume += std::abs(size);
+    std::cout << "total volume = " << volume << "\n";
+    std::cout << "total volume = "
+              << get_total_volume(file.get_records<Order>()) << "\n";
+  }
+
+  else if (argc == 3 && strcmp(argv[1], "arrow") == 0) {
+    // Export as Arrow, then import the size column back and sum it.
+    ArrowArray array;
+    ArrowSchema schema;
+    {
+      RecordFile file(argv[2]);
+      export_arrow(file, &array, &schema);
+    }
+    for (int64_t i = 0; i < schema.n_children; ++i)
+      std::cout << schema.children[i]->name << ": "
+                << schema.children[i]->format << "\n";
+
+    auto const i = get_schema<Order>().find("size");
+    auto const buffer
+      = import_arrow<Size>(array.children[i], schema.children[i]);
+    uint64_t volume = 0;
+    for (auto const size : get_typed_array<Size>(*buffer))
+      volume += std::abs(size);
+    std::cout << "total volume = " << volume << "\n";
+
+    array.release(&array);
+    schema.release(&schema);
+  }
+
+  else {
+    std::cerr << "usage: " << argv[0] << " convert ORDERS FILENAME\n"
+              << "       " << argv[0] << " describe FILENAME\n"
+              << "       " << argv[0] << " volume FILENAME\n"
+              << "       " << argv[0] << " arrow FILENAME\n";
+    return 2;
+  }
+
+  return 0;
+}
+catch (std::runtime_error const& err) {
+  std::cerr << err.what() << "\n";
+  return 1;
+}
+
@@ -0,0 +1,684 @@
+#pragma once
+
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <system_error>
+#include <type_traits>
+#include <unistd.h>
+#include <vector>
+
+#include "array.hh"
+#include "arrow.hh"
+#include "buffer.hh"
+#include "file.hh"
+#include "instrument.hh"
+#include "reader.hh"
+#include "rec.hh"
+#include "reflect.hh"
+
+//------------------------------------------------------------------------------
+// Schema
+
+/*
+ * Logical type of a field.  The physical type is the field's width in bytes.
+ */
+enum class LogicalType : uint8_t
+{
+  BYTES,
+  BOOL,
+  INT,
+  UINT,
+  FLOAT,
+  // Nanoseconds since the epoch, as UINT.
+  TIMESTAMP,
+};
+
+
+inline char const*
+get_name(
+  LogicalType const logical)
+{
+  switch (logical) {
+  case LogicalType::BYTES:      return "bytes";
+  case LogicalType::BOOL:       return "bool";
+  case LogicalType::INT:        return "int";
+  case LogicalType::UINT:       return "uint";
+  case LogicalType::FLOAT:      return "float";
+  case LogicalType::TIMESTAMP:  return "timestamp";
+  default:                      return "?";
+  }
+}
+
+
+/*
+ * The default logical type for a C++ field type.
+ */
+template<class T>
+inline LogicalType
+get_logical_type()
+{
+  return
+      std::is_same<T, bool>::value ? LogicalType::BOOL
+    : std::is_floating_point<T>::value ? LogicalType::FLOAT
+    : std::is_signed<T>::value ? LogicalType::INT
+    : std::is_unsigned<T>::value ? LogicalType::UINT
+    : LogicalType::BYTES;
+}
+
+
+/*
+ * Returns true if values of `logical` type and `width` may be accessed as T.
+ */
+template<class T>
+inline bool
+is_accessible_as(
+  LogicalType const logical,
+  size_t const width)
+{
+  if (width != sizeof(T))
+    return false;
+  auto const native = get_logical_type<T>();
+  return
+    logical == native
+    || (logical == LogicalType::TIMESTAMP && native == LogicalType::UINT)
+    || logical == LogicalType::BYTES;
+}
+
+
+struct Field
+{
+  std::string name;
+  LogicalType logical;
+  // Physical type: width in bytes.
+  size_t width;
+  // Offset in the record, in bytes.
+  size_t offset;
+};
+
+
+struct Schema
+{
+  size_t record_size;
+  std::vector<Field> fields;
+  // Indices of fields by which records are sorted, most significant first.
+  std::vector<size_t> sort_keys;
+
+  /*
+   * Returns the index of the field named `name`, or -1 if none.
+   */
+  int
+  find(
+    std::string const& name)
+    const
+  {
+    for (size_t i = 0; i < fields.size(); ++i)
+      if (fields[i].name == name)
+        return i;
+    return -1;
+  }
+
+  /*
+   * Returns true if the fields of this schema can be accessed through
+   * `other`.  Field names, types, and offsets must match; sort keys needn't.
+   */
+  bool
+  is_compatible(
+    Schema const& other)
+    const
+  {
+    if (record_size != other.record_size
+        || fields.size() != other.fields.size())
+      return false;
+    for (size_t i = 0; i < fields.size(); ++i) {
+      auto const& f0 = fields[i];
+      auto const& f1 = other.fields[i];
+      if (f0.name != f1.name || f0.logical != f1.logical
+          || f0.width != f1.width || f0.offset != f1.offset)
+        return false;
+    }
+    return true;
+  }
+};
+
+
+inline std::ostream&
+operator<<(
+  std::ostream& os,
+  Schema const& schema)
+{
+  os << "record_size = " << schema.record_size << "\n";
+  for (auto const& field : schema.fields)
+    os << "  " << field.name << ": " << get_name(field.logical)
+       << field.width * 8 << " @" << field.offset << "\n";
+  os << "sort keys =";
+  for (auto const key : schema.sort_keys)
+    os << " " << schema.fields[key].name;
+  return os << "\n";
+}
+
+
+//------------------------------------------------------------------------------
+// Schemas of the records in rec.hh.
+
+/*
+ * Returns the schema of REC, from its `Layout`.  A field named "timestamp" is
+ * a `TIMESTAMP`, and the sort key, as for all records in rec.hh.
+ */
+template<class REC>
+inline Schema
+get_schema()
+{
+  size_t constexpr TIMESTAMP = get_field_index<REC>("timestamp");
+  static_assert(TIMESTAMP < get_num_fields<REC>(), "no timestamp field");
+
+  Schema schema{sizeof(REC), {}, {TIMESTAMP}};
+  for_each_field<REC>([&](auto const field) {
+    using type = typename decltype(field)::type;
+    schema.fields.push_back({
+      field.name(),
+      field.index == TIMESTAMP ? LogicalType::TIMESTAMP
+        : get_logical_type<type>(),
+      sizeof(type), field.offset});
+  });
+  return schema;
+}
+
+
+//------------------------------------------------------------------------------
+// File format
+
+/*
+ * A record file is a header followed by fixed-size records.
+ *
+ * The header contains a `FileHeader`, then a `FieldHeader` for each field,
+ * then the index of each sort key field as a uint32_t, padded to a multiple of
+ * `RECFILE_PAGE_SIZE`.  All values are in the writer's byte order, which the
+ * reader checks.  Records start on a page boundary, so the payload can be
+ * mapped and used in place.
+ *
+ * The header's length counts only complete, committed records; any bytes
+ * after them are ignored.
+ */
+size_t constexpr RECFILE_PAGE_SIZE = 4096;
+uint32_t constexpr RECFILE_VERSION = 1;
+uint32_t constexpr RECFILE_BYTE_ORDER = 0x01020304;
+char constexpr RECFILE_MAGIC[8] = {'R', 'E', 'C', 'F', 'I', 'L', 'E', '\0'};
+
+struct FileHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t header_size;
+  uint64_t record_size;
+  uint64_t length;
+  uint32_t num_fields;
+  uint32_t num_sort_keys;
+};
+
+struct FieldHeader
+{
+  char name[48];
+  uint32_t offset;
+  uint8_t width;
+  LogicalType logical;
+  uint8_t reserved[10];
+};
+
+static_assert(sizeof(FileHeader) == 48, "FileHeader layout");
+static_assert(sizeof(FieldHeader) == 64, "FieldHeader layout");
+
+
+inline size_t
+get_header_size(
+  size_t const num_fields,
+  size_t const num_sort_keys)
+{
+  auto const size
+    = sizeof(FileHeader) + num_fields * sizeof(FieldHeader)
+      + num_sort_keys * sizeof(uint32_t);
+  return (size + RECFILE_PAGE_SIZE - 1) / RECFILE_PAGE_SIZE * RECFILE_PAGE_SIZE;
+}
+
+
+/*
+ * Checks the header at `data`, of a file of `size` bytes.  Returns a
+ * description of the first problem found, or null if the header is valid.
+ */
+inline char const*
+check_header(
+  void const* const data,
+  size_t const size)
+{
+  if (size < sizeof(FileHeader))
+    return "file too short for header";
+  auto const& header = *reinterpret_cast<FileHeader const*>(data);
+  if (memcmp(header.magic, RECFILE_MAGIC, sizeof(RECFILE_MAGIC)) != 0)
+    return "not a record file";
+  if (header.byte_order != RECFILE_BYTE_ORDER)
+    return "wrong byte order";
+  if (header.version != RECFILE_VERSION)
+    return "unsupported version";
+  if (header.header_size % RECFILE_PAGE_SIZE != 0
+      || header.header_size
+         < get_header_size(header.num_fields, header.num_sort_keys)
+      || header.header_size > size)
+    return "bad header size";
+  if (header.record_size == 0 || header.num_fields == 0)
+    return "empty schema";
+  if (header.length > (size - header.header_size) / header.record_size)
+    return "file too short for length";
+
+  auto const fields = reinterpret_cast<FieldHeader const*>(&header + 1);
+  for (size_t i = 0; i < header.num_fields; ++i) {
+    auto const& field = fields[i];
+    if (strnlen(field.name, sizeof(field.name)) == sizeof(field.name))
+      return "unterminated field name";
+    auto const w = field.width;
+    if (!(w == 1 || w == 2 || w == 4 || w == 8))
+      return "bad field width";
+    if (field.offset + w > header.record_size)
+      return "field outside record";
+    switch (field.logical) {
+    case LogicalType::BYTES:
+    case LogicalType::INT:
+    case LogicalType::UINT:
+      break;
+    case LogicalType::BOOL:
+      if (w != 1)
+        return "bad bool width";
+      break;
+    case LogicalType::FLOAT:
+      if (w != 4 && w != 8)
+        return "bad float width";
+      break;
+    case LogicalType::TIMESTAMP:
+      if (w != 8)
+        return "bad timestamp width";
+      break;
+    default:
+      return "bad logical type";
+    }
+  }
+
+  auto const sort_keys
+    = reinterpret_cast<uint32_t const*>(fields + header.num_fields);
+  for (size_t i = 0; i < header.num_sort_keys; ++i)
+    if (sort_keys[i] >= header.num_fields)
+      return "bad sort key";
+
+  return nullptr;
+}
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Reads a record file by mapping it.  The header is validated on open; if it
+ * is not valid, the constructor throws `std::runtime_error`, or if the file
+ * can't be read, `std::system_error`.
+ */
+class RecordFile
+{
+public:
+
+  RecordFile(
+    char const* const filename)
+  : filename_(filename)
+  {
+    INSTRUMENT_STAGE(OPEN);
+    int const fd = open(filename, O_RDONLY);
+    if (fd == -1)
+      throw std::system_error(errno, std::generic_category(), filename_);
+
+    struct stat file_info;
+    if (fstat(fd, &file_info) == -1) {
+      auto const error = errno;
+      close(fd);
+      throw std::system_error(error, std::generic_category(), filename_);
+    }
+    size_ = file_info.st_size;
+
+    // An empty file can't be mapped; it fails the header check below.
+    void* const data
+      = size_ == 0 ? nullptr
+      : mmap(nullptr, size_, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0);
+    auto const mmap_errno = errno;
+    close(fd);
+    if (data == MAP_FAILED)
+      throw std::system_error(mmap_errno, std::generic_category(), filename_);
+    data_ = reinterpret_cast<char const*>(data);
+    INSTRUMENT_COUNT(FILES_MAPPED, 1);
+    INSTRUMENT_COUNT(BYTES_MAPPED, size_);
+
+    auto const error = check_header(data_, size_);
+    if (error != nullptr) {
+      if (data != nullptr)
+        munmap(data, size_);
+      throw std::runtime_error(filename_ + ": " + error);
+    }
+
+    auto const& header = *reinterpret_cast<FileHeader const*>(data_);
+    length_ = header.length;
+    schema_.record_size = header.record_size;
+    auto const fields = reinterpret_cast<FieldHeader const*>(&header + 1);
+    for (size_t i = 0; i < header.num_fields; ++i)
+      schema_.fields.push_back({
+        fields[i].name, fields[i].logical, fields[i].width, fields[i].offset});
+    auto const sort_keys
+      = reinterpret_cast<uint32_t const*>(fields + header.num_fields);
+    for (size_t i = 0; i < header.num_sort_keys; ++i)
+      schema_.sort_keys.push_back(sort_keys[i]);
+    records_ = data_ + header.header_size;
+  }
+
+  RecordFile(RecordFile const&) = delete;
+  RecordFile(RecordFile&&) = delete;
+
+  ~RecordFile()
+  {
+    int const rval = munmap((void*) data_, size_);
+    assert(rval == 0);
+  }
+
+  Schema const& schema() const { return schema_; }
+  size_t length() const { return length_; }
+  size_t record_size() const { return schema_.record_size; }
+
+  /*
+   * Returns a pointer to record `pos`.
+   */
+  void const*
+  get_record(
+    size_t const pos)
+    const
+  {
+    assert(pos < length_);
+    return records_ + pos * schema_.record_size;
+  }
+
+  /*
+   * Returns the values of field `name`, strided through the records.  Throws
+   * `std::runtime_error` if there is no such field, or it isn't accessible
+   * as T.
+   */
+  template<class T>
+  Array<T const>
+  get_field(
+    std::string const& name)
+    const
+  {
+    auto const i = schema_.find(name);
+    if (i == -1)
+      throw std::runtime_error(filename_ + ": no field " + name);
+    auto const& field = schema_.fields[i];
+    if (!is_accessible_as<T>(field.logical, field.width))
+      throw std::runtime_error(
+        filename_ + ": field " + name + " is " + get_name(field.logical)
+        + std::to_string(field.width * 8) + ", not accessible as "
+        + get_name(get_logical_type<T>()) + std::to_string(sizeof(T) * 8));
+    return {
+      reinterpret_cast<T const*>(records_ + field.offset), length_,
+      (ptrdiff_t) schema_.record_size};
+  }
+
+  /*
+   * Returns the records as REC.  Throws `std::runtime_error` if REC's schema
+   * isn't compatible.
+   */
+  template<class REC>
+  RecordBatch<REC>
+  get_records()
+    const
+  {
+    if (!get_schema<REC>().is_compatible(schema_))
+      throw std::runtime_error(filename_ + ": incompatible record type");
+    return {reinterpret_cast<REC const*>(records_), length_};
+  }
+
+private:
+
+  std::string const filename_;
+  size_t size_;
+  char const* data_;
+  char const* records_;
+  size_t length_;
+  Schema schema_;
+
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Writes a new record file of REC.  The length in the header is updated on
+ * `commit()` and on close, so a reader never sees records that haven't been
+ * written.
+ *
+ * Errors throw `std::system_error`.  A batch whose write fails stays
+ * buffered, and is written again, at the same offset, by a later `append()`,
+ * `flush()`, or `commit()`.  The destructor commits too, but can't throw, so
+ * call `commit()` before it to see errors.
+ */
+template<class REC>
+class RecordFileWriter
+{
+public:
+
+  using value_type = REC;
+
+  RecordFileWriter(
+    char const* const filename,
+    Schema const& schema=get_schema<REC>(),
+    size_t const batch_length=4096)
+  : batch_length_(batch_length),
+    buffer_(batch_length * sizeof(REC)),
+    batch_(reinterpret_cast<REC*>(buffer_.get_start()))
+  {
+    assert(schema.record_size == sizeof(REC));
+    assert(batch_length_ > 0);
+
+    fd_ = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd_ == -1)
+      throw std::system_error(errno, std::generic_category(), filename);
+
+    header_size_ = get_header_size(
+      schema.fields.size(), schema.sort_keys.size());
+    std::vector<char> header(header_size_, 0);
+    auto& file_header = *reinterpret_cast<FileHeader*>(header.data());
+    memcpy(file_header.magic, RECFILE_MAGIC, sizeof(RECFILE_MAGIC));
+    file_header.version = RECFILE_VERSION;
+    file_header.byte_order = RECFILE_BYTE_ORDER;
+    file_header.header_size = header_size_;
+    file_header.record_size = schema.record_size;
+    file_header.length = 0;
+    file_header.num_fields = schema.fields.size();
+    file_header.num_sort_keys = schema.sort_keys.size();
+
+    auto const fields = reinterpret_cast<FieldHeader*>(&file_header + 1);
+    for (size_t i = 0; i < schema.fields.size(); ++i) {
+      auto const& field = schema.fields[i];
+      assert(field.name.size() < sizeof(fields[i].name));
+      strcpy(fields[i].name, field.name.c_str());
+      fields[i].offset = field.offset;
+      fields[i].width = field.width;
+      fields[i].logical = field.logical;
+    }
+    auto const sort_keys
+      = reinterpret_cast<uint32_t*>(fields + schema.fields.size());
+    for (size_t i = 0; i < schema.sort_keys.size(); ++i)
+      sort_keys[i] = schema.sort_keys[i];
+
+    assert(check_header(header.data(), header.size()) == nullptr);
+    try {
+      pwrite_all(fd_, header.data(), header.size(), 0);
+    }
+    catch (std::system_error const&) {
+      close(fd_);
+      throw;
+    }
+  }
+
+  RecordFileWriter(RecordFileWriter const&) = delete;
+  RecordFileWriter(RecordFileWriter&&) = delete;
+
+  ~RecordFileWriter()
+  {
+    try {
+      commit();
+    }
+    catch (std::system_error const&) {
+      // Buffered records are lost; the header counts only those written.
+    }
+    int const rval = close(fd_);
+    assert(rval == 0);
+  }
+
+  size_t length() const { return length_ + num_batch_; }
+
+  void
+  append(
+    REC const& rec)
+  {
+    // Retry a full batch whose write failed.
+    if (num_batch_ == batch_length_)
+      flush();
+    batch_[num_batch_++] = rec;
+    if (num_batch_ == batch_length_)
+      flush();
+  }
+
+  /*
+   * Writes buffered records.
+   */
+  void
+  flush()
+  {
+    // Write at the batch's own offset, so that a retry after a partial write
+    // overwrites it rather than appending after it.
+    pwrite_all(
+      fd_, batch_, num_batch_ * sizeof(REC),
+      header_size_ + length_ * sizeof(REC));
+    length_ += num_batch_;
+    num_batch_ = 0;
+  }
+
+  /*
+   * Writes buffered records, then updates the length in the header.
+   */
+  void
+  commit()
+  {
+    flush();
+    uint64_t const length = length_;
+    pwrite_all(fd_, &length, sizeof(length), offsetof(FileHeader, length));
+  }
+
+private:
+
+  size_t const batch_length_;
+  MallocBuffer buffer_;
+  REC* const batch_;
+  size_t num_batch_ = 0;
+
+  int fd_;
+  size_t header_size_;
+  size_t length_ = 0;
+
+};
+
+
+//------------------------------------------------------------------------------
+// Arrow export
+
+/*
+ * Returns the Arrow format for a field.  BOOL fields are bytes, so they are
+ * exported as uint8.
+ */
+inline std::string
+get_arrow_format(
+  Field const& field)
+{
+  static char const* const ints[] = {"c", "s", "i", "l"};
+  static char const* const uints[] = {"C", "S", "I", "L"};
+  auto const w = field.width;
+  auto const i = w == 1 ? 0 : w == 2 ? 1 : w == 4 ? 2 : 3;
+  switch (field.logical) {
+  case LogicalType::INT:        return ints[i];
+  case LogicalType::UINT:       return uints[i];
+  case LogicalType::BOOL:       return "C";
+  case LogicalType::FLOAT:      return w == 4 ? "f" : "g";
+  case LogicalType::TIMESTAMP:  return "tsn:";
+  case LogicalType::BYTES:
+  default:                      return "w:" + std::to_string(w);
+  }
+}
+
+
+/*
+ * Exports field `index` of `file` as an Arrow array.
+ *
+ * Arrow has no strided layout, so the field is gathered into a new buffer,
+ * which the export owns; this is the only copy.
+ */
+inline void
+export_arrow_field(
+  RecordFile const& file,
+  size_t const index,
+  ArrowArray* const out_array,
+  ArrowSchema* const out_schema)
+{
+  auto const& field = file.schema().fields[index];
+  auto const length = file.length();
+  auto const w = field.width;
+  auto const buffer = std::make_shared<MallocBuffer>(length * w);
+  auto const dst = reinterpret_cast<char*>(buffer->get_start());
+  auto const src
+    = length == 0 ? nullptr
+    : reinterpret_cast<char const*>(file.get_record(0)) + field.offset;
+  auto const stride = file.record_size();
+  // Dispatch on width, so the copies are of constant size.
+  for (size_t i = 0; i < length; ++i)
+    switch (w) {
+    case 1: memcpy(dst + i, src + i * stride, 1); break;
+    case 2: memcpy(dst + i * 2, src + i * stride, 2); break;
+    case 4: memcpy(dst + i * 4, src + i * stride, 4); break;
+    case 8: memcpy(dst + i * 8, src + i * stride, 8); break;
+    }
+
+  export_arrow(
+    dst, length, get_arrow_format(field).c_str(), buffer, out_array,
+    out_schema, field.name.c_str());
+}
+
+
+/*
+ * Exports all fields of `file` as an Arrow struct array.
+ */
+inline void
+export_arrow(
+  RecordFile const& file,
+  ArrowArray* const out_array,
+  ArrowSchema* const out_schema)
+{
+  auto const num_fields = file.schema().fields.size();
+  std::vector<ArrowArray> fields(num_fields);
+  std::vector<ArrowSchema> field_schemas(num_fields);
+  for (size_t i = 0; i < num_fields; ++i)
+    export_arrow_field(file, i, &fields[i], &field_schemas[i]);
+  export_arrow_struct(
+    file.length(), std::move(fields), std::move(field_schemas), out_array,
+    out_schema);
+}
+
+
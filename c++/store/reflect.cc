@@ -0,0 +1,90 @@
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+
+#include "parallel.hh"
+#include "pipeline.hh"
+#include "reader.hh"
+#include "rec.hh"
+#include "reflect.hh"
+#include "timer.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * Sums field `x` grouped by field `y`, by dispatching to the instantiation of
+ * `parallel_group_by()` for those fields, and prints the groups.
+ */
+template<class READER>
+void
+print_sum_by(
+  READER const& reader,
+  size_t const x,
+  size_t const y,
+  ThreadPool* const pool)
+{
+  using REC = typename READER::value_type;
+  for_each_field<REC>([&](auto const fx) {
+    using FX = std::decay_t<decltype(fx)>;
+    if (FX::index == x)
+      for_each_field<REC>([&](auto const fy) {
+        using FY = std::decay_t<decltype(fy)>;
+        if (FY::index != y)
+          return;
+
+        auto const start = now();
+        auto const sums = pipeline::parallel_group_by<FY::index>(
+          reader, pool, pipeline::Sum<FX::index>());
+        auto const elapsed = now() - start;
+
+        std::cout << FY::name() << "\tsum(" << FX::name() << ")\n";
+        size_t n = 0;
+        for (auto const& i : sums)
+          if (n++ < 10)
+            std::cout << +i.first << "\t" << std::get<0>(i.second) << "\n";
+        std::cout << "groups = " << sums.size() << "\n";
+        std::cerr << "elapsed: " << elapsed << " = "
+                  << elapsed / reader.length() / 1E-9 << " ns/rec\n";
+      });
+  });
+}
+
+
+/*
+ * Prints the first orders in a file with their field names, and sums one field
+ * grouped by another, both given by name.
+ */
+int
+main(
+  int const argc,
+  char const* const* const argv)
+{
+  if (argc < 2 || argc > 5) {
+    std::cerr << "usage: " << argv[0] << " FILENAME [FIELD [BY [THREADS]]]\n";
+    return 2;
+  }
+  char const* const filename = argv[1];
+  auto const x = get_field_index<Order>(argc >= 3 ? argv[2] : "size");
+  auto const y = get_field_index<Order>(argc >= 4 ? argv[3] : "instrument");
+  if (x == get_num_fields<Order>() || y == get_num_fields<Order>()) {
+    std::cerr << "unknown field\n";
+    return 2;
+  }
+  std::unique_ptr<ThreadPool> pool;
+  if (argc >= 5)
+    pool.reset(new ThreadPool(atol(argv[4])));
+
+  MmapReader<Order> reader(filename);
+  print_header<Order>(std::cout);
+  for (size_t i = 0; i < std::min<size_t>(5, reader.length()); ++i)
+    print_row(std::cout, reader.get(i));
+  std::cout << "\n";
+
+  print_sum_by(reader, x, y, pool.get());
+
+  return 0;
+}
+
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <type_traits>
+#include <utility>
+
+#include "reader.hh"
+#include "rec.hh"
+
+/*
+ * Generic kernels over the fields of record types, from their compile-time
+ * `Layout`.  Fields are identified by index; offsets, strides, and types are
+ * all constants, so a kernel instantiated for a field compiles to the same
+ * loop as one written by hand for it.
+ */
+
+//------------------------------------------------------------------------------
+
+namespace reflect {
+
+/*
+ * Field I of REC.
+ */
+template<class REC, size_t I>
+struct Field
+{
+  using layout = typename FieldAt<typename Layout<REC>::type, I>::type;
+  using type = typename layout::type;
+  static size_t constexpr index = I;
+  static size_t constexpr offset = layout::offset;
+
+  static constexpr char const* name() { return Layout<REC>::get_name(I); }
+
+  static type const&
+  get(
+    REC const& rec)
+  {
+    return *reinterpret_cast<type const*>(
+      reinterpret_cast<char const*>(&rec) + offset);
+  }
+};
+
+template<class REC, size_t I>
+size_t constexpr Field<REC, I>::index;
+
+template<class REC, size_t I>
+size_t constexpr Field<REC, I>::offset;
+
+}  // namespace reflect
+
+
+template<class REC>
+constexpr size_t
+get_num_fields()
+{
+  return Layout<REC>::type::num_fields;
+}
+
+
+/*
+ * Returns the index of the field of REC named `name`, or the number of
+ * fields if there is none.  Usable in constant expressions, for example,
+ *
+ *     size_t constexpr SIZE = get_field_index<Order>("size");
+ */
+template<class REC>
+constexpr size_t
+get_field_index(
+  char const* const name)
+{
+  size_t i = 0;
+  for (; i < get_num_fields<REC>(); ++i) {
+    auto const n = Layout<REC>::get_name(i);
+    size_t j = 0;
+    while (n[j] != '\0' && n[j] == name[j])
+      ++j;
+    if (n[j] == name[j])
+      break;
+  }
+  return i;
+}
+
+
+namespace reflect {
+
+template<class REC, class FN, size_t... I>
+inline void
+for_each_field(
+  FN&& fn,
+  std::index_sequence<I...>)
+{
+  int const _[] = {(fn(Field<REC, I>()), 0)...};
+  (void) _;
+}
+
+}  // namespace reflect
+
+
+/*
+ * Invokes `fn(reflect::Field<REC, I>())` for each field I, in order.
+ */
+template<class REC, class FN>
+inline void
+for_each_field(
+  FN&& fn)
+{
+  reflect::for_each_field<REC>(
+    fn, std::make_index_sequence<get_num_fields<REC>()>());
+}
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * A typed view of field I of contiguous records.  Unlike the strided `Array`
+ * of `RecordFile::get_field()`, the stride and offset are constants.
+ */
+template<class REC, size_t I>
+class FieldView
+{
+public:
+
+  using field = reflect::Field<REC, I>;
+  using value_type = typename field::type;
+
+  class Iterator
+  {
+  public:
+
+    Iterator(REC const* const rec) : rec_(rec) {}
+
+    bool operator==(Iterator const& other) const { return other.rec_ == rec_; }
+    bool operator!=(Iterator const& other) const { return ! operator==(other); }
+    void operator++() { ++rec_; }
+
+    value_type const& operator*() const { return field::get(*rec_); }
+
+  private:
+
+    REC const* rec_;
+
+  };
+
+  FieldView(
+    RecordBatch<REC> const& batch)
+  : batch_(batch)
+  {
+  }
+
+  size_t length() const { return batch_.length(); }
+
+  value_type const&
+  operator[](
+    size_t const pos)
+    const
+  {
+    return field::get(batch_.get(pos));
+  }
+
+  Iterator begin() const { return batch_.begin(); }
+  Iterator end() const { return batch_.end(); }
+
+private:
+
+  RecordBatch<REC> batch_;
+
+};
+
+
+template<size_t I, class READER>
+inline FieldView<typename READER::value_type, I>
+get_field_view(
+  READER const& reader)
+{
+  return get_batch(reader, 0, reader.length());
+}
+
+
+//------------------------------------------------------------------------------
+// Printing
+
+/*
+ * Prints the field names of REC, separated by `sep`.
+ */
+template<class REC>
+inline void
+print_header(
+  std::ostream& os,
+  char const* const sep="\t")
+{
+  for_each_field<REC>([&](auto const field) {
+    if (field.index > 0)
+      os << sep;
+    os << field.name();
+  });
+  os << "\n";
+}
+
+
+/*
+ * Prints the fields of `rec`, separated by `sep`.
+ */
+template<class REC>
+inline void
+print_row(
+  std::ostream& os,
+  REC const& rec,
+  char const* const sep="\t")
+{
+  for_each_field<REC>([&](auto const field) {
+    if (field.index > 0)
+      os << sep;
+    os << +field.get(rec);
+  });
+  os << "\n";
+}
+
+
+/*
+ * Prints `rec` as `name=value` pairs.
+ */
+template<class REC>
+inline void
+print_fields(
+  std::ostream& os,
+  REC const& rec)
+{
+  for_each_field<REC>([&](auto const field) {
+    if (field.index > 0)
+      os << ' ';
+    os << field.name() << '=' << +field.get(rec);
+  });
+}
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Type in which to sum values of T: 64 bits, and double for floating point.
+ */
+template<class T>
+using SumType = typename std::conditional<
+  std::is_floating_point<T>::value, double,
+  typename std::conditional<
+    std::is_signed<T>::value, int64_t, uint64_t>::type>::type;
+
+
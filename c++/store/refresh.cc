@@ -0,0 +1,45 @@
+#include <iostream>
+#include <memory>
+
+#include "checkpoint.hh"
+#include "parallel.hh"
+#include "timer.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * Brings the checkpointed order stats for a file up to date, and prints
+ * totals.
+ */
+int
+main(
+  int const argc,
+  char const* const* const argv)
+{
+  if (argc != 2 && argc != 3) {
+    std::cerr << "usage: " << argv[0] << " FILENAME [THREADS]\n";
+    return 2;
+  }
+  char const* const filename = argv[1];
+  std::unique_ptr<ThreadPool> pool;
+  if (argc == 3)
+    pool.reset(new ThreadPool(atol(argv[2])));
+
+  auto const start = now();
+  StatsCheckpoint checkpoint;
+  load_checkpoint(filename, checkpoint);
+  auto const scanned = refresh_order_stats(filename, checkpoint, pool.get());
+  auto const elapsed = now() - start;
+
+  uint64_t volume = 0;
+  for (auto const& s : checkpoint.stats)
+    volume += s.second.volume;
+  std::cout << "length = " << checkpoint.length << "\n"
+            << "scanned = " << scanned << "\n"
+            << "instruments = " << checkpoint.stats.size() << "\n"
+            << "total volume = " << volume << "\n";
+  std::cerr << "elapsed: " << elapsed << "\n";
+
+  return 0;
+}
+
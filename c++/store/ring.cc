@@ -0,0 +1,74 @@
+#include <cstring>
+#include <iostream>
+
+#include "rec.hh"
+#include "ring.hh"
+#include "stats.hh"
+#include "timer.hh"
+
+//------------------------------------------------------------------------------
+
+size_t constexpr CAPACITY = 65536;
+
+
+/*
+ * Passes orders through a ring in shared memory.  Run `init` once, then start
+ * any consumers, then the producer.
+ */
+int
+main(
+  int const argc,
+  char const* const* const argv)
+{
+  if (!(argc == 3 && strcmp(argv[2], "init") == 0)
+      && !(argc == 4 && (strcmp(argv[2], "produce") == 0
+                         || strcmp(argv[2], "consume") == 0))) {
+    std::cerr << "usage: " << argv[0] << " NAME init\n"
+              << "       " << argv[0] << " NAME produce COUNT\n"
+              << "       " << argv[0] << " NAME consume COUNT\n";
+    return 2;
+  }
+  char const* const name = argv[1];
+  char const* const mode = argv[2];
+  size_t const size = RecordRing<Order>::get_size(CAPACITY);
+
+  if (strcmp(mode, "init") == 0) {
+    SharedMemoryBuffer buffer(name, size, true);
+    RecordRing<Order> ring(buffer, CAPACITY, true);
+    return 0;
+  }
+
+  size_t const count = atol(argv[3]);
+  SharedMemoryBuffer buffer(name, size, false);
+  RecordRing<Order> ring(buffer, CAPACITY, false);
+
+  if (strcmp(mode, "produce") == 0) {
+    auto const start = now();
+    for (size_t i = 0; i < count; ++i)
+      ring.push({i, (Sid) (1000000 + i % 5000), 100, 10, 0});
+    auto const elapsed = now() - start;
+    std::cerr << "produced " << count << ": "
+              << elapsed / count / 1E-6 << " µs/rec\n";
+  }
+
+  else {
+    int const id = ring.attach();
+    assert(id != -1);
+    uint64_t volume = 0;
+    auto const start = now();
+    for (size_t n = 0; n < count; ) {
+      auto const batch = ring.peek(id, count - n);
+      volume += get_total_volume(batch);
+      ring.consume(id, batch.length());
+      n += batch.length();
+    }
+    auto const elapsed = now() - start;
+    ring.detach(id);
+    std::cout << "total volume = " << volume << "\n";
+    std::cerr << "consumed " << count << ": "
+              << elapsed / count / 1E-6 << " µs/rec\n";
+  }
+
+  return 0;
+}
+
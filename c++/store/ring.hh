@@ -0,0 +1,261 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include "buffer.hh"
+#include "reader.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * Single-producer, multi-consumer ring of records in a buffer, which may be
+ * shared between processes.
+ *
+ * Every consumer sees every record.  Records are numbered by a sequence number
+ * that increases without wrapping; record `seq` is stored in slot
+ * `seq % capacity`.  The producer publishes `head`, the sequence number after
+ * the last record written, and each consumer publishes its own `tail`, the
+ * sequence number after the last record it has consumed.  The producer does
+ * not overwrite a record until all attached consumers have consumed it.
+ *
+ * The hot path uses no locks and no syscalls.  The producer and consumers
+ * each cache the other side's position, and reload it only when they appear
+ * to have caught up, so shared cache lines are touched rarely.
+ */
+template<class REC>
+class RecordRing
+{
+public:
+
+  using value_type = REC;
+
+  static size_t constexpr MAX_CONSUMERS = 16;
+
+  /*
+   * Returns the buffer size required for a ring of `capacity` records.
+   */
+  static size_t
+  get_size(
+    size_t const capacity)
+  {
+    return sizeof(Header) + capacity * sizeof(REC);
+  }
+
+  /*
+   * Attaches to a ring in `buffer`.  If `init`, initializes an empty ring;
+   * this must be done once, before any other process attaches.
+   */
+  RecordRing(
+    Buffer& buffer,
+    size_t const capacity,
+    bool const init)
+  : capacity_(capacity),
+    mask_(capacity - 1),
+    header_(reinterpret_cast<Header*>(buffer.get_start())),
+    data_(reinterpret_cast<REC*>(header_ + 1))
+  {
+    assert((capacity & mask_) == 0);
+    assert(buffer.get_size() >= get_size(capacity));
+
+    if (init) {
+      header_->capacity = capacity;
+      header_->rec_size = sizeof(REC);
+      header_->head.store(0, std::memory_order_relaxed);
+      for (auto& consumer : header_->consumers) {
+        consumer.tail.store(0, std::memory_order_relaxed);
+        consumer.active.store(0, std::memory_order_relaxed);
+      }
+      header_->magic.store(MAGIC, std::memory_order_release);
+    }
+    else {
+      assert(header_->magic.load(std::memory_order_acquire) == MAGIC);
+      assert(header_->capacity == capacity);
+      assert(header_->rec_size == sizeof(REC));
+    }
+  }
+
+  RecordRing(RecordRing const&) = delete;
+  RecordRing(RecordRing&&) = delete;
+
+  size_t capacity() const { return capacity_; }
+
+  //----------------------------------------------------------------------------
+  // Producer
+
+  /*
+   * Appends a record, if there is room for it.
+   */
+  bool
+  try_push(
+    REC const& rec)
+  {
+    auto const head = header_->head.load(std::memory_order_relaxed);
+    if (head - min_tail_ >= capacity_) {
+      min_tail_ = get_min_tail(head);
+      if (head - min_tail_ >= capacity_)
+        return false;
+    }
+    data_[head & mask_] = rec;
+    header_->head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /*
+   * Appends a record, spinning until there is room for it.
+   */
+  void
+  push(
+    REC const& rec)
+  {
+    while (!try_push(rec))
+      __builtin_ia32_pause();
+  }
+
+  /*
+   * Appends as many of `length` records as there is room for, and publishes
+   * them together.  Returns the number appended.
+   */
+  size_t
+  try_push(
+    REC const* const recs,
+    size_t const length)
+  {
+    auto const head = header_->head.load(std::memory_order_relaxed);
+    if (head - min_tail_ + length > capacity_)
+      min_tail_ = get_min_tail(head);
+    auto const count = std::min(length, capacity_ - (head - min_tail_));
+    for (size_t i = 0; i < count; ++i)
+      data_[(head + i) & mask_] = recs[i];
+    header_->head.store(head + count, std::memory_order_release);
+    return count;
+  }
+
+  //----------------------------------------------------------------------------
+  // Consumers
+
+  /*
+   * Attaches a consumer, which starts with the next record pushed.  Returns
+   * the consumer's id, or -1 if there are already `MAX_CONSUMERS`.
+   *
+   * The producer may be computing its minimum tail concurrently, and then
+   * writes up to `capacity` records past it without looking again.  If it
+   * didn't see this consumer active, it also ran before the head loaded here
+   * (see the fence in `get_min_tail()`), so its minimum is at most that head,
+   * and records from it on are not overwritten.  If it did see this consumer
+   * active, it may have loaded the slot's old tail, but that is no later than
+   * the head loaded here, so it only holds the producer back.
+   */
+  int
+  attach()
+  {
+    for (int id = 0; id < (int) MAX_CONSUMERS; ++id) {
+      auto& consumer = header_->consumers[id];
+      uint32_t inactive = 0;
+      if (consumer.active.compare_exchange_strong(inactive, 1)) {
+        consumer.tail.store(
+          header_->head.load(std::memory_order_seq_cst),
+          std::memory_order_seq_cst);
+        return id;
+      }
+    }
+    return -1;
+  }
+
+  void
+  detach(
+    int const id)
+  {
+    header_->consumers[id].active.store(0, std::memory_order_release);
+  }
+
+  /*
+   * Returns a batch of up to `max_length` unconsumed records, without
+   * consuming them.  The batch is contiguous, so it may be shorter than the
+   * number available if they wrap around the end of the ring.  It is empty if
+   * none are available.
+   */
+  RecordBatch<REC>
+  peek(
+    int const id,
+    size_t const max_length=SIZE_MAX)
+  {
+    auto const tail
+      = header_->consumers[id].tail.load(std::memory_order_relaxed);
+    if (head_ <= tail)
+      head_ = header_->head.load(std::memory_order_acquire);
+    auto const start = tail & mask_;
+    auto const length = std::min({head_ - tail, capacity_ - start, max_length});
+    return {data_ + start, length};
+  }
+
+  /*
+   * Marks `length` records as consumed, after which the producer may overwrite
+   * them.
+   */
+  void
+  consume(
+    int const id,
+    size_t const length)
+  {
+    auto& tail = header_->consumers[id].tail;
+    tail.store(
+      tail.load(std::memory_order_relaxed) + length,
+      std::memory_order_release);
+  }
+
+private:
+
+  static uint64_t constexpr MAGIC = 0x676e6952636552ull;  // "RecRing"
+
+  struct alignas(CACHE_LINE_SIZE) Consumer
+  {
+    std::atomic<uint64_t> tail;
+    std::atomic<uint32_t> active;
+  };
+
+  struct Header
+  {
+    std::atomic<uint64_t> magic;
+    uint64_t capacity;
+    uint64_t rec_size;
+
+    // Written only by the producer.
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head;
+
+    // Each written only by its consumer.
+    Consumer consumers[MAX_CONSUMERS];
+  };
+
+  uint64_t
+  get_min_tail(
+    uint64_t const head)
+    const
+  {
+    // Order the head stores before the loads of `active`, so that a consumer
+    // attaching concurrently either is seen, or sees the head.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto min_tail = head;
+    for (auto const& consumer : header_->consumers)
+      if (consumer.active.load(std::memory_order_seq_cst))
+        min_tail = std::min(
+          min_tail, consumer.tail.load(std::memory_order_acquire));
+    return min_tail;
+  }
+
+  size_t const capacity_;
+  size_t const mask_;
+  Header* const header_;
+  REC* const data_;
+
+  // Producer's cached minimum consumer tail.
+  uint64_t min_tail_ = 0;
+  // Consumer's cached producer head.
+  uint64_t head_ = 0;
+
+};
+
+
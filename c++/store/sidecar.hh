@@ -0,0 +1,387 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "cache.hh"
+#include "dataset.hh"
+#include "file.hh"
+#include "hash.hh"
+#include "instrument.hh"
+#include "parallel.hh"
+#include "reader.hh"
+#include "rec.hh"
+#include "sketch.hh"
+
+//------------------------------------------------------------------------------
+
+// Records per sketched block.
+size_t constexpr SKETCH_BLOCK_LENGTH = 64 * 1024;
+
+// Distinct instrument counter: 4 KB, with about 1.6% error.
+using SidCounter = HyperLogLog<12>;
+
+// Instrument filter: 8 KB, with about 0.3% false positives for a block with
+// 5000 instruments.
+using SidFilter = BloomFilter<64 * 1024, 6>;
+
+struct BlockSketch
+{
+  SidCounter sids;
+  SidFilter filter;
+};
+
+
+/*
+ * Sketches of the instruments in a file of records: a distinct counter for
+ * the file, and a distinct counter and filter for each block of
+ * `SKETCH_BLOCK_LENGTH` records.
+ *
+ * Sketches are stored in a sidecar file next to the records, with the version
+ * of the file they are for, so they are rebuilt if the file changes.
+ */
+struct FileSketch
+{
+  FileVersion file;
+  uint64_t length = 0;
+  SidCounter sids;
+  std::vector<BlockSketch> blocks;
+
+  /*
+   * False if no block has records for `sid`.
+   */
+  bool
+  may_contain(
+    Sid const sid)
+    const
+  {
+    auto const hash = mix_hash(sid);
+    for (auto const& block : blocks)
+      if (block.filter.may_contain(hash))
+        return true;
+    return false;
+  }
+};
+
+
+/*
+ * Returns the name of the sketch file for a record file.
+ */
+inline std::string
+get_sketch_filename(
+  std::string const& filename)
+{
+  return filename + ".sketch";
+}
+
+
+/*
+ * Sketches the records of `reader`, the contents of `file`.  Sketches blocks
+ * in parallel on `pool`, or serially if it is null.
+ */
+template<class READER>
+FileSketch
+build_sketch(
+  READER const& reader,
+  FileVersion const& file,
+  ThreadPool* const pool=nullptr)
+{
+  auto const length = reader.length();
+  FileSketch sketch;
+  sketch.file = file;
+  sketch.length = length;
+  sketch.blocks.resize(
+    (length + SKETCH_BLOCK_LENGTH - 1) / SKETCH_BLOCK_LENGTH);
+
+  auto const build = [&](size_t const b0, size_t const b1) {
+    INSTRUMENT_STAGE(SCAN);
+    for (size_t b = b0; b < b1; ++b) {
+      auto const batch = get_batch(
+        reader, b * SKETCH_BLOCK_LENGTH,
+        std::min((b + 1) * SKETCH_BLOCK_LENGTH, length));
+      INSTRUMENT_COUNT(RECORDS_SCANNED, batch.length());
+      INSTRUMENT_COUNT(BYTES_SCANNED, batch.size());
+      auto& block = sketch.blocks[b];
+      for (auto const& rec : batch) {
+        auto const hash = mix_hash(rec.instrument);
+        block.sids.add_hash(hash);
+        block.filter.add_hash(hash);
+      }
+    }
+  };
+  if (pool == nullptr)
+    build(0, sketch.blocks.size());
+  else
+    pool->parallel_for(0, sketch.blocks.size(), 1, build);
+
+  for (auto const& block : sketch.blocks)
+    sketch.sids.merge(block.sids);
+  return sketch;
+}
+
+
+namespace sidecar {
+
+uint64_t constexpr MAGIC = 0x6374656b53636552ull;  // "RecSketc"
+uint32_t constexpr VERSION = 2;
+
+/*
+ * On disk, a sketch file is a header, the file's counter, and `num_blocks`
+ * block sketches.
+ */
+struct Header
+{
+  uint64_t magic;
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t block_length;
+  FileVersion file;
+  uint64_t length;
+  uint64_t num_blocks;
+  // Hash of the counter and block sketches.
+  uint64_t checksum;
+};
+
+// The header is written as is, so it mustn't have padding.
+static_assert(sizeof(Header) == 80, "padding in sidecar::Header");
+
+inline uint64_t
+get_checksum(
+  FileSketch const& sketch)
+{
+  return hash_bytes(
+    sketch.blocks.data(), sketch.blocks.size() * sizeof(BlockSketch),
+    hash_bytes(&sketch.sids, sizeof(SidCounter)));
+}
+
+inline bool
+operator==(
+  FileVersion const& v0,
+  FileVersion const& v1)
+{
+  return
+    v0.dev == v1.dev && v0.ino == v1.ino && v0.size == v1.size
+    && v0.mtime_ns == v1.mtime_ns;
+}
+
+}  // namespace sidecar
+
+
+/*
+ * Loads the sketch for `filename`, a file of REC.  Returns false if there is
+ * none, it can't be read, it is not valid, or it is for another version of
+ * the file.
+ */
+template<class REC>
+inline bool
+load_sketch(
+  std::string const& filename,
+  FileSketch& sketch)
+{
+  using namespace sidecar;
+
+  int const fd = open(get_sketch_filename(filename).c_str(), O_RDONLY);
+  if (fd == -1)
+    return false;
+
+  struct stat file_info;
+  Header header;
+  bool valid
+    = fstat(fd, &file_info) == 0
+      && read(fd, &header, sizeof(header)) == sizeof(header)
+      && header.magic == MAGIC
+      && header.version == VERSION
+      && header.record_size == sizeof(REC)
+      && header.block_length == SKETCH_BLOCK_LENGTH
+      && header.file == get_file_version(filename.c_str())
+      && (size_t) file_info.st_size
+         == sizeof(header) + sizeof(SidCounter)
+            + header.num_blocks * sizeof(BlockSketch);
+  if (valid) {
+    sketch.blocks.resize(header.num_blocks);
+    auto const size = sketch.blocks.size() * sizeof(BlockSketch);
+    valid
+      = read(fd, &sketch.sids, sizeof(SidCounter)) == sizeof(SidCounter)
+        && read(fd, sketch.blocks.data(), size) == (ssize_t) size
+        && get_checksum(sketch) == header.checksum;
+  }
+  close(fd);
+  if (!valid)
+    return false;
+
+  sketch.file = header.file;
+  sketch.length = header.length;
+  return true;
+}
+
+
+/*
+ * Saves the sketch for `filename`, a file of REC.  The sketch file is replaced
+ * atomically, so concurrent loads see a whole sketch, and concurrent saves
+ * don't interfere.  Throws `std::system_error` if it can't be written.
+ */
+template<class REC>
+inline void
+save_sketch(
+  std::string const& filename,
+  FileSketch const& sketch)
+{
+  using namespace sidecar;
+
+  Header const header{
+    MAGIC, VERSION, sizeof(REC), SKETCH_BLOCK_LENGTH, sketch.file,
+    sketch.length, sketch.blocks.size(), get_checksum(sketch)};
+
+  std::string contents(reinterpret_cast<char const*>(&header), sizeof(header));
+  contents.append(
+    reinterpret_cast<char const*>(&sketch.sids), sizeof(SidCounter));
+  contents.append(
+    reinterpret_cast<char const*>(sketch.blocks.data()),
+    sketch.blocks.size() * sizeof(BlockSketch));
+  replace_file(get_sketch_filename(filename), contents);
+}
+
+
+/*
+ * Returns the sketch for a partition, from its sketch file if that is up to
+ * date.  Otherwise, builds the sketch, and if `save`, saves it; throws
+ * `std::system_error` if it can't.
+ */
+template<class REC>
+inline FileSketch
+get_sketch(
+  Partition const& partition,
+  ThreadPool* const pool=nullptr,
+  bool const save=true)
+{
+  FileSketch sketch;
+  if (load_sketch<REC>(partition.filename, sketch))
+    return sketch;
+
+  // Get the version first, so a change while building invalidates the sketch.
+  auto const file = get_file_version(partition.filename.c_str());
+  sketch = scan_partition<REC>(
+    partition, 0, UINT64_MAX,
+    [&](RecordBatch<REC> const& batch) {
+      return build_sketch(batch, file, pool);
+    });
+  if (save)
+    save_sketch<REC>(partition.filename, sketch);
+  return sketch;
+}
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Scans the blocks of `batch`, the records of a file sketched by `sketch`,
+ * that may have records for `sid` in [start, end).  Computes `map(block)` for
+ * each, trimmed to the range, and folds the results with `combine`, starting
+ * with `init`.  Blocks still include records of other instruments.
+ */
+template<class REC, class T, class MAP, class COMBINE>
+inline T
+scan_sid(
+  RecordBatch<REC> const& batch,
+  FileSketch const& sketch,
+  Sid const sid,
+  Timestamp const start,
+  Timestamp const end,
+  T init,
+  MAP&& map,
+  COMBINE&& combine)
+{
+  assert(sketch.length == batch.length());
+  auto const hash = mix_hash(sid);
+  auto result = std::move(init);
+  for (size_t b = 0; b < sketch.blocks.size(); ++b) {
+    if (!sketch.blocks[b].filter.may_contain(hash)) {
+      INSTRUMENT_COUNT(BLOCKS_SKIPPED, 1);
+      continue;
+    }
+    auto const block = get_batch(
+      batch, b * SKETCH_BLOCK_LENGTH,
+      std::min((b + 1) * SKETCH_BLOCK_LENGTH, batch.length()));
+    auto const len = block.length();
+    auto const i0 = lower_bound_timestamp(block, start, 0, len);
+    auto const i1 = lower_bound_timestamp(block, end, i0, len);
+    if (i0 < i1)
+      result = combine(std::move(result), map(get_batch(block, i0, i1)));
+  }
+  return result;
+}
+
+
+/*
+ * Like `scan()` of a dataset, but for the records of one instrument: skips
+ * partitions in other buckets, and files and blocks whose sketches show no
+ * records for `sid`.  Builds and saves missing sketches.
+ */
+template<class REC, class T, class MAP, class COMBINE>
+inline T
+scan_sid(
+  Dataset<REC> const& dataset,
+  Timestamp const start,
+  Timestamp const end,
+  Sid const sid,
+  ThreadPool* const pool,
+  T init,
+  MAP&& map,
+  COMBINE&& combine)
+{
+  auto const partitions = dataset.select(start, end, &sid);
+  return parallel_reduce(
+    pool, 0, partitions.size(), 1, init,
+    [&](size_t const i0, size_t const i1) {
+      auto result = init;
+      for (size_t i = i0; i < i1; ++i) {
+        auto const sketch = get_sketch<REC>(partitions[i]);
+        if (!sketch.may_contain(sid)) {
+          // Don't map the file at all.
+          INSTRUMENT_COUNT(BLOCKS_SKIPPED, sketch.blocks.size());
+          continue;
+        }
+        result = combine(
+          std::move(result),
+          scan_partition<REC>(
+            partitions[i], 0, UINT64_MAX,
+            [&](RecordBatch<REC> const& batch) {
+              return scan_sid(
+                batch, sketch, sid, start, end, init, map, combine);
+            }));
+      }
+      return result;
+    },
+    combine);
+}
+
+
+/*
+ * Estimates the number of distinct instruments in the partitions of `dataset`
+ * that overlap [start, end), by merging their sketches.  Records are scanned
+ * only to build missing sketches, on `pool` if not null.  Partitions are
+ * counted whole, so the range should be whole days.
+ */
+template<class REC>
+inline double
+count_distinct_sids(
+  Dataset<REC> const& dataset,
+  Timestamp const start,
+  Timestamp const end,
+  ThreadPool* const pool=nullptr)
+{
+  SidCounter sids;
+  for (auto const& partition : dataset.select(start, end))
+    sids.merge(get_sketch<REC>(partition, pool).sids);
+  return sids.get_count();
+}
+
+
@@ -0,0 +1,124 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+
+#include "dataset.hh"
+#include "instrument.hh"
+#include "parallel.hh"
+#include "reader.hh"
+#include "rec.hh"
+#include "sidecar.hh"
+#include "stats.hh"
+#include "timer.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * Counts distinct instruments in a dataset from sketches, and compares with an
+ * exact count from a scan.
+ */
+void
+count(
+  Dataset<Order> const& dataset,
+  Timestamp const start,
+  Timestamp const end,
+  ThreadPool* const pool)
+{
+  auto t = now();
+  auto const estimate = count_distinct_sids(dataset, start, end, pool);
+  t = now() - t;
+  std::cout << "sketch: instruments = " << estimate
+            << " elapsed = " << t << " s\n";
+
+  t = now();
+  auto const stats = scan(
+    dataset, start, end, pool, std::map<Sid, OrderStats>{},
+    [](RecordBatch<Order> const& batch) { return get_order_stats(batch); },
+    [](std::map<Sid, OrderStats> stats,
+       std::map<Sid, OrderStats> const& later) {
+      merge(stats, later);
+      return stats;
+    });
+  t = now() - t;
+  std::cout << "scan: instruments = " << stats.size()
+            << " elapsed = " << t << " s\n";
+}
+
+
+/*
+ * Counts orders for one instrument in a dataset, skipping blocks by their
+ * sketches, and compares with a full scan.
+ */
+void
+find(
+  Dataset<Order> const& dataset,
+  Sid const sid,
+  Timestamp const start,
+  Timestamp const end,
+  ThreadPool* const pool)
+{
+  auto const count_sid = [sid](RecordBatch<Order> const& batch) {
+    uint64_t count = 0;
+    for (auto const& order : batch)
+      count += order.instrument == sid;
+    return count;
+  };
+  auto const add = [](uint64_t const c0, uint64_t const c1) { return c0 + c1; };
+
+  auto t = now();
+  auto const skipped
+    = scan_sid(dataset, start, end, sid, pool, uint64_t{0}, count_sid, add);
+  t = now() - t;
+  std::cout << "sketch: orders = " << skipped << " elapsed = " << t << " s\n";
+
+  t = now();
+  auto const scanned
+    = scan(dataset, start, end, pool, uint64_t{0}, count_sid, add);
+  t = now() - t;
+  std::cout << "scan: orders = " << scanned << " elapsed = " << t << " s\n";
+}
+
+
+int
+main(
+  int const argc,
+  char const* const* const argv)
+{
+  bool const is_count = argc >= 2 && strcmp(argv[1], "count") == 0;
+  bool const is_find = argc >= 2 && strcmp(argv[1], "find") == 0;
+  // Arguments after the command and directory.
+  int const arg = is_find ? 5 : 4;
+  if (!((is_count && argc >= 3) || (is_find && argc >= 5))
+      || !(argc == arg || argc == arg + 2 || argc == arg + 3)) {
+    std::cerr << "usage: " << argv[0]
+              << " count DIR BUCKETS [START_DATE END_DATE [THREADS]]\n"
+              << "       " << argv[0]
+              << " find DIR BUCKETS SID [START_DATE END_DATE [THREADS]]\n";
+    return 2;
+  }
+
+  Dataset<Order> const dataset(argv[2], atol(argv[3]));
+  // The date range is inclusive.
+  Timestamp const start
+    = argc >= arg + 2 ? get_day_of_date(atol(argv[arg])) * NS_PER_DAY : 0;
+  Timestamp const end
+    = argc >= arg + 2 ? (get_day_of_date(atol(argv[arg + 1])) + 1) * NS_PER_DAY
+    : UINT64_MAX;
+  std::unique_ptr<ThreadPool> pool;
+  if (argc == arg + 3)
+    pool.reset(new ThreadPool(atol(argv[arg + 2])));
+
+  if (is_count)
+    count(dataset, start, end, pool.get());
+  else
+    find(dataset, atol(argv[4]), start, end, pool.get());
+
+#ifdef INSTRUMENT
+  std::cerr << get_instrument_totals();
+#endif
+
+  return 0;
+}
+
@@ -0,0 +1,491 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "hash.hh"
+#include "instrument.hh"
+#include "parallel.hh"
+#include "reader.hh"
+#include "rec.hh"
+#include "sketch.hh"
+#include "sum.hh"
+#include "table.hh"
+
+// Minimum number of records per task, for parallel scans.
+size_t constexpr SCAN_GRAIN = 64 * 1024;
+
+//------------------------------------------------------------------------------
+
+struct OrderStats
+{
+  uint32_t count;
+  Size net_size;
+  Size volume;
+  // Sum of volume * price, compensated so it reconciles over many orders.
+  Compensated<double> vwp;
+  Price last_price;
+
+  double vwap() const { return volume == 0 ? 0 : vwp.get() / volume; }
+};
+
+
+// Records per span in scans.
+size_t constexpr STATS_SPAN = 64;
+
+/*
+ * Updates stats `s` with `order`.
+ */
+inline void
+update(
+  OrderStats& s,
+  Order const& order)
+{
+  auto const volume = std::abs(order.size);
+  ++s.count;
+  s.net_size += order.size;
+  s.volume += volume;
+  s.vwp.add((double) volume * order.price);
+  s.last_price = order.price;
+}
+
+
+//------------------------------------------------------------------------------
+// Group-by with prefetching
+
+uint64_t constexpr NS_PER_MINUTE = 60ull * 1000000000ull;
+
+/*
+ * Group-by keys for order stats.
+ */
+struct BySid
+{
+  using type = Sid;
+  static Sid get(Order const& order) { return order.instrument; }
+};
+
+
+/*
+ * Instrument and minute, packed into 64 bits.
+ */
+struct BySidMinute
+{
+  using type = uint64_t;
+
+  static uint64_t
+  get(
+    Order const& order)
+  {
+    return
+      (uint64_t) order.instrument << 32
+      | (uint32_t) (order.timestamp / NS_PER_MINUTE);
+  }
+};
+
+
+/*
+ * How group-by hides the latency of hash table lookups that miss cache.  Once
+ * a table outgrows the LLC, nearly every lookup does.
+ *
+ * - NONE looks up each record as it is scanned, so misses are serialized.
+ *
+ * - GROUP hashes a group of `PREFETCH_GROUP` records and prefetches their
+ *   slots, then updates them; the group's misses overlap with each other.
+ *
+ * - AHEAD hashes a span and prefetches its slots while updating the span
+ *   before it, so misses also overlap with updates.
+ *
+ * With linear probing, a lookup is one dependent access, so prefetching the
+ * slot covers it; there are no chains to walk with a multi-stage AMAC state
+ * machine.
+ */
+enum class Prefetch
+{
+  NONE,
+  GROUP,
+  AHEAD,
+};
+
+
+// Records per prefetch group; enough to keep the line fill buffers busy.
+size_t constexpr PREFETCH_GROUP = 16;
+
+/*
+ * Aggregates order stats of `reader` into `table`, grouped by KEY.
+ */
+template<class KEY, Prefetch PREFETCH=Prefetch::AHEAD, class READER>
+void
+group_order_stats(
+  READER const& reader,
+  HashTable<typename KEY::type, OrderStats>& table)
+{
+  INSTRUMENT_STAGE(SCAN);
+  INSTRUMENT_COUNT(RECORDS_SCANNED, reader.length());
+  INSTRUMENT_COUNT(
+    BYTES_SCANNED, reader.length() * sizeof(typename READER::value_type));
+
+  OrderStats const init{0, 0, 0, {}, 0};
+  auto const get_hash = [](Order const& order) {
+    return mix_hash(KEY::get(order));
+  };
+  auto const update_hashed = [&](Order const& order, uint64_t const hash) {
+    update(table.get(KEY::get(order), hash, init), order);
+  };
+
+  if (PREFETCH == Prefetch::NONE)
+    for (auto const& order : get_batch(reader, 0, reader.length()))
+      update_hashed(order, get_hash(order));
+
+  else if (PREFETCH == Prefetch::GROUP)
+    for_each_span<PREFETCH_GROUP>(reader, [&](auto const& orders) {
+      uint64_t hashes[PREFETCH_GROUP];
+      for (size_t i = 0; i < orders.length(); ++i) {
+        hashes[i] = get_hash(orders.get(i));
+        table.prefetch(hashes[i]);
+      }
+      for (size_t i = 0; i < orders.length(); ++i)
+        update_hashed(orders.get(i), hashes[i]);
+    });
+
+  else {
+    auto const spans = get_spans<STATS_SPAN>(reader);
+    uint64_t hashes[2][STATS_SPAN];
+    auto const hash = [&](RecordSpan<Order, STATS_SPAN> const span, int h) {
+      for (size_t i = 0; i < STATS_SPAN; ++i) {
+        hashes[h][i] = get_hash(span[i]);
+        table.prefetch(hashes[h][i]);
+      }
+    };
+
+    if (spans.size() > 0)
+      hash(spans[0], 0);
+    for (size_t j = 0; j < spans.size(); ++j) {
+      // Hash the next span and prefetch its slots, then update this one.
+      auto const h = j % 2;
+      if (j + 1 < spans.size())
+        hash(spans[j + 1], 1 - h);
+      auto const span = spans[j];
+      for (size_t i = 0; i < STATS_SPAN; ++i)
+        update_hashed(span[i], hashes[h][i]);
+    }
+    for (auto const& order : spans.tail())
+      update_hashed(order, get_hash(order));
+  }
+}
+
+
+//------------------------------------------------------------------------------
+
+template<class READER>
+std::map<Sid, OrderStats>
+get_order_stats(
+  READER const& reader) 
+{
+  HashTable<Sid, OrderStats> table;
+  group_order_stats<BySid>(reader, table);
+
+  std::map<Sid, OrderStats> stats;
+  table.for_each([&](Sid const sid, OrderStats const& s) {
+    stats.emplace(sid, s);
+  });
+  return stats;
+}
+
+
+template<class READER>
+uint64_t
+get_total_volume(
+  READER const& reader)
+{
+  INSTRUMENT_STAGE(SCAN);
+  INSTRUMENT_COUNT(RECORDS_SCANNED, reader.length());
+  INSTRUMENT_COUNT(
+    BYTES_SCANNED, reader.length() * sizeof(typename READER::value_type));
+  uint64_t volume = 0;
+  for_each_span<STATS_SPAN>(reader, [&volume](auto const& orders) {
+    for (auto const& order : orders)
+      volume += std::abs(order.size);
+  });
+  return volume;
+}
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Merges stats for later orders of the same instrument into `s`.
+ */
+inline void
+merge(
+  OrderStats& s,
+  OrderStats const& later)
+{
+  s.count += later.count;
+  s.net_size += later.net_size;
+  s.volume += later.volume;
+  s.vwp.add(later.vwp);
+  s.last_price = later.last_price;
+}
+
+
+/*
+ * Merges stats for later orders into `stats`.
+ */
+template<class STATS>
+inline void
+merge(
+  std::map<Sid, STATS>& stats,
+  std::map<Sid, STATS> const& later)
+{
+  INSTRUMENT_STAGE(MERGE);
+  for (auto const& i : later) {
+    auto const j = stats.find(i.first);
+    if (j == stats.end())
+      stats.insert(i);
+    else
+      merge(j->second, i.second);
+  }
+}
+
+
+/*
+ * Scans in parallel on `pool`, or serially if it is null.  Records are scanned
+ * in fixed chunks whose results are merged in order, so the result is the
+ * same for any pool.
+ */
+template<class READER>
+std::map<Sid, OrderStats>
+get_order_stats(
+  READER const& reader,
+  ThreadPool* const pool)
+{
+  return parallel_reduce(
+    pool, 0, reader.length(), SCAN_GRAIN, std::map<Sid, OrderStats>{},
+    [&reader](size_t const start, size_t const stop) {
+      return get_order_stats(get_batch(reader, start, stop));
+    },
+    [](std::map<Sid, OrderStats> stats,
+       std::map<Sid, OrderStats> const& later) {
+      merge(stats, later);
+      return stats;
+    });
+}
+
+
+/*
+ * Scans in parallel on `pool`, or serially if it is null.
+ */
+template<class READER>
+uint64_t
+get_total_volume(
+  READER const& reader,
+  ThreadPool* const pool)
+{
+  if (pool == nullptr)
+    return get_total_volume(reader);
+  return pool->parallel_reduce(
+    0, reader.length(), SCAN_GRAIN, uint64_t{0},
+    [&reader](size_t const start, size_t const stop) {
+      return get_total_volume(get_batch(reader, start, stop));
+    },
+    [](uint64_t const v0, uint64_t const v1) { return v0 + v1; });
+}
+
+
+//------------------------------------------------------------------------------
+// Distributions
+
+// Number of largest orders kept per instrument.
+size_t constexpr TOP_ORDERS = 8;
+
+// Records per task for distributions.  Merging sketches costs more than
+// merging stats, so tasks are larger.
+size_t constexpr DISTRIBUTION_GRAIN = 256 * 1024;
+
+/*
+ * Orders by volume.
+ */
+struct ByVolume
+{
+  bool
+  operator()(
+    Order const& o0,
+    Order const& o1)
+    const
+  {
+    return std::abs(o0.size) < std::abs(o1.size);
+  }
+};
+
+
+/*
+ * The distribution of an instrument's orders, in bounded memory: the largest
+ * orders, and sketches of price and volume quantiles.
+ */
+struct OrderDistribution
+{
+  TopK<Order, TOP_ORDERS, ByVolume> largest;
+  QuantileSketch<Price> price;
+  QuantileSketch<Size> volume;
+};
+
+
+inline void
+update(
+  OrderDistribution& d,
+  Order const& order)
+{
+  d.largest.add(order);
+  d.price.add(order.price);
+  d.volume.add(std::abs(order.size));
+}
+
+
+/*
+ * Merges the distribution of later orders of the same instrument into `d`.
+ */
+inline void
+merge(
+  OrderDistribution& d,
+  OrderDistribution const& later)
+{
+  d.largest.merge(later.largest);
+  d.price.merge(later.price);
+  d.volume.merge(later.volume);
+}
+
+
+template<class READER>
+std::map<Sid, OrderDistribution>
+get_order_distributions(
+  READER const& reader)
+{
+  INSTRUMENT_STAGE(SCAN);
+  INSTRUMENT_COUNT(RECORDS_SCANNED, reader.length());
+  INSTRUMENT_COUNT(
+    BYTES_SCANNED, reader.length() * sizeof(typename READER::value_type));
+
+  OrderDistribution const init{};
+  HashTable<Sid, OrderDistribution> table;
+  for (auto const& order : get_batch(reader, 0, reader.length()))
+    update(
+      table.get(order.instrument, mix_hash(order.instrument), init), order);
+
+  std::map<Sid, OrderDistribution> dists;
+  table.for_each([&](Sid const sid, OrderDistribution const& d) {
+    dists.emplace(sid, d);
+  });
+  return dists;
+}
+
+
+/*
+ * Scans in parallel on `pool`, or serially if it is null.  Since chunks are
+ * merged in order, and sketches are deterministic, the result is the same for
+ * any pool.
+ */
+template<class READER>
+std::map<Sid, OrderDistribution>
+get_order_distributions(
+  READER const& reader,
+  ThreadPool* const pool)
+{
+  return parallel_reduce(
+    pool, 0, reader.length(), DISTRIBUTION_GRAIN,
+    std::map<Sid, OrderDistribution>{},
+    [&reader](size_t const start, size_t const stop) {
+      return get_order_distributions(get_batch(reader, start, stop));
+    },
+    [](std::map<Sid, OrderDistribution> dists,
+       std::map<Sid, OrderDistribution> const& later) {
+      merge(dists, later);
+      return dists;
+    });
+}
+
+
+//------------------------------------------------------------------------------
+
+// Number of key partitions for the partitioned merge, by the high bits of the
+// key's hash; the low bits index the hash tables.
+size_t constexpr STATS_PARTITION_BITS = 6;
+size_t constexpr STATS_PARTITIONS = size_t{1} << STATS_PARTITION_BITS;
+
+/*
+ * Like `get_order_stats()` on `pool`, but without a serial merge, for hosts
+ * with many cores or NUMA nodes.
+ *
+ * Each chunk of records is aggregated into a private hash table, by whichever
+ * worker scans it; since workers are pinned, the table is allocated on that
+ * worker's node by first touch.  The worker then scatters the table's entries
+ * by the radix of the key's hash into `STATS_PARTITIONS` partitions.  In the
+ * merge, each task owns whole partitions, and merges them across chunks in
+ * chunk order, so no two threads write the same entry and no atomics or locks
+ * are needed.
+ *
+ * Returns the stats of each partition.  Partitions have disjoint keys, and
+ * together are the same as the result of `get_order_stats()`; combining them
+ * into one map, if a caller needs that, is a serial step.
+ */
+template<class READER>
+std::vector<std::map<Sid, OrderStats>>
+get_order_stats_partitioned(
+  READER const& reader,
+  ThreadPool& pool)
+{
+  using Entries = std::vector<std::pair<Sid, OrderStats>>;
+  auto const partition = [](uint64_t const hash) {
+    return hash >> (64 - STATS_PARTITION_BITS);
+  };
+
+  auto const length = reader.length();
+  auto const num_chunks = (length + SCAN_GRAIN - 1) / SCAN_GRAIN;
+  // Entries for each chunk and partition.
+  std::vector<std::vector<Entries>> chunks(num_chunks);
+
+  pool.parallel_for(
+    0, num_chunks, 1,
+    [&](size_t const c0, size_t const c1) {
+      for (size_t c = c0; c < c1; ++c) {
+        HashTable<Sid, OrderStats> table;
+        group_order_stats<BySid>(
+          get_batch(
+            reader, c * SCAN_GRAIN, std::min((c + 1) * SCAN_GRAIN, length)),
+          table);
+
+        auto& parts = chunks[c];
+        parts.resize(STATS_PARTITIONS);
+        table.for_each([&](Sid const sid, OrderStats const& s) {
+          parts[partition(mix_hash(sid))].emplace_back(sid, s);
+        });
+      }
+    });
+
+  std::vector<std::map<Sid, OrderStats>> stats(STATS_PARTITIONS);
+  pool.parallel_for(
+    0, STATS_PARTITIONS, 1,
+    [&](size_t const p0, size_t const p1) {
+      INSTRUMENT_STAGE(MERGE);
+      for (size_t p = p0; p < p1; ++p) {
+        HashTable<Sid, OrderStats> table;
+        for (auto const& parts : chunks)
+          for (auto const& entry : parts[p]) {
+            // Insert the first stats for a key, and merge later ones.
+            auto const size = table.size();
+            auto& s
+              = table.get(entry.first, mix_hash(entry.first), entry.second);
+            if (table.size() == size)
+              merge(s, entry.second);
+          }
+        table.for_each([&](Sid const sid, OrderStats const& s) {
+          stats[p].emplace(sid, s);
+        });
+      }
+    });
+  return stats;
+}
+
+
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "buffer.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * Allocator of cache line aligned arrays, so that an element no larger than a
+ * line, whose size divides the line size, never straddles two.
+ */
+template<class T>
+struct CacheAlignedAllocator
+{
+  using value_type = T;
+
+  CacheAlignedAllocator() = default;
+  template<class U> CacheAlignedAllocator(CacheAlignedAllocator<U> const&) {}
+
+  T*
+  allocate(
+    size_t const n)
+  {
+    void* ptr;
+    if (posix_memalign(&ptr, CACHE_LINE_SIZE, n * sizeof(T)) != 0)
+      throw std::bad_alloc();
+    return static_cast<T*>(ptr);
+  }
+
+  void deallocate(T* const ptr, size_t) { free(ptr); }
+
+  template<class U>
+  bool operator==(CacheAlignedAllocator<U> const&) const { return true; }
+  template<class U>
+  bool operator!=(CacheAlignedAllocator<U> const&) const { return false; }
+};
+
+
+/*
+ * Open addressing hash table, for aggregating by key in scans.
+ *
+ * Callers compute hashes themselves, so that they can hash a batch of keys,
+ * `prefetch()` their slots, and only then look them up.  Slots are probed
+ * linearly, and the table doubles when it is half full.  Entries can't be
+ * erased.  Slots are aligned to cache lines; a 64-byte slot, as for order
+ * stats by a 64-bit key, is one line, so a lookup that doesn't collide misses
+ * once.
+ */
+template<class K, class V>
+class HashTable
+{
+public:
+
+  struct Slot
+  {
+    uint64_t hash;
+    bool used;
+    K key;
+    V value;
+  };
+
+  HashTable(
+    size_t const capacity=64)
+  {
+    size_t num_slots = 16;
+    while (num_slots < 2 * capacity)
+      num_slots *= 2;
+    slots_.resize(num_slots);
+    mask_ = num_slots - 1;
+  }
+
+  size_t size() const { return size_; }
+  size_t num_slots() const { return slots_.size(); }
+
+  /*
+   * Hints that the slot for `hash` will be accessed soon.
+   */
+  void
+  prefetch(
+    uint64_t const hash)
+    const
+  {
+    // The slot will be written.
+    __builtin_prefetch(&slots_[hash & mask_], 1);
+  }
+
+  /*
+   * Returns the value for `key`, whose hash is `hash`.  If there is none,
+   * inserts `init` first.
+   */
+  V&
+  get(
+    K const& key,
+    uint64_t const hash,
+    V const& init)
+  {
+    for (size_t i = hash & mask_; ; i = (i + 1) & mask_) {
+      auto& slot = slots_[i];
+      if (!slot.used) {
+        if (2 * (size_ + 1) > slots_.size()) {
+          grow();
+          return get(key, hash, init);
+        }
+        slot = {hash, true, key, init};
+        ++size_;
+        return slot.value;
+      }
+      if (slot.hash == hash && slot.key == key)
+        return slot.value;
+    }
+  }
+
+  /*
+   * Invokes `fn(key, value)` for each entry, in no particular order.
+   */
+  template<class FN>
+  void
+  for_each(
+    FN&& fn)
+    const
+  {
+    for (auto const& slot : slots_)
+      if (slot.used)
+        fn(slot.key, slot.value);
+  }
+
+private:
+
+  void
+  grow()
+  {
+    Slots slots(2 * slots_.size());
+    std::swap(slots, slots_);
+    mask_ = slots_.size() - 1;
+    for (auto& slot : slots)
+      if (slot.used) {
+        auto i = slot.hash & mask_;
+        while (slots_[i].used)
+          i = (i + 1) & mask_;
+        slots_[i] = std::move(slot);
+      }
+  }
+
+  using Slots = std::vector<Slot, CacheAlignedAllocator<Slot>>;
+
+  Slots slots_;
+  size_t mask_;
+  size_t size_ = 0;
+
+};
+
+
@@ -0,0 +1,29 @@
+#include <iostream>
+
+#include "rec.hh"
+#include "tail.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * Prints orders as they are appended to a file.
+ */
+int
+main(
+  int const argc,
+  char const* const* const argv)
+{
+  if (argc != 2) {
+    std::cerr << "usage: " << argv[0] << " FILENAME\n";
+    return 2;
+  }
+
+  TailReader<Order> reader(argv[1]);
+  reader.follow([](Order const& order) {
+    std::cout << order << std::endl;
+    return true;
+  });
+
+  return 0;
+}
+
@@ -0,0 +1,307 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+//------------------------------------------------------------------------------
+
+/*
+ * State shared between a writer and the readers tailing its file, in a sidecar
+ * file next to it.
+ *
+ * The writer stores `length` only after the records it covers are completely
+ * written, then bumps `seq` and wakes any waiting readers.  A reader never
+ * reads past `length`, so it never sees a partially written record.
+ */
+struct TailState
+{
+  std::atomic<uint64_t> length;
+  // Futex word, bumped on each publish.
+  std::atomic<uint32_t> seq;
+  // Number of readers blocked on the futex.
+  std::atomic<uint32_t> waiters;
+};
+
+static_assert(
+  ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+  "TailState must be lock-free to be shared between processes");
+
+
+inline std::string
+get_tail_filename(
+  char const* const filename)
+{
+  return std::string(filename) + ".tail";
+}
+
+
+/*
+ * Opens and maps the tail state for a file, creating it if `create`.  Returns
+ * null if it doesn't exist and `create` is false.
+ */
+inline TailState*
+open_tail_state(
+  char const* const filename,
+  bool const create)
+{
+  auto const tail_filename = get_tail_filename(filename);
+  int const fd = open(
+    tail_filename.c_str(), create ? O_RDWR | O_CREAT : O_RDWR, 0644);
+  if (fd == -1) {
+    assert(!create);
+    return nullptr;
+  }
+  if (create) {
+    int const rval = ftruncate(fd, sizeof(TailState));
+    assert(rval == 0);
+  }
+
+  void* const state = mmap(
+    nullptr, sizeof(TailState), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  assert(state != MAP_FAILED);
+  close(fd);
+  return reinterpret_cast<TailState*>(state);
+}
+
+
+inline void
+close_tail_state(
+  TailState* const state)
+{
+  int const rval = munmap(state, sizeof(TailState));
+  assert(rval == 0);
+}
+
+
+/*
+ * Publishes `length` records as safe to read.
+ */
+inline void
+publish_tail_length(
+  TailState* const state,
+  uint64_t const length)
+{
+  state->length.store(length, std::memory_order_release);
+  state->seq.fetch_add(1, std::memory_order_seq_cst);
+  if (state->waiters.load(std::memory_order_seq_cst) > 0)
+    syscall(SYS_futex, &state->seq, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Reader for a record file that is being appended to concurrently.
+ *
+ * Maps a large reserved range of the file up front, so the mapping never has
+ * to move as the file grows; pages past the end of the file are not touched
+ * until records in them are visible.
+ *
+ * If the writer publishes tail state (see `WriterOptions::publish`), the
+ * visible length is the published length, and waits use a futex on it.
+ * Otherwise, the visible length is the file size rounded down to whole
+ * records, and waits poll.
+ */
+template<class REC>
+class TailReader
+{
+public:
+
+  using value_type = REC;
+
+  // FIXME: Iterator may not outlive container.
+  class Iterator
+  {
+  public:
+
+    Iterator(
+      TailReader const* const reader,
+      size_t const pos)
+    : reader_(reader),
+      pos_(pos)
+    {
+      assert(pos_ <= reader->length());
+    }
+
+    ~Iterator() = default;
+
+    bool operator==(Iterator const& other) const { return other.pos_ == pos_; }
+    bool operator!=(Iterator const& other) const { return ! operator==(other); }
+    void operator++() { ++pos_; }
+
+    REC const& operator->() { return reader_->get(pos_); }
+    REC const& operator*() { return reader_->get(pos_); }
+
+  private:
+
+    TailReader const* const reader_;
+    size_t pos_;
+
+  };
+
+  TailReader(
+    char const* const filename,
+    size_t const reserve=size_t{1} << 40)
+  : reserve_(reserve)
+  {
+    fd_ = open(filename, O_RDONLY);
+    assert(fd_ != -1);
+
+    void const* data
+      = mmap(nullptr, reserve_, PROT_READ, MAP_SHARED | MAP_NORESERVE, fd_, 0);
+    assert(data != MAP_FAILED);
+    data_ = reinterpret_cast<REC const*>(data);
+
+    state_ = open_tail_state(filename, false);
+    poll();
+  }
+
+  TailReader(TailReader const&) = delete;
+  TailReader(TailReader&&) = delete;
+
+  ~TailReader()
+  {
+    if (state_ != nullptr)
+      close_tail_state(state_);
+    int const rval = munmap((void*) data_, reserve_);
+    assert(rval == 0);
+    close(fd_);
+  }
+
+  size_t length() const { return length_; }
+
+  REC const& get(
+    size_t const pos)
+    const
+  {
+    assert(pos < length_);
+    return data_[pos];
+  }
+
+  Iterator begin() const { return {this, 0}; }
+  Iterator end() const { return {this, length_}; }
+
+  /*
+   * Updates and returns the visible length.
+   */
+  size_t
+  poll()
+  {
+    size_t length;
+    if (state_ != nullptr)
+      length = state_->length.load(std::memory_order_acquire);
+    else {
+      struct stat file_info;
+      int const rval = fstat(fd_, &file_info);
+      assert(rval == 0);
+      length = file_info.st_size / sizeof(REC);
+    }
+    assert(length >= length_);
+    assert(length * sizeof(REC) <= reserve_);
+    length_ = length;
+    return length_;
+  }
+
+  /*
+   * Waits until more records are visible, or until `timeout_usec` elapses.
+   * Spins briefly before blocking.  Returns true if there are more records.
+   */
+  bool
+  wait(
+    uint64_t const timeout_usec=1000000)
+  {
+    auto const length = length_;
+    if (state_ == nullptr) {
+      // No writer notification; poll.
+      struct timespec const interval{0, 50000};
+      for (uint64_t t = 0; t < timeout_usec; t += 50) {
+        if (poll() > length)
+          return true;
+        nanosleep(&interval, nullptr);
+      }
+      return poll() > length;
+    }
+
+    auto const seq = state_->seq.load(std::memory_order_acquire);
+    for (int i = 0; i < SPIN_COUNT; ++i) {
+      if (poll() > length)
+        return true;
+      __builtin_ia32_pause();
+    }
+
+    state_->waiters.fetch_add(1, std::memory_order_seq_cst);
+    if (poll() == length) {
+      struct timespec const timeout{
+        (time_t) (timeout_usec / 1000000),
+        (long) (timeout_usec % 1000000) * 1000};
+      // Returns immediately if seq has already changed.
+      syscall(
+        SYS_futex, &state_->seq, FUTEX_WAIT, seq, &timeout, nullptr, 0);
+    }
+    state_->waiters.fetch_sub(1, std::memory_order_seq_cst);
+    return poll() > length;
+  }
+
+  /*
+   * Invokes `fn(rec)` for each record that has become visible since the last
+   * delivery.  Returns the number delivered.
+   */
+  template<class FN>
+  size_t
+  deliver(
+    FN&& fn)
+  {
+    auto const start = next_;
+    for (poll(); next_ < length_; ++next_)
+      fn(data_[next_]);
+    return next_ - start;
+  }
+
+  /*
+   * Invokes `fn(rec)` for each record as it becomes visible, until `fn`
+   * returns false.
+   */
+  template<class FN>
+  void
+  follow(
+    FN&& fn)
+  {
+    for (;;) {
+      for (poll(); next_ < length_; ++next_)
+        if (!fn(data_[next_])) {
+          ++next_;
+          return;
+        }
+      wait();
+    }
+  }
+
+private:
+
+  static int constexpr SPIN_COUNT = 4096;
+
+  size_t const reserve_;
+  int fd_;
+  REC const* data_;
+  TailState* state_;
+
+  size_t length_ = 0;
+  // Next record to deliver.
+  size_t next_ = 0;
+
+};
+
+
@@ -0,0 +1,163 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+#include "async.hh"
+#include "dataset.hh"
+#include "rec.hh"
+#include "writer.hh"
+
+//------------------------------------------------------------------------------
+
+std::string const DIRNAME = "test_async.d";
+size_t const NUM_DAYS = 6;
+// Several scan blocks per partition.
+size_t const DAY_LENGTH = 3 * async::SCAN_BLOCK_SIZE / sizeof(Order) + 100;
+uint32_t const FIRST_DAY = 19000;
+
+void
+make_dataset()
+{
+  mkdir(DIRNAME.c_str(), 0755);
+  for (size_t d = 0; d < NUM_DAYS; ++d) {
+    auto const name
+      = DIRNAME + "/" + get_partition_filename(FIRST_DAY + d);
+    unlink(name.c_str());
+    RecordWriter<Order> writer(name.c_str());
+    for (size_t i = 0; i < DAY_LENGTH; ++i)
+      writer.append({(FIRST_DAY + d) * NS_PER_DAY + i, 1, 1, 1, 0});
+  }
+}
+
+
+void
+remove_dataset()
+{
+  for (size_t d = 0; d < NUM_DAYS; ++d)
+    unlink((DIRNAME + "/" + get_partition_filename(FIRST_DAY + d)).c_str());
+  rmdir(DIRNAME.c_str());
+}
+
+
+uint64_t
+count(
+  RecordBatch<Order> const& batch)
+{
+  return batch.length();
+}
+
+
+uint64_t
+add(
+  uint64_t const n0,
+  uint64_t const n1)
+{
+  return n0 + n1;
+}
+
+
+void
+test_scan(
+  async::Scheduler& scheduler,
+  async::IoPool& io)
+{
+  Dataset<Order> const dataset(DIRNAME);
+  for (size_t const max_open : {1, 2, 64})
+    assert(
+      async::scan(
+        dataset, 0, UINT64_MAX, scheduler, io, uint64_t{0}, count, add,
+        max_open)
+      == NUM_DAYS * DAY_LENGTH);
+  // Part of two days.
+  auto const start = (FIRST_DAY + 1) * NS_PER_DAY + 1000;
+  auto const end = (FIRST_DAY + 2) * NS_PER_DAY + 50;
+  assert(
+    async::scan(dataset, start, end, scheduler, io, uint64_t{0}, count, add)
+    == DAY_LENGTH - 1000 + 50);
+}
+
+
+/*
+ * An exception from `map` fails the scan, and releases the partition's file
+ * and open permit, so that scans waiting for it still run.
+ */
+void
+test_map_throws(
+  async::Scheduler& scheduler,
+  async::IoPool& io)
+{
+  Dataset<Order> const dataset(DIRNAME);
+  // The first record of the second block of the third day.
+  Timestamp const throw_at
+    = (FIRST_DAY + 2) * NS_PER_DAY + async::SCAN_BLOCK_SIZE / sizeof(Order);
+  auto const map = [throw_at](RecordBatch<Order> const& batch) {
+    // Thrown while the next block is being read.
+    if (batch.get(0).timestamp == throw_at)
+      throw std::logic_error("map");
+    return count(batch);
+  };
+  for (size_t const max_open : {1, 2}) {
+    bool failed = false;
+    try {
+      async::scan(
+        dataset, 0, UINT64_MAX, scheduler, io, uint64_t{0}, map, add,
+        max_open);
+    }
+    catch (std::logic_error const&) {
+      failed = true;
+    }
+    assert(failed);
+  }
+}
+
+
+/*
+ * A partition that can't be opened fails the scan.
+ */
+void
+test_missing(
+  async::Scheduler& scheduler,
+  async::IoPool& io)
+{
+  Dataset<Order> const dataset(DIRNAME);
+  auto const name = DIRNAME + "/" + get_partition_filename(FIRST_DAY + 3);
+  rename(name.c_str(), (name + ".tmp").c_str());
+  bool failed = false;
+  try {
+    async::scan(
+      dataset, 0, UINT64_MAX, scheduler, io, uint64_t{0}, count, add, 1);
+  }
+  catch (std::system_error const& error) {
+    assert(error.code().value() == ENOENT);
+    failed = true;
+  }
+  rename((name + ".tmp").c_str(), name.c_str());
+  assert(failed);
+}
+
+
+int
+main()
+{
+  make_dataset();
+  {
+    async::Scheduler scheduler(2);
+    async::IoPool io(2);
+    test_scan(scheduler, io);
+    test_map_throws(scheduler, io);
+    test_missing(scheduler, io);
+    // The scheduler and I/O pool still work after failed scans.
+    test_scan(scheduler, io);
+  }
+  remove_dataset();
+  return 0;
+}
+
+
@@ -0,0 +1,143 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+
+#include "checkpoint.hh"
+#include "rec.hh"
+#include "writer.hh"
+
+//------------------------------------------------------------------------------
+
+char const* const FILENAME = "test_checkpoint.rec";
+
+Order
+make_order(
+  uint64_t const seq,
+  Size const size=10)
+{
+  return {seq, Sid(seq % 7), size, 100, 0};
+}
+
+
+void
+append_orders(
+  uint64_t const start,
+  uint64_t const stop)
+{
+  RecordWriter<Order> writer(FILENAME);
+  for (auto seq = start; seq < stop; ++seq)
+    writer.append(make_order(seq));
+}
+
+
+/*
+ * Refreshes the saved checkpoint, and returns the number of records scanned.
+ */
+size_t
+refresh(
+  StatsCheckpoint& checkpoint)
+{
+  checkpoint = {};
+  load_checkpoint(FILENAME, checkpoint);
+  return refresh_order_stats(FILENAME, checkpoint);
+}
+
+
+uint64_t
+get_volume(
+  StatsCheckpoint const& checkpoint)
+{
+  uint64_t volume = 0;
+  for (auto const& s : checkpoint.stats)
+    volume += s.second.volume;
+  return volume;
+}
+
+
+/*
+ * Only records appended since the checkpoint are scanned.
+ */
+void
+test_append()
+{
+  StatsCheckpoint checkpoint;
+  append_orders(0, 5000);
+  assert(refresh(checkpoint) == 5000);
+  assert(refresh(checkpoint) == 0);
+  assert(checkpoint.length == 5000 && checkpoint.stats.size() == 7);
+
+  append_orders(5000, 6000);
+  assert(refresh(checkpoint) == 1000);
+  assert(checkpoint.length == 6000 && get_volume(checkpoint) == 60000);
+}
+
+
+/*
+ * Checkpointed records rewritten in place are scanned again.
+ */
+void
+test_rewrite()
+{
+  StatsCheckpoint checkpoint;
+  assert(refresh(checkpoint) == 0);
+
+  // Change the last checkpointed record, without changing the file's size.
+  int const fd = open(FILENAME, O_WRONLY);
+  assert(fd != -1);
+  auto const order = make_order(5999, 20);
+  auto const rval = pwrite(fd, &order, sizeof(order), 5999 * sizeof(order));
+  assert(rval == sizeof(order));
+  close(fd);
+
+  assert(refresh(checkpoint) == 6000);
+  assert(get_volume(checkpoint) == 60010);
+  assert(refresh(checkpoint) == 0);
+}
+
+
+/*
+ * A corrupt checkpoint isn't loaded.
+ */
+void
+test_corrupt()
+{
+  StatsCheckpoint checkpoint;
+  assert(load_checkpoint(FILENAME, checkpoint));
+
+  auto const filename = get_checkpoint_filename(FILENAME);
+  int const fd = open(filename.c_str(), O_WRONLY);
+  assert(fd != -1);
+  uint32_t const count = 12345;
+  auto const rval = pwrite(
+    fd, &count, sizeof(count),
+    sizeof(checkpoint::Header) + offsetof(checkpoint::Entry, stats));
+  assert(rval == sizeof(count));
+  close(fd);
+  assert(!load_checkpoint(FILENAME, checkpoint));
+
+  assert(refresh(checkpoint) == 6000);
+  assert(load_checkpoint(FILENAME, checkpoint));
+  // Missing.
+  remove(filename.c_str());
+  assert(!load_checkpoint(FILENAME, checkpoint));
+}
+
+
+int
+main()
+{
+  remove(FILENAME);
+  remove(get_checkpoint_filename(FILENAME).c_str());
+  test_append();
+  test_rewrite();
+  test_corrupt();
+  remove(FILENAME);
+  return 0;
+}
+
+
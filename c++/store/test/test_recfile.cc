@@ -0,0 +1,326 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <sys/resource.h>
+#include <system_error>
+#include <vector>
+
+#include "rec.hh"
+#include "recfile.hh"
+
+//------------------------------------------------------------------------------
+
+char const* const FILENAME = "test_recfile.rec";
+
+std::vector<char>
+read_file(
+  char const* const filename)
+{
+  std::ifstream file(filename, std::ios::binary);
+  return {std::istreambuf_iterator<char>(file), {}};
+}
+
+
+void
+write_file(
+  char const* const filename,
+  std::vector<char> const& data)
+{
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  file.write(data.data(), data.size());
+}
+
+
+/*
+ * Returns true if opening `data` as a record file throws.
+ */
+bool
+is_rejected(
+  std::vector<char> const& data)
+{
+  write_file(FILENAME, data);
+  try {
+    RecordFile file(FILENAME);
+    return false;
+  }
+  catch (std::runtime_error const&) {
+    return true;
+  }
+}
+
+
+/*
+ * Writes orders, and reads them back with the same schema.
+ */
+void
+test_round_trip()
+{
+  size_t const length = 10000;
+  {
+    // A small batch, so that records are written in several.
+    RecordFileWriter<Order> writer(FILENAME, get_schema<Order>(), 64);
+    for (size_t i = 0; i < length; ++i)
+      writer.append({i, Sid(i % 7), Size(i) - 5000, i * .5f, OrderType(i % 2)});
+  }
+
+  RecordFile const file(FILENAME);
+  assert(file.length() == length);
+  assert(file.record_size() == sizeof(Order));
+  auto const& schema = file.schema();
+  assert(schema.is_compatible(get_schema<Order>()));
+  assert(schema.fields[0].logical == LogicalType::TIMESTAMP);
+  assert(schema.sort_keys == std::vector<size_t>{0});
+
+  auto const orders = file.get_records<Order>();
+  assert(orders.length() == length);
+  for (size_t i = 0; i < length; ++i) {
+    auto const& order = orders.get(i);
+    assert(order.timestamp == i);
+    assert(order.instrument == i % 7);
+    assert(order.size == Size(i) - 5000);
+    assert(order.price == i * .5f);
+    assert(order.type == i % 2);
+  }
+
+  size_t i = 0;
+  for (auto const size : file.get_field<Size>("size"))
+    assert(size == Size(i++) - 5000);
+  assert(i == length);
+}
+
+
+/*
+ * Only committed records are counted.
+ */
+void
+test_commit()
+{
+  RecordFileWriter<Order> writer(FILENAME);
+  for (size_t i = 0; i < 100; ++i)
+    writer.append({i, 1, 1, 1, 0});
+  writer.flush();
+  assert(RecordFile(FILENAME).length() == 0);
+  writer.commit();
+  assert(RecordFile(FILENAME).length() == 100);
+}
+
+
+/*
+ * Rejects files with invalid headers.
+ */
+void
+test_reject()
+{
+  {
+    RecordFileWriter<Order> writer(FILENAME);
+    for (size_t i = 0; i < 100; ++i)
+      writer.append({i, 1, 1, 1, 0});
+  }
+  auto const good = read_file(FILENAME);
+  assert(check_header(good.data(), good.size()) == nullptr);
+  assert(!is_rejected(good));
+
+  auto const get_header = [](std::vector<char>& data) -> FileHeader& {
+    return *reinterpret_cast<FileHeader*>(data.data());
+  };
+  auto const get_field = [](std::vector<char>& data, size_t const i)
+    -> FieldHeader& {
+    return reinterpret_cast<FieldHeader*>(data.data() + sizeof(FileHeader))[i];
+  };
+
+  // Each corruption is rejected, by check_header() and on open.
+  auto const check = [&](char const* const error, auto const corrupt) {
+    auto data = good;
+    corrupt(data);
+    auto const e = check_header(data.data(), data.size());
+    assert(e != nullptr && strcmp(e, error) == 0);
+    assert(is_rejected(data));
+  };
+  check("file too short for header", [](auto& data) { data.clear(); });
+  check("file too short for header", [](auto& data) { data.resize(40); });
+  check("not a record file", [&](auto& data) {
+    get_header(data).magic[0] = 'X';
+  });
+  check("wrong byte order", [&](auto& data) {
+    get_header(data).byte_order = 0x04030201;
+  });
+  check("unsupported version", [&](auto& data) {
+    get_header(data).version = RECFILE_VERSION + 1;
+  });
+  check("bad header size", [&](auto& data) {
+    get_header(data).header_size = 100;
+  });
+  check("bad header size", [&](auto& data) {
+    data.resize(get_header(data).header_size - 1);
+  });
+  check("empty schema", [&](auto& data) { get_header(data).num_fields = 0; });
+  check("file too short for length", [&](auto& data) {
+    data.resize(data.size() - 1);
+  });
+  check("unterminated field name", [&](auto& data) {
+    memset(get_field(data, 1).name, 'x', sizeof(FieldHeader::name));
+  });
+  check("bad field width", [&](auto& data) { get_field(data, 1).width = 3; });
+  check("field outside record", [&](auto& data) {
+    get_field(data, 4).offset = 22;
+  });
+  check("bad float width", [&](auto& data) { get_field(data, 3).width = 2; });
+  check("bad timestamp width", [&](auto& data) {
+    get_field(data, 0).width = 4;
+  });
+  check("bad logical type", [&](auto& data) {
+    get_field(data, 1).logical = LogicalType(99);
+  });
+  check("bad sort key", [&](auto& data) {
+    auto const sort_keys = reinterpret_cast<uint32_t*>(&get_field(data, 5));
+    sort_keys[0] = 5;
+  });
+}
+
+
+/*
+ * Returns true if `fn()` throws `std::runtime_error`.
+ */
+template<class FN>
+bool
+throws(
+  FN&& fn)
+{
+  try {
+    fn();
+    return false;
+  }
+  catch (std::runtime_error const&) {
+    return true;
+  }
+}
+
+
+/*
+ * Fields and records are accessible only as compatible types.
+ */
+void
+test_access()
+{
+  {
+    RecordFileWriter<Order> writer(FILENAME);
+    for (size_t i = 0; i < 100; ++i)
+      writer.append({i, 1, Size(i), 1, 0});
+  }
+  RecordFile const file(FILENAME);
+
+  auto const sizes = file.get_field<Size>("size");
+  assert(sizes.length() == 100 && sizes.stride() == sizeof(Order));
+  assert(sum(sizes) == 4950);
+  // A timestamp is accessible as a uint64_t.
+  assert(file.get_field<uint64_t>("timestamp").length() == 100);
+
+  assert(throws([&] { file.get_field<Size>("volume"); }));
+  assert(throws([&] { file.get_field<int64_t>("size"); }));
+  assert(throws([&] { file.get_field<uint32_t>("price"); }));
+  assert(throws([&] { file.get_records<Trade>(); }));
+  assert(file.get_records<Order>().length() == 100);
+
+  // A file that can't be opened.
+  bool failed = false;
+  try {
+    RecordFile("test_recfile.missing");
+  }
+  catch (std::system_error const& error) {
+    assert(error.code().value() == ENOENT);
+    failed = true;
+  }
+  assert(failed);
+}
+
+
+/*
+ * Limits the size of files this process writes.  Past the limit, write()
+ * is short, then fails with EFBIG.
+ */
+void
+set_file_limit(
+  rlim_t const size)
+{
+  struct rlimit limit;
+  int rval = getrlimit(RLIMIT_FSIZE, &limit);
+  assert(rval == 0);
+  limit.rlim_cur = size;
+  rval = setrlimit(RLIMIT_FSIZE, &limit);
+  assert(rval == 0);
+}
+
+
+/*
+ * A batch whose write fails partway is written again in place on retry.
+ */
+void
+test_write_error()
+{
+  struct rlimit limit;
+  getrlimit(RLIMIT_FSIZE, &limit);
+  auto const schema = get_schema<Order>();
+  auto const header_size
+    = get_header_size(schema.fields.size(), schema.sort_keys.size());
+
+  size_t i = 0;
+  {
+    RecordFileWriter<Order> writer(FILENAME, schema, 100);
+    // The limit falls inside the third batch, and inside a record.
+    set_file_limit(header_size + 250 * sizeof(Order) + 3);
+    bool failed = false;
+    try {
+      for (; i < 300; ++i)
+        writer.append({i, 1, 1, 1, 0});
+    }
+    catch (std::system_error const& error) {
+      assert(error.code().value() == EFBIG);
+      failed = true;
+    }
+    // The record that filled the batch was kept.
+    assert(failed && i == 299 && writer.length() == 300);
+    ++i;
+
+    set_file_limit(limit.rlim_cur);
+    for (; i < 350; ++i)
+      writer.append({i, 1, 1, 1, 0});
+    writer.commit();
+
+    // The destructor swallows errors, and the header counts only records
+    // committed.
+    set_file_limit(header_size + 400 * sizeof(Order));
+    for (; i < 420; ++i)
+      writer.append({i, 1, 1, 1, 0});
+  }
+  set_file_limit(limit.rlim_cur);
+
+  RecordFile const file(FILENAME);
+  auto const orders = file.get_records<Order>();
+  assert(orders.length() == 350);
+  for (size_t i = 0; i < orders.length(); ++i)
+    assert(orders.get(i).timestamp == i);
+}
+
+
+int
+main()
+{
+  // Fail writes past the file size limit with EFBIG, instead of a signal.
+  signal(SIGXFSZ, SIG_IGN);
+  test_round_trip();
+  test_commit();
+  test_reject();
+  test_access();
+  test_write_error();
+  remove(FILENAME);
+  return 0;
+}
+
+
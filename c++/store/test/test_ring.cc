@@ -0,0 +1,167 @@
+#undef NDEBUG
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "buffer.hh"
+#include "rec.hh"
+#include "ring.hh"
+
+//------------------------------------------------------------------------------
+
+using Ring = RecordRing<Order>;
+
+Order
+make_order(
+  uint64_t const seq)
+{
+  return {seq, Sid(seq % 5000), 100, 10, 0};
+}
+
+
+/*
+ * The producer stops when the slowest consumer is a full ring behind.
+ */
+void
+test_full()
+{
+  size_t const capacity = 8;
+  MallocBuffer buffer(Ring::get_size(capacity));
+  Ring ring(buffer, capacity, true);
+
+  // With no consumers, the producer never blocks.
+  for (uint64_t i = 0; i < 3 * capacity; ++i)
+    assert(ring.try_push(make_order(i)));
+
+  auto const c0 = ring.attach();
+  auto const c1 = ring.attach();
+  assert(c0 != -1 && c1 != -1 && c0 != c1);
+  assert(ring.peek(c0).length() == 0);
+
+  uint64_t seq = 3 * capacity;
+  for (size_t i = 0; i < capacity; ++i)
+    assert(ring.try_push(make_order(seq++)));
+  assert(!ring.try_push(make_order(seq)));
+
+  // The slowest consumer holds the producer back.
+  auto batch = ring.peek(c0, 3);
+  assert(batch.length() == 3);
+  for (size_t i = 0; i < 3; ++i)
+    assert(batch.get(i).timestamp == 3 * capacity + i);
+  ring.consume(c0, 3);
+  assert(!ring.try_push(make_order(seq)));
+
+  ring.consume(c1, 2);
+  Order const orders[] = {make_order(seq), make_order(seq + 1), make_order(0)};
+  assert(ring.try_push(orders, 3) == 2);
+  seq += 2;
+  assert(!ring.try_push(make_order(seq)));
+
+  // Each consumer sees every record, in order, from where it attached.
+  for (auto const id : {c0, c1}) {
+    uint64_t next = 3 * capacity + (id == c0 ? 3 : 2);
+    while (true) {
+      auto const batch = ring.peek(id);
+      if (batch.length() == 0)
+        break;
+      for (auto const& order : batch)
+        assert(order.timestamp == next++);
+      ring.consume(id, batch.length());
+    }
+    assert(next == seq);
+  }
+
+  // A detached consumer doesn't hold the producer back.
+  for (size_t i = 0; i < capacity; ++i)
+    assert(ring.try_push(make_order(seq++)));
+  ring.detach(c1);
+  assert(!ring.try_push(make_order(seq)));
+  ring.consume(c0, ring.peek(c0).length());
+  assert(ring.try_push(make_order(seq++)));
+
+  // A consumer reattaching to the slot starts at the head.
+  assert(ring.attach() == c1);
+  assert(ring.peek(c1).length() == 0);
+  ring.detach(c0);
+  ring.detach(c1);
+}
+
+
+/*
+ * Consumers never see overwritten records, including consumers that attach
+ * while the producer runs.
+ */
+void
+test_concurrent()
+{
+  size_t const capacity = 256;
+  uint64_t const count = 1000000;
+  MallocBuffer buffer(Ring::get_size(capacity));
+  Ring producer(buffer, capacity, true);
+
+  std::atomic<size_t> num_attached{0};
+  std::atomic<bool> done{false};
+
+  auto const consume = [&](bool const early) {
+    Ring ring(buffer, capacity, false);
+    auto const id = ring.attach();
+    assert(id != -1);
+    ++num_attached;
+    // A late consumer starts wherever the producer is.
+    uint64_t next = early ? 0 : UINT64_MAX;
+    while (next != count) {
+      bool const finished = done;
+      auto const batch = ring.peek(id);
+      if (batch.length() == 0) {
+        if (finished)
+          break;
+        // Don't spin, in case there are fewer cores than threads.
+        std::this_thread::yield();
+      }
+      for (auto const& order : batch) {
+        if (next == UINT64_MAX)
+          next = order.timestamp;
+        assert(order.timestamp == next);
+        assert(order.instrument == next % 5000);
+        ++next;
+      }
+      ring.consume(id, batch.length());
+    }
+    assert(!early || next == count);
+    ring.detach(id);
+  };
+
+  // Two consumers attach before the producer starts, and more while it runs.
+  std::vector<std::thread> consumers;
+  consumers.emplace_back(consume, true);
+  consumers.emplace_back(consume, true);
+  while (num_attached < 2)
+    std::this_thread::yield();
+  std::thread late([&] {
+    for (size_t i = 0; i < 8; ++i)
+      std::thread(consume, false).join();
+  });
+
+  for (uint64_t i = 0; i < count; ++i)
+    while (!producer.try_push(make_order(i)))
+      std::this_thread::yield();
+  done = true;
+  late.join();
+  for (auto& consumer : consumers)
+    consumer.join();
+}
+
+
+int
+main()
+{
+  test_full();
+  test_concurrent();
+  return 0;
+}
+
+
@@ -0,0 +1,496 @@
+#undef NDEBUG
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "hash.hh"
+#include "reader.hh"
+#include "rec.hh"
+#include "sidecar.hh"
+#include "sketch.hh"
+#include "writer.hh"
+
+//------------------------------------------------------------------------------
+// TopK
+
+/*
+ * A value with an id, compared by value only, to tell equal values apart.
+ */
+struct Item
+{
+  int val;
+  size_t id;
+
+  bool
+  operator==(
+    Item const& other)
+    const
+  {
+    return val == other.val && id == other.id;
+  }
+};
+
+struct ByVal
+{
+  bool
+  operator()(
+    Item const& i0,
+    Item const& i1)
+    const
+  {
+    return i0.val < i1.val;
+  }
+};
+
+using TopItems = TopK<Item, 8, ByVal>;
+
+
+/*
+ * Returns the top `k` of `items` directly: greatest first, then first added.
+ */
+std::vector<Item>
+get_top(
+  std::vector<Item> items,
+  size_t const k)
+{
+  std::stable_sort(
+    items.begin(), items.end(),
+    [](Item const& i0, Item const& i1) { return i0.val > i1.val; });
+  items.resize(std::min(k, items.size()));
+  return items;
+}
+
+
+/*
+ * Random items, with many equal values.
+ */
+std::vector<Item>
+make_items(
+  size_t const length,
+  int const max_val)
+{
+  std::mt19937 rng(42);
+  std::vector<Item> items;
+  for (size_t i = 0; i < length; ++i)
+    items.push_back({int(rng() % max_val), i});
+  return items;
+}
+
+
+void
+test_top_k()
+{
+  // Fewer values than K.
+  TopItems top;
+  assert(top.size() == 0 && top.get().empty());
+  for (auto const& item : make_items(5, 3))
+    top.add(item);
+  assert(top.size() == 5);
+  assert(top.get() == get_top(make_items(5, 3), 8));
+
+  for (int const max_val : {2, 10, 1000000}) {
+    auto const items = make_items(10000, max_val);
+    TopItems top;
+    for (auto const& item : items)
+      top.add(item);
+    assert(top.get() == get_top(items, 8));
+  }
+}
+
+
+/*
+ * Merging summaries of consecutive chunks keeps the same values, ties
+ * included, as adding them all to one.
+ */
+void
+test_top_k_merge()
+{
+  std::mt19937 rng(7);
+  for (int const max_val : {2, 10, 1000000}) {
+    auto const items = make_items(10000, max_val);
+    TopItems top;
+    for (size_t start = 0; start < items.size(); ) {
+      auto const stop = std::min<size_t>(start + rng() % 500, items.size());
+      TopItems chunk;
+      for (size_t i = start; i < stop; ++i)
+        chunk.add(items[i]);
+      top.merge(chunk);
+      start = stop;
+    }
+    assert(top.get() == get_top(items, 8));
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// QuantileSketch
+
+/*
+ * Returns the fraction of `sorted` values no greater than `val`.
+ */
+double
+get_rank(
+  std::vector<double> const& sorted,
+  double const val)
+{
+  return double(std::upper_bound(sorted.begin(), sorted.end(), val)
+                - sorted.begin()) / sorted.size();
+}
+
+
+/*
+ * Checks that quantiles of `sketch` are within `error` in rank of `sorted`.
+ */
+void
+check_quantiles(
+  QuantileSketch<double> const& sketch,
+  std::vector<double> const& sorted,
+  double const error)
+{
+  assert(sketch.count() == sorted.size());
+  for (double q = 0.01; q < 1; q += 0.01)
+    assert(std::abs(get_rank(sorted, sketch.get_quantile(q)) - q) <= error);
+  assert(sketch.get_quantile(0) >= sorted.front());
+  assert(sketch.get_quantile(1) <= sorted.back());
+}
+
+
+std::vector<double>
+make_values(
+  size_t const length)
+{
+  std::mt19937 rng(42);
+  std::lognormal_distribution<double> dist(0, 1);
+  std::vector<double> vals;
+  for (size_t i = 0; i < length; ++i)
+    vals.push_back(dist(rng));
+  return vals;
+}
+
+
+/*
+ * Until a sketch compacts, its quantiles are exact.
+ */
+void
+test_quantile_exact()
+{
+  QuantileSketch<double> sketch;
+  for (int i = 100; i > 0; --i)
+    sketch.add(i);
+  assert(sketch.count() == 100 && sketch.size() == 100);
+  assert(sketch.get_quantile(0) == 1);
+  assert(sketch.get_quantile(0.25) == 25);
+  assert(sketch.get_quantile(0.5) == 50);
+  assert(sketch.get_quantile(0.999) == 100);
+  assert(sketch.get_quantile(1) == 100);
+}
+
+
+void
+test_quantile_error()
+{
+  auto const vals = make_values(1000000);
+  auto sorted = vals;
+  std::sort(sorted.begin(), sorted.end());
+
+  QuantileSketch<double> sketch;
+  for (auto const val : vals)
+    sketch.add(val);
+  // The sketch stays small.
+  assert(sketch.size() < 4 * QUANTILE_K);
+  // Rank error is about 1.7/k with high probability.
+  check_quantiles(sketch, sorted, 2.5 / QUANTILE_K);
+
+  // A larger k is more accurate.
+  QuantileSketch<double> large(1024);
+  for (auto const val : vals)
+    large.add(val);
+  check_quantiles(large, sorted, 2.5 / 1024);
+}
+
+
+/*
+ * A sketch merged from sketches of chunks has the same accuracy as one of all
+ * the values, and is the same each time it is built the same way.
+ */
+void
+test_quantile_merge()
+{
+  auto const vals = make_values(1000000);
+  auto sorted = vals;
+  std::sort(sorted.begin(), sorted.end());
+
+  auto const build = [&](size_t const chunk_length) {
+    QuantileSketch<double> sketch;
+    for (size_t start = 0; start < vals.size(); start += chunk_length) {
+      QuantileSketch<double> chunk;
+      auto const stop = std::min(start + chunk_length, vals.size());
+      for (size_t i = start; i < stop; ++i)
+        chunk.add(vals[i]);
+      sketch.merge(chunk);
+    }
+    return sketch;
+  };
+
+  for (size_t const chunk_length : {1000, 65536, 1000000}) {
+    auto const sketch = build(chunk_length);
+    assert(sketch.size() < 4 * QUANTILE_K);
+    check_quantiles(sketch, sorted, 2.5 / QUANTILE_K);
+
+    auto const again = build(chunk_length);
+    for (double q = 0; q <= 1; q += 0.01)
+      assert(again.get_quantile(q) == sketch.get_quantile(q));
+  }
+
+  // Merging an empty sketch changes nothing.
+  auto sketch = build(65536);
+  auto const median = sketch.get_quantile(0.5);
+  sketch.merge(QuantileSketch<double>());
+  assert(sketch.count() == vals.size());
+  assert(sketch.get_quantile(0.5) == median);
+}
+
+
+//------------------------------------------------------------------------------
+// HyperLogLog
+
+/*
+ * Returns a sketch of values [start, stop), each added `times` times.
+ */
+template<unsigned P>
+HyperLogLog<P>
+make_hll(
+  uint64_t const start,
+  uint64_t const stop,
+  size_t const times=1)
+{
+  HyperLogLog<P> hll;
+  for (size_t t = 0; t < times; ++t)
+    for (uint64_t i = start; i < stop; ++i)
+      hll.add_hash(mix_hash(i));
+  return hll;
+}
+
+
+/*
+ * Counts are within three standard errors, small counts included.
+ */
+template<unsigned P>
+void
+check_hll_error()
+{
+  double const error = 3 * 1.04 / std::sqrt(double(size_t{1} << P));
+  assert(make_hll<P>(0, 0).get_count() == 0);
+  for (uint64_t const n : {1, 10, 100, 1000, 10000, 100000, 1000000}) {
+    // Different values for each n.
+    auto const count = make_hll<P>(n, 2 * n).get_count();
+    assert(std::abs(count - n) <= error * n);
+  }
+}
+
+
+void
+test_hll_error()
+{
+  check_hll_error<6>();
+  check_hll_error<12>();
+  check_hll_error<16>();
+}
+
+
+/*
+ * Merging sketches gives the count of the union of their values, and adding
+ * a value again changes nothing.
+ */
+void
+test_hll_merge()
+{
+  using Hll = HyperLogLog<12>;
+  auto const all = make_hll<12>(0, 1000000).get_count();
+
+  Hll chunks;
+  for (uint64_t start = 0; start < 1000000; start += 70000) {
+    auto const stop = std::min<uint64_t>(start + 70000, 1000000);
+    chunks.merge(make_hll<12>(start, stop));
+  }
+  assert(chunks.get_count() == all);
+
+  // Overlapping parts.
+  auto overlap = make_hll<12>(0, 600000);
+  overlap.merge(make_hll<12>(400000, 1000000));
+  assert(overlap.get_count() == all);
+  overlap.merge(make_hll<12>(0, 1000000));
+  assert(overlap.get_count() == all);
+
+  assert(make_hll<12>(0, 1000000, 3).get_count() == all);
+  Hll empty;
+  empty.merge(Hll());
+  assert(empty.get_count() == 0);
+}
+
+
+//------------------------------------------------------------------------------
+// BloomFilter
+
+/*
+ * Returns the fraction of values not added to `filter` that it may contain.
+ */
+template<class FILTER>
+double
+get_false_positive_rate(
+  FILTER const& filter,
+  uint64_t const start,
+  uint64_t const stop)
+{
+  size_t positives = 0;
+  for (uint64_t i = start; i < stop; ++i)
+    positives += filter.may_contain(mix_hash(i));
+  return double(positives) / (stop - start);
+}
+
+
+/*
+ * A filter contains every value added, and others at about the expected
+ * false positive rate.
+ */
+template<size_t BITS, unsigned HASHES>
+void
+check_bloom(
+  uint64_t const n)
+{
+  BloomFilter<BITS, HASHES> filter;
+  for (uint64_t i = 0; i < n; ++i)
+    filter.add_hash(mix_hash(i));
+  for (uint64_t i = 0; i < n; ++i)
+    assert(filter.may_contain(mix_hash(i)));
+
+  double const expected
+    = std::pow(1 - std::exp(-double(HASHES) * n / BITS), HASHES);
+  auto const rate = get_false_positive_rate(filter, n, n + 1000000);
+  assert(expected / 2 <= rate && rate <= expected * 2);
+}
+
+
+void
+test_bloom()
+{
+  BloomFilter<4096, 3> empty;
+  assert(!empty.may_contain(mix_hash(0)));
+  assert(get_false_positive_rate(empty, 0, 100000) == 0);
+
+  check_bloom<4096, 3>(1000);
+  check_bloom<64 * 1024, 6>(5000);
+  check_bloom<64 * 1024, 6>(20000);
+}
+
+
+/*
+ * A filter merged from filters of chunks contains every value in them, and is
+ * the same as a filter of all the values.
+ */
+void
+test_bloom_merge()
+{
+  using Filter = BloomFilter<64 * 1024, 6>;
+  Filter all;
+  for (uint64_t i = 0; i < 10000; ++i)
+    all.add_hash(mix_hash(i));
+
+  Filter merged;
+  for (uint64_t start = 0; start < 10000; start += 700) {
+    Filter chunk;
+    for (uint64_t i = start; i < std::min<uint64_t>(start + 700, 10000); ++i)
+      chunk.add_hash(mix_hash(i));
+    merged.merge(chunk);
+  }
+  for (uint64_t i = 0; i < 10000; ++i)
+    assert(merged.may_contain(mix_hash(i)));
+  for (uint64_t i = 10000; i < 1000000; ++i)
+    assert(merged.may_contain(mix_hash(i)) == all.may_contain(mix_hash(i)));
+}
+
+
+//------------------------------------------------------------------------------
+// Sidecar files
+
+std::string const FILENAME = "test_sketch.rec";
+
+/*
+ * Writes a record file, and returns its sketch.
+ */
+FileSketch
+make_file()
+{
+  remove(FILENAME.c_str());
+  {
+    RecordWriter<Order> writer(FILENAME.c_str());
+    for (uint64_t i = 0; i < 3 * SKETCH_BLOCK_LENGTH / 2; ++i)
+      writer.append({i, Sid(i % 1000), 1, 1, 0});
+  }
+  MmapReader<Order> const reader(FILENAME.c_str());
+  return build_sketch(reader, get_file_version(FILENAME.c_str()));
+}
+
+
+void
+test_sidecar()
+{
+  auto const sketch_filename = get_sketch_filename(FILENAME);
+  auto const sketch = make_file();
+  FileSketch loaded;
+  remove(sketch_filename.c_str());
+  assert(!load_sketch<Order>(FILENAME, loaded));
+
+  save_sketch<Order>(FILENAME, sketch);
+  assert(load_sketch<Order>(FILENAME, loaded));
+  assert(loaded.length == sketch.length);
+  assert(loaded.blocks.size() == 2);
+  assert(loaded.sids.get_count() == sketch.sids.get_count());
+  assert(loaded.may_contain(999) && !loaded.may_contain(1000));
+
+  // Corrupt a block's filter.
+  int const fd = open(sketch_filename.c_str(), O_WRONLY);
+  assert(fd != -1);
+  uint64_t const bits = ~uint64_t{0};
+  auto const rval = pwrite(
+    fd, &bits, sizeof(bits),
+    sizeof(sidecar::Header) + sizeof(SidCounter) + sizeof(BlockSketch)
+    + offsetof(BlockSketch, filter));
+  assert(rval == sizeof(bits));
+  close(fd);
+  assert(!load_sketch<Order>(FILENAME, loaded));
+
+  // Can't be opened.
+  assert(!load_sketch<Order>(FILENAME + "/x", loaded));
+
+  remove(sketch_filename.c_str());
+  remove(FILENAME.c_str());
+}
+
+
+int
+main()
+{
+  test_top_k();
+  test_top_k_merge();
+  test_quantile_exact();
+  test_quantile_error();
+  test_quantile_merge();
+  test_hll_error();
+  test_hll_merge();
+  test_bloom();
+  test_bloom_merge();
+  test_sidecar();
+  return 0;
+}
+
+
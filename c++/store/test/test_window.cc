@@ -0,0 +1,158 @@
+#undef NDEBUG
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "rec.hh"
+#include "window.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * Returns stats of `orders` in [start, stop) computed directly.
+ */
+WindowStats
+get_stats(
+  std::vector<Order> const& orders,
+  size_t const start,
+  size_t const stop)
+{
+  WindowStats stats = {};
+  for (size_t i = start; i < stop; ++i) {
+    auto const& order = orders[i];
+    auto const volume = std::abs(order.size);
+    if (stats.count == 0 || order.price < stats.min_price)
+      stats.min_price = order.price;
+    if (stats.count == 0 || order.price > stats.max_price)
+      stats.max_price = order.price;
+    ++stats.count;
+    stats.net_size += order.size;
+    stats.volume += volume;
+    stats.notional += (double) volume * order.price;
+  }
+  return stats;
+}
+
+
+void
+check_equal(
+  WindowStats const& s0,
+  WindowStats const& s1)
+{
+  // Prices and sizes are small and exact, so the notional sums are too.
+  assert(s0.count == s1.count);
+  assert(s0.net_size == s1.net_size);
+  assert(s0.volume == s1.volume);
+  assert(s0.notional == s1.notional);
+  assert(s0.min_price == s1.min_price);
+  assert(s0.max_price == s1.max_price);
+}
+
+
+/*
+ * Random orders, with runs of equal timestamps and prices.
+ */
+std::vector<Order>
+make_orders(
+  size_t const length)
+{
+  std::mt19937 rng(42);
+  std::vector<Order> orders;
+  Timestamp timestamp = 1000;
+  for (size_t i = 0; i < length; ++i) {
+    timestamp += rng() % 4 == 0 ? 0 : rng() % 20;
+    Size const size = rng() % 1000 + 1;
+    orders.push_back({
+      timestamp, 1, rng() % 2 == 0 ? size : -size, (rng() % 8) * .25f, 0});
+  }
+  return orders;
+}
+
+
+/*
+ * Compares each push with stats computed directly over the window.
+ */
+void
+test_time_window()
+{
+  auto const orders = make_orders(10000);
+  for (Timestamp const duration : {1, 2, 19, 50, 1000, 1000000}) {
+    RollingWindow<TimeWindow> window(TimeWindow{duration});
+    size_t start = 0;
+    for (size_t i = 0; i < orders.size(); ++i) {
+      auto const& stats = window.push(orders[i]);
+      // The window is (latest - duration, latest].
+      while (orders[start].timestamp + duration <= orders[i].timestamp)
+        ++start;
+      check_equal(stats, get_stats(orders, start, i + 1));
+      assert(stats.count > 0);
+    }
+  }
+}
+
+
+void
+test_count_window()
+{
+  auto const orders = make_orders(10000);
+  for (size_t const length : {1, 2, 3, 64, 20000}) {
+    RollingWindow<CountWindow> window(CountWindow{length});
+    for (size_t i = 0; i < orders.size(); ++i) {
+      auto const& stats = window.push(orders[i]);
+      auto const start = i + 1 > length ? i + 1 - length : 0;
+      check_equal(stats, get_stats(orders, start, i + 1));
+    }
+  }
+}
+
+
+/*
+ * A zero window is always empty.
+ */
+void
+test_zero_window()
+{
+  auto const orders = make_orders(100);
+  RollingWindow<TimeWindow> time_window(TimeWindow{0});
+  RollingWindow<CountWindow> count_window(CountWindow{0});
+  WindowStats const empty = {};
+  for (auto const& order : orders) {
+    check_equal(time_window.push(order), empty);
+    check_equal(count_window.push(order), empty);
+  }
+}
+
+
+/*
+ * Min and max fall back to earlier prices as the extremes are evicted.
+ */
+void
+test_min_max()
+{
+  RollingWindow<CountWindow> window(CountWindow{3});
+  float const prices[] = {5, 1, 9, 4, 4, 3, 7, 7};
+  float const mins[] = {5, 1, 1, 1, 4, 3, 3, 3};
+  float const maxs[] = {5, 5, 9, 9, 9, 4, 7, 7};
+  for (size_t i = 0; i < 8; ++i) {
+    auto const& stats = window.push({i, 1, 1, prices[i], 0});
+    assert(stats.min_price == mins[i]);
+    assert(stats.max_price == maxs[i]);
+  }
+}
+
+
+int
+main()
+{
+  test_time_window();
+  test_count_window();
+  test_zero_window();
+  test_min_max();
+  return 0;
+}
+
+
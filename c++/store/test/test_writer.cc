@@ -0,0 +1,135 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <system_error>
+
+#include "reader.hh"
+#include "rec.hh"
+#include "writer.hh"
+
+//------------------------------------------------------------------------------
+
+char const* const FILENAME = "test_writer.rec";
+
+Order
+make_order(
+  uint64_t const seq)
+{
+  return {seq, Sid(seq % 7), 100, 10, 0};
+}
+
+
+/*
+ * Limits the size of files this process writes.  Past the limit, write()
+ * is short, then fails with EFBIG.
+ */
+void
+set_file_limit(
+  rlim_t const size)
+{
+  struct rlimit limit;
+  int rval = getrlimit(RLIMIT_FSIZE, &limit);
+  assert(rval == 0);
+  limit.rlim_cur = size;
+  rval = setrlimit(RLIMIT_FSIZE, &limit);
+  assert(rval == 0);
+}
+
+
+void
+check_file(
+  uint64_t const length)
+{
+  struct stat info;
+  int const rval = stat(FILENAME, &info);
+  assert(rval == 0);
+  assert((uint64_t) info.st_size == length * sizeof(Order));
+
+  MmapReader<Order> const reader(FILENAME);
+  assert(reader.length() == length);
+  for (uint64_t i = 0; i < length; ++i)
+    assert(reader.get(i).timestamp == i);
+}
+
+
+/*
+ * A batch whose write fails partway is finished, not repeated, on retry.
+ */
+void
+test_write_error(
+  size_t const grow_size)
+{
+  remove(FILENAME);
+  struct rlimit limit;
+  getrlimit(RLIMIT_FSIZE, &limit);
+
+  WriterOptions options;
+  options.batch_length = 100;
+  options.grow_size = grow_size;
+  uint64_t seq = 0;
+  {
+    RecordWriter<Order> writer(FILENAME, options);
+    // The limit falls inside the third batch, and inside a record.
+    set_file_limit(250 * sizeof(Order) + 3);
+    for (; seq < 200; ++seq)
+      writer.append(make_order(seq));
+    bool failed = false;
+    try {
+      for (; seq < 300; ++seq)
+        writer.append(make_order(seq));
+    }
+    catch (std::system_error const& error) {
+      assert(error.code().value() == EFBIG);
+      failed = true;
+    }
+    assert(failed);
+    // The record that filled the batch was kept.
+    assert(seq == 299 && writer.length() == 300);
+    ++seq;
+    // Still failing: a full batch is retried before adding to it.
+    failed = false;
+    try {
+      writer.append(make_order(seq));
+    }
+    catch (std::system_error const&) {
+      failed = true;
+    }
+    assert(failed && writer.length() == 300);
+
+    set_file_limit(limit.rlim_cur);
+    for (; seq < 350; ++seq)
+      writer.append(make_order(seq));
+    writer.commit();
+    assert(writer.synced_length() == 350);
+  }
+  check_file(350);
+
+  // The destructor swallows errors, and leaves the file on a record.
+  {
+    RecordWriter<Order> writer(FILENAME, options);
+    set_file_limit(400 * sizeof(Order) + 3);
+    for (; seq < 420; ++seq)
+      writer.append(make_order(seq));
+  }
+  set_file_limit(limit.rlim_cur);
+  check_file(350);
+}
+
+
+int
+main()
+{
+  // Fail writes past the file size limit with EFBIG, instead of a signal.
+  signal(SIGXFSZ, SIG_IGN);
+  test_write_error(0);
+  test_write_error(1024 * 1024);
+  remove(FILENAME);
+  return 0;
+}
+
+
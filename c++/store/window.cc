@@ -0,0 +1,47 @@
+#include <iostream>
+#include <map>
+
+#include "reader.hh"
+#include "rec.hh"
+#include "timer.hh"
+#include "window.hh"
+
+//------------------------------------------------------------------------------
+
+int
+main(
+  int const argc,
+  char const* const* const argv)
+{
+  if (argc != 2 && argc != 3) {
+    std::cerr << "usage: " << argv[0] << " FILENAME [SECONDS]\n";
+    return 2;
+  }
+  Timestamp const duration = (argc == 3 ? atof(argv[2]) : 300) * 1E+9;
+
+  MmapReader<Order> reader(argv[1]);
+
+  auto const start = now();
+  // Track the widest price range seen in any window.
+  float max_range = 0;
+  auto const windows = get_rolling_order_stats(
+    reader, TimeWindow{duration},
+    [&max_range](Order const&, WindowStats const& stats) {
+      max_range = std::max(max_range, stats.max_price - stats.min_price);
+    });
+  auto const elapsed = now() - start;
+
+  // Print the final window for each instrument, in order.
+  std::map<Sid, WindowStats> final;
+  for (auto const& w : windows)
+    final.emplace(w.first, w.second.stats());
+  for (auto const& f : final)
+    std::cout << f.first << ": " << f.second << "\n";
+  std::cout << "max range = " << max_range << "\n";
+
+  std::cerr << "elapsed: " << elapsed << " = "
+            << elapsed / reader.length() / 1E-6 << " µs/rec\n";
+
+  return 0;
+}
+
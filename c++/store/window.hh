@@ -0,0 +1,202 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <unordered_map>
+
+#include "rec.hh"
+
+//------------------------------------------------------------------------------
+
+/*
+ * Window containing records within `duration` ns of the latest, i.e. with
+ * timestamps in (latest - duration, latest].
+ */
+struct TimeWindow
+{
+  Timestamp duration;
+
+  template<class ENTRY>
+  bool
+  expired(
+    ENTRY const& oldest,
+    ENTRY const& latest,
+    size_t const /* count */)
+    const
+  {
+    return oldest.timestamp + duration <= latest.timestamp;
+  }
+};
+
+
+/*
+ * Window containing the latest `length` records.
+ */
+struct CountWindow
+{
+  size_t length;
+
+  template<class ENTRY>
+  bool
+  expired(
+    ENTRY const& /* oldest */,
+    ENTRY const& /* latest */,
+    size_t const count)
+    const
+  {
+    return count > length;
+  }
+};
+
+
+//------------------------------------------------------------------------------
+
+struct WindowStats
+{
+  uint32_t count;
+  Size net_size;
+  Size volume;
+  double notional;
+  Price min_price;
+  Price max_price;
+
+  double vwap() const { return volume == 0 ? 0 : notional / volume; }
+};
+
+
+inline std::ostream&
+operator<<(
+  std::ostream& os,
+  WindowStats const& stats)
+{
+  os << stats.count
+     << " volume=" << stats.volume
+     << " net=" << stats.net_size
+     << " vwap=" << stats.vwap()
+     << " min=" << stats.min_price
+     << " max=" << stats.max_price;
+  return os;
+}
+
+
+/*
+ * Rolling aggregates over a window of orders for a single instrument.
+ *
+ * Each push is amortized O(1): sums are updated by adding the new record and
+ * subtracting evicted ones, and min/max are maintained with monotonic deques.
+ *
+ * A zero-length window evicts each record as it is pushed, so its stats are
+ * always empty, with zero min and max prices.
+ */
+template<class WINDOW>
+class RollingWindow
+{
+public:
+
+  RollingWindow(
+    WINDOW const& window)
+  : window_(window)
+  {
+  }
+
+  WindowStats const&
+  push(
+    Order const& order)
+  {
+    Entry const entry{seq_++, order.timestamp, order.size, order.price};
+    assert(entries_.empty() || entries_.back().timestamp <= entry.timestamp);
+    entries_.push_back(entry);
+
+    auto const volume = std::abs(entry.size);
+    ++stats_.count;
+    stats_.net_size += entry.size;
+    stats_.volume += volume;
+    stats_.notional += (double) volume * entry.price;
+
+    while (!mins_.empty() && mins_.back().price >= entry.price)
+      mins_.pop_back();
+    mins_.push_back(entry);
+    while (!maxs_.empty() && maxs_.back().price <= entry.price)
+      maxs_.pop_back();
+    maxs_.push_back(entry);
+
+    // Evict from the front.
+    while (!entries_.empty()
+           && window_.expired(entries_.front(), entry, entries_.size()))
+      evict();
+
+    stats_.min_price = entries_.empty() ? 0 : mins_.front().price;
+    stats_.max_price = entries_.empty() ? 0 : maxs_.front().price;
+    return stats_;
+  }
+
+  WindowStats const& stats() const { return stats_; }
+
+private:
+
+  struct Entry
+  {
+    uint64_t seq;
+    Timestamp timestamp;
+    Size size;
+    Price price;
+  };
+
+  void
+  evict()
+  {
+    auto const& entry = entries_.front();
+    auto const volume = std::abs(entry.size);
+    --stats_.count;
+    stats_.net_size -= entry.size;
+    stats_.volume -= volume;
+    stats_.notional -= (double) volume * entry.price;
+
+    if (mins_.front().seq == entry.seq)
+      mins_.pop_front();
+    if (maxs_.front().seq == entry.seq)
+      maxs_.pop_front();
+    entries_.pop_front();
+  }
+
+  WINDOW const window_;
+  uint64_t seq_ = 0;
+  std::deque<Entry> entries_;
+  std::deque<Entry> mins_;
+  std::deque<Entry> maxs_;
+  WindowStats stats_ = {};
+
+};
+
+
+//------------------------------------------------------------------------------
+
+/*
+ * Scans orders and maintains a rolling window per instrument.  After each
+ * order, invokes `fn(order, stats)` with the stats of that instrument's
+ * window, including the order.
+ *
+ * For a time window, an instrument's window is advanced only when an order
+ * for that instrument arrives.
+ */
+template<class READER, class WINDOW, class FN>
+std::unordered_map<Sid, RollingWindow<WINDOW>>
+get_rolling_order_stats(
+  READER const& reader,
+  WINDOW const& window,
+  FN&& fn)
+{
+  std::unordered_map<Sid, RollingWindow<WINDOW>> windows;
+  for (auto const& order : reader) {
+    auto i = windows.find(order.instrument);
+    if (i == windows.end())
+      i = windows.emplace(order.instrument, window).first;
+    fn(order, i->second.push(order));
+  }
+  return windows;
+}
+
+
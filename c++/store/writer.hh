@@ -0,0 +1,249 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <system_error>
+#include <time.h>
+#include <unistd.h>
+
+#include "buffer.hh"
+#include "tail.hh"
+
+//------------------------------------------------------------------------------
+
+struct WriterOptions
+{
+  // Number of records buffered between writes.
+  size_t batch_length = 4096;
+
+  // Group commit: fdatasync after this many records, or zero for never.
+  size_t sync_records = 0;
+
+  // Group commit: fdatasync after this many µs, or zero for never.
+  uint64_t sync_usec = 0;
+
+  // Preallocate file space in chunks of this many bytes, or zero for none.
+  // Space past the last record is released on close.
+  size_t grow_size = 1024 * 1024;
+
+  // Publish the written length for a TailReader, after each write.
+  bool publish = false;
+};
+
+
+/*
+ * Appends records to a file, through a batch buffer.
+ *
+ * On open, any torn record at the end of an existing file, left by a crash
+ * during a write, is truncated.  Records are durable only once committed,
+ * either explicitly or by the group commit policy in the options.
+ *
+ * Write and sync errors throw `std::system_error`.  The failed batch stays
+ * buffered, and a later `append()`, `flush()`, or `commit()` writes the rest
+ * of it.  The destructor commits too, but can't throw, so call `commit()`
+ * before it to see errors.
+ */
+template<class REC>
+class RecordWriter
+{
+public:
+
+  using value_type = REC;
+
+  RecordWriter(
+    char const* const filename,
+    WriterOptions const& options={})
+  : options_(options),
+    buffer_(options.batch_length * sizeof(REC)),
+    batch_(reinterpret_cast<REC*>(buffer_.get_start()))
+  {
+    assert(options_.batch_length > 0);
+
+    fd_ = open(filename, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    assert(fd_ != -1);
+
+    struct stat file_info;
+    int const rval = fstat(fd_, &file_info);
+    assert(rval == 0);
+    length_ = file_info.st_size / sizeof(REC);
+    size_t const size = length_ * sizeof(REC);
+    if (size != (size_t) file_info.st_size) {
+      // Truncate a torn tail record.
+      int const rval = ftruncate(fd_, size);
+      assert(rval == 0);
+      sync();
+    }
+
+    synced_length_ = length_;
+    allocated_ = size;
+    last_sync_ = now_usec();
+
+    if (options_.publish) {
+      state_ = open_tail_state(filename, true);
+      publish_tail_length(state_, length_);
+    }
+  }
+
+  RecordWriter(RecordWriter const&) = delete;
+  RecordWriter(RecordWriter&&) = delete;
+
+  ~RecordWriter()
+  {
+    try {
+      commit();
+    }
+    catch (std::system_error const&) {
+      // Buffered records are lost.
+    }
+    if (allocated_ > length_ * sizeof(REC) || written_ > 0) {
+      // Release preallocated space past the end, and any part of a batch
+      // whose write failed.  Truncating to the same size frees blocks
+      // allocated beyond it.
+      int const rval = ftruncate(fd_, length_ * sizeof(REC));
+      assert(rval == 0);
+    }
+    if (state_ != nullptr)
+      close_tail_state(state_);
+    int const rval = close(fd_);
+    assert(rval == 0);
+  }
+
+  /*
+   * Number of records in the file, including buffered records.
+   */
+  size_t length() const { return length_ + num_batch_; }
+
+  /*
+   * Number of records known to be durable.
+   */
+  size_t synced_length() const { return synced_length_; }
+
+  void
+  append(
+    REC const& rec)
+  {
+    // Retry a full batch whose write failed.
+    if (num_batch_ == options_.batch_length)
+      flush();
+    batch_[num_batch_++] = rec;
+    if (num_batch_ == options_.batch_length)
+      flush();
+    // Check the clock only occasionally.
+    else if (options_.sync_usec > 0 && num_batch_ % 64 == 0
+             && now_usec() - last_sync_ >= options_.sync_usec)
+      commit();
+  }
+
+  /*
+   * Writes buffered records to the file, and syncs if the group commit policy
+   * calls for it.
+   */
+  void
+  flush()
+  {
+    write_batch();
+
+    if ((options_.sync_records > 0
+         && length_ - synced_length_ >= options_.sync_records)
+        || (options_.sync_usec > 0
+            && now_usec() - last_sync_ >= options_.sync_usec))
+      sync();
+  }
+
+  /*
+   * Writes buffered records and syncs them to storage.
+   */
+  void
+  commit()
+  {
+    write_batch();
+    if (synced_length_ < length_)
+      sync();
+  }
+
+private:
+
+  static uint64_t
+  now_usec()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+  }
+
+  void
+  write_batch()
+  {
+    if (num_batch_ == 0)
+      return;
+
+    size_t const size = num_batch_ * sizeof(REC);
+    size_t const end = (length_ + num_batch_) * sizeof(REC);
+    if (options_.grow_size > 0 && end > allocated_) {
+      // Preallocate without changing the file size, so that the file never
+      // appears to contain records that haven't been written.
+      auto const grow = std::max(options_.grow_size, end - allocated_);
+      int const rval = fallocate(fd_, FALLOC_FL_KEEP_SIZE, allocated_, grow);
+      // Not all file systems support fallocate(); there, just write.
+      if (rval == -1 && errno != EOPNOTSUPP)
+        throw std::system_error(errno, std::generic_category(), "fallocate");
+      allocated_ += grow;
+    }
+
+    // Resume after any part of the batch written before a failed write, so
+    // a retry doesn't append it twice.
+    auto ptr = reinterpret_cast<char const*>(batch_);
+    while (written_ < size) {
+      auto const rval = write(fd_, ptr + written_, size - written_);
+      if (rval == -1 && errno == EINTR)
+        continue;
+      if (rval == -1)
+        throw std::system_error(errno, std::generic_category(), "write");
+      // write() returns 0 only if it can make no progress.
+      if (rval == 0)
+        throw std::system_error(EIO, std::generic_category(), "write");
+      written_ += rval;
+    }
+    written_ = 0;
+
+    length_ += num_batch_;
+    num_batch_ = 0;
+
+    if (state_ != nullptr)
+      publish_tail_length(state_, length_);
+  }
+
+  void
+  sync()
+  {
+    if (fdatasync(fd_) == -1)
+      throw std::system_error(errno, std::generic_category(), "fdatasync");
+    synced_length_ = length_;
+    last_sync_ = now_usec();
+  }
+
+  WriterOptions const options_;
+  int fd_;
+
+  MallocBuffer buffer_;
+  REC* const batch_;
+  size_t num_batch_ = 0;
+  // Bytes of the batch written, if a write failed partway.
+  size_t written_ = 0;
+
+  size_t length_;
+  size_t synced_length_;
+  size_t allocated_;
+  uint64_t last_sync_;
+
+  TailState* state_ = nullptr;
+
+};
+
+
@@ -0,0 +1,67 @@
+# Classifies each kernel in an x86-64 assembly listing by the packed SIMD
+# instructions it executes, in its own body or in functions it calls:
+#
+#   arithmetic  packed arithmetic, such as addpd, mulps, or paddd
+#   store       packed stores to memory other than the stack, but no packed
+#               arithmetic
+#   scalar      neither
+#
+# Scalar code moves values between xmm registers and spills them with packed
+# moves too, so register copies and stack stores don't count.
+#
+# Usage: awk -f vectorized.awk kernels.s
+
+function reaches(fn, kind, seen,    n, i, callees)
+{
+  if (fn in seen)
+    return 0
+  seen[fn] = 1
+  if ((fn, kind) in found)
+    return 1
+  n = split(calls[fn], callees, " ")
+  for (i = 1; i <= n; ++i)
+    if (reaches(callees[i], kind, seen))
+      return 1
+  return 0
+}
+
+# A function label; split-off parts like fn.cold belong to fn.
+/^[A-Za-z_][A-Za-z_0-9.]*:$/ {
+  fn = substr($1, 1, length($1) - 1)
+  sub(/\..*/, "", fn)
+  fns[fn] = 1
+}
+
+fn == "" { next }
+
+/^\tv?((add|sub|mul|div|min|max|sqrt|f(n)?m(add|sub)[0-9]*)p[sd]|p(add|sub)[bwdq]|pmul(l[dwq]|h[uw]*|u?dq))\t/ {
+  found[fn, "arithmetic"] = 1
+}
+
+/^\tv?mov(dq[au]|[au]p[sd]|nt(dq|p[sd]))\t%[xyz]mm[0-9]+, / \
+  && $0 ~ /\(/ && $0 !~ /%[re](sp|bp)/ {
+  found[fn, "store"] = 1
+}
+
+# Direct calls, and tail calls.
+/^\t(call|jmp)\t[A-Za-z_]/ {
+  callee = $2
+  sub(/@.*/, "", callee)
+  calls[fn] = calls[fn] " " callee
+}
+
+END {
+  for (fn in fns) {
+    # Report only the kernels, which are extern "C", not mangled helpers.
+    if (fn ~ /^_/)
+      continue
+    split("", seen)
+    if (reaches(fn, "arithmetic", seen))
+      kind = "arithmetic"
+    else {
+      split("", seen)
+      kind = reaches(fn, "store", seen) ? "store" : "scalar"
+    }
+    print fn, kind
+  }
+}
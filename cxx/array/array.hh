@@ -3,6 +3,7 @@
 #pragma once
 
 #include <cassert>
+#include <cstddef>
 
 namespace array {
 
@@ -14,7 +15,7 @@ using index_t = long;
 namespace {
 
 template<typename T>
-T* 
+inline T* 
 shift(
   T* ptr,
   size_t offset)
@@ -24,7 +25,7 @@ shift(
 
 
 template<typename T>
-T const* 
+inline T const* 
 shift(
   T const* ptr,
   size_t offset)
@@ -34,7 +35,7 @@ shift(
 }
 
 
-index_t 
+inline index_t 
 check_index(
   index_t idx,
   index_t length)
@@ -2,6 +2,7 @@
 
 #include "array.hh"
 #include "contig.hh"
+#include "instrument.hh"
 
 //------------------------------------------------------------------------------
 
@@ -103,9 +104,16 @@ public:
       new byte_t[sizeof(T) * length],
       length)
   {
+    INSTRUMENT_COUNT(BUFFERS_ALLOCATED, 1);
+    INSTRUMENT_COUNT(BYTES_ALLOCATED, sizeof(T) * length);
   }
 
-  virtual ~OwnedArray() { delete[] this->buffer_; }
+  virtual ~OwnedArray()
+  {
+    delete[] this->buffer_;
+    INSTRUMENT_COUNT(BUFFERS_FREED, 1);
+    INSTRUMENT_COUNT(BYTES_FREED, sizeof(T) * this->length());
+  }
 
 };
 
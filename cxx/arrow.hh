@@ -0,0 +1,353 @@
+#pragma once
+
+/**
+ * Zero-copy export and import of arrays through the Arrow C data interface.
+ *
+ * This implements the C ABI described at
+ * https://arrow.apache.org/docs/format/CDataInterface.html, with no dependency
+ * on the Arrow library.  Only primitive arrays without nulls, and structs of
+ * them, are supported.
+ *
+ * An exported array keeps the `Buffer` holding its data alive until the
+ * consumer releases it.  An imported array is held by an `ArrowBuffer`, which
+ * releases it when destroyed.
+ */
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "array/typed.hh"
+#include "buffer.hh"
+
+//------------------------------------------------------------------------------
+// The C data interface ABI.
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+extern "C" {
+
+struct ArrowSchema {
+  const char* format;
+  const char* name;
+  const char* metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema** children;
+  struct ArrowSchema* dictionary;
+  void (*release)(struct ArrowSchema*);
+  void* private_data;
+};
+
+struct ArrowArray {
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void** buffers;
+  struct ArrowArray** children;
+  struct ArrowArray* dictionary;
+  void (*release)(struct ArrowArray*);
+  void* private_data;
+};
+
+}  // extern "C"
+
+#endif  // ARROW_C_DATA_INTERFACE
+
+//------------------------------------------------------------------------------
+// Formats
+
+/*
+ * Arrow format string for primitive type T.
+ */
+template<class T> inline char const* get_arrow_format();
+template<> inline char const* get_arrow_format<int8_t>()   { return "c"; }
+template<> inline char const* get_arrow_format<uint8_t>()  { return "C"; }
+template<> inline char const* get_arrow_format<int16_t>()  { return "s"; }
+template<> inline char const* get_arrow_format<uint16_t>() { return "S"; }
+template<> inline char const* get_arrow_format<int32_t>()  { return "i"; }
+template<> inline char const* get_arrow_format<uint32_t>() { return "I"; }
+template<> inline char const* get_arrow_format<int64_t>()  { return "l"; }
+template<> inline char const* get_arrow_format<uint64_t>() { return "L"; }
+template<> inline char const* get_arrow_format<float>()    { return "f"; }
+template<> inline char const* get_arrow_format<double>()   { return "g"; }
+
+
+/*
+ * Returns the element width in bytes of a primitive Arrow format, or 0 if it
+ * is not a supported fixed-width format.
+ */
+inline size_t
+get_arrow_width(
+  char const* const format)
+{
+  if (format[0] != '\0' && format[1] == '\0')
+    switch (format[0]) {
+    case 'c': case 'C':             return 1;
+    case 's': case 'S': case 'e':   return 2;
+    case 'i': case 'I': case 'f':   return 4;
+    case 'l': case 'L': case 'g':   return 8;
+    default:                        return 0;
+    }
+  // Timestamps and durations are 64 bits.
+  if (strncmp(format, "ts", 2) == 0 || strncmp(format, "tD", 2) == 0)
+    return 8;
+  // Fixed-size binary.
+  if (strncmp(format, "w:", 2) == 0)
+    return atol(format + 2);
+  return 0;
+}
+
+
+//------------------------------------------------------------------------------
+// Export
+
+namespace arrow {
+
+/*
+ * Private data for an exported array and its schema.  Owns everything the
+ * ArrowArray and ArrowSchema point to.
+ */
+struct ArrayExport
+{
+  std::shared_ptr<Buffer> buffer;
+  void const* buffers[2] = {nullptr, nullptr};
+  std::vector<ArrowArray*> children;
+};
+
+
+struct SchemaExport
+{
+  std::string format;
+  std::string name;
+  std::vector<ArrowSchema*> children;
+};
+
+
+extern "C" inline void
+release_array(
+  ArrowArray* const array)
+{
+  auto const priv = reinterpret_cast<ArrayExport*>(array->private_data);
+  for (auto const child : priv->children) {
+    if (child->release != nullptr)
+      child->release(child);
+    delete child;
+  }
+  delete priv;
+  array->release = nullptr;
+}
+
+
+extern "C" inline void
+release_schema(
+  ArrowSchema* const schema)
+{
+  auto const priv = reinterpret_cast<SchemaExport*>(schema->private_data);
+  for (auto const child : priv->children) {
+    if (child->release != nullptr)
+      child->release(child);
+    delete child;
+  }
+  delete priv;
+  schema->release = nullptr;
+}
+
+
+}  // namespace arrow
+
+
+/*
+ * Exports `length` elements of `format` starting at `data`, which `buffer`
+ * holds, without copying.  The elements must be contiguous.
+ */
+inline void
+export_arrow(
+  void const* const data,
+  size_t const length,
+  char const* const format,
+  std::shared_ptr<Buffer> buffer,
+  ArrowArray* const out_array,
+  ArrowSchema* const out_schema,
+  char const* const name="")
+{
+  auto const array_priv = new arrow::ArrayExport;
+  array_priv->buffer = std::move(buffer);
+  // No validity buffer, since there are no nulls.
+  array_priv->buffers[1] = data;
+  *out_array = {
+    (int64_t) length, 0, 0, 2, 0, array_priv->buffers, nullptr, nullptr,
+    arrow::release_array, array_priv};
+
+  auto const schema_priv = new arrow::SchemaExport{format, name, {}};
+  *out_schema = {
+    schema_priv->format.c_str(), schema_priv->name.c_str(), nullptr, 0, 0,
+    nullptr, nullptr, arrow::release_schema, schema_priv};
+}
+
+
+template<class T>
+inline void
+export_arrow(
+  T const* const data,
+  size_t const length,
+  std::shared_ptr<Buffer> buffer,
+  ArrowArray* const out_array,
+  ArrowSchema* const out_schema,
+  char const* const name="")
+{
+  export_arrow(
+    (void const*) data, length, get_arrow_format<T>(), std::move(buffer),
+    out_array, out_schema, name);
+}
+
+
+/*
+ * Exports `arr` without copying.  `buffer`, if not null, is kept alive until
+ * the consumer releases the array; otherwise, `arr` must outlive it.
+ */
+template<class T>
+inline void
+export_arrow(
+  array::TypedContigArray<T> const& arr,
+  std::shared_ptr<Buffer> buffer,
+  ArrowArray* const out_array,
+  ArrowSchema* const out_schema,
+  char const* const name="")
+{
+  export_arrow<T>(
+    arr.begin_ptr(), arr.length(), std::move(buffer), out_array, out_schema,
+    name);
+}
+
+
+/*
+ * Exports a struct array of `length` rows, whose fields are the given arrays,
+ * which are moved into it.
+ */
+inline void
+export_arrow_struct(
+  size_t const length,
+  std::vector<ArrowArray> fields,
+  std::vector<ArrowSchema> field_schemas,
+  ArrowArray* const out_array,
+  ArrowSchema* const out_schema,
+  char const* const name="")
+{
+  assert(fields.size() == field_schemas.size());
+  auto const array_priv = new arrow::ArrayExport;
+  auto const schema_priv = new arrow::SchemaExport{"+s", name, {}};
+  for (size_t i = 0; i < fields.size(); ++i) {
+    assert(fields[i].length == (int64_t) length);
+    array_priv->children.push_back(new ArrowArray(fields[i]));
+    schema_priv->children.push_back(new ArrowSchema(field_schemas[i]));
+  }
+
+  // A struct array has only a validity buffer.
+  *out_array = {
+    (int64_t) length, 0, 0, 1, (int64_t) fields.size(), array_priv->buffers,
+    array_priv->children.data(), nullptr, arrow::release_array, array_priv};
+  *out_schema = {
+    schema_priv->format.c_str(), schema_priv->name.c_str(), nullptr, 0,
+    (int64_t) fields.size(), schema_priv->children.data(), nullptr,
+    arrow::release_schema, schema_priv};
+}
+
+
+//------------------------------------------------------------------------------
+// Import
+
+/*
+ * A buffer holding the data of an imported primitive Arrow array.  Takes
+ * ownership of the array, and releases it when destroyed.
+ */
+class ArrowBuffer
+: public Buffer
+{
+public:
+
+  /*
+   * Imports `array`, which must be a primitive array with no nulls, whose
+   * elements are `width` bytes.  Moves the array, leaving `*array` released.
+   */
+  ArrowBuffer(
+    ArrowArray* const array,
+    size_t const width)
+  : array_(*array)
+  {
+    array->release = nullptr;
+    assert(array_.release != nullptr);
+    assert(array_.n_buffers == 2);
+    assert(array_.null_count == 0 || array_.buffers[0] == nullptr);
+    start_ = (char*) array_.buffers[1] + array_.offset * width;
+    size_ = array_.length * width;
+  }
+
+  ArrowBuffer(ArrowBuffer const&) = delete;
+  ArrowBuffer& operator=(ArrowBuffer const&) = delete;
+
+  virtual ~ArrowBuffer()
+  {
+    if (array_.release != nullptr)
+      array_.release(&array_);
+  }
+
+  virtual void* get_start() const { return start_; }
+  virtual size_t get_size() const { return size_; }
+
+  size_t length() const { return array_.length; }
+
+private:
+
+  ArrowArray array_;
+  void* start_;
+  size_t size_;
+
+};
+
+
+/*
+ * Imports a primitive array of T without copying, and returns the buffer that
+ * holds it.  Takes ownership of `array`; `schema` is not released.
+ */
+template<class T>
+inline std::unique_ptr<ArrowBuffer>
+import_arrow(
+  ArrowArray* const array,
+  ArrowSchema const* const schema)
+{
+  assert(get_arrow_width(schema->format) == sizeof(T));
+  // Timestamps are imported as their integer representation.
+  assert(
+    strcmp(schema->format, get_arrow_format<T>()) == 0
+    || (std::is_integral<T>::value && strncmp(schema->format, "ts", 2) == 0));
+  return std::unique_ptr<ArrowBuffer>(new ArrowBuffer(array, sizeof(T)));
+}
+
+
+/*
+ * Returns a typed view of an imported buffer.
+ */
+template<class T>
+inline array::TypedContigArray<T>
+get_typed_array(
+  ArrowBuffer const& buffer)
+{
+  return {reinterpret_cast<array::byte_t*>(buffer.get_start()),
+          (array::index_t) buffer.length()};
+}
+
+
@@ -3,6 +3,16 @@
 #include <cassert>
 #include <cstddef>
 #include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "instrument.hh"
+
+//------------------------------------------------------------------------------
+
+size_t constexpr CACHE_LINE_SIZE = 64;
 
 //------------------------------------------------------------------------------
 
@@ -54,6 +64,10 @@ MallocBuffer::MallocBuffer(
   start_(size == 0 ? nullptr : malloc(size))
 {
   assert(size_ == 0 || start_ != nullptr);
+  if (start_ != nullptr) {
+    INSTRUMENT_COUNT(BUFFERS_ALLOCATED, 1);
+    INSTRUMENT_COUNT(BYTES_ALLOCATED, size_);
+  }
 }
 
 
@@ -70,8 +84,11 @@ MallocBuffer::MallocBuffer(
 inline
 MallocBuffer::~MallocBuffer()
 {
-  if (start_ != nullptr)
+  if (start_ != nullptr) {
     free(start_);
+    INSTRUMENT_COUNT(BUFFERS_FREED, 1);
+    INSTRUMENT_COUNT(BYTES_FREED, size_);
+  }
 }
 
 
@@ -79,8 +96,11 @@ inline MallocBuffer&
 MallocBuffer::operator=(
   MallocBuffer&& buffer)
 {
-  if (start_ != nullptr)
+  if (start_ != nullptr) {
     free(start_);
+    INSTRUMENT_COUNT(BUFFERS_FREED, 1);
+    INSTRUMENT_COUNT(BYTES_FREED, size_);
+  }
   start_ = buffer.start_;
   size_ = buffer.size_;
   buffer.start_ = nullptr;
@@ -89,3 +109,64 @@ MallocBuffer::operator=(
 }
 
 
+//------------------------------------------------------------------------------
+
+/**
+ * Buffer in a named POSIX shared memory object, which other processes can map
+ * by name.
+ */
+class SharedMemoryBuffer
+: public Buffer
+{
+public:
+
+  SharedMemoryBuffer(char const* name, size_t size, bool create);
+  SharedMemoryBuffer(SharedMemoryBuffer const&) = delete;
+  SharedMemoryBuffer& operator=(SharedMemoryBuffer const&) = delete;
+
+  virtual ~SharedMemoryBuffer();
+
+  virtual void* get_start() const { return start_; }
+  virtual size_t get_size() const { return size_; }
+
+private:
+
+  size_t size_;
+  void* start_;
+
+};
+
+
+/*
+ * If `create`, creates the shared memory object, or resizes it if it exists.
+ * Otherwise, the object must already exist.  The object persists after the
+ * buffer is destroyed, until shm_unlink().
+ */
+inline
+SharedMemoryBuffer::SharedMemoryBuffer(
+  char const* const name,
+  size_t const size,
+  bool const create)
+: size_(size),
+  start_(nullptr)
+{
+  int const fd = shm_open(name, create ? O_RDWR | O_CREAT : O_RDWR, 0644);
+  assert(fd != -1);
+  if (create) {
+    int const rval = ftruncate(fd, size_);
+    assert(rval == 0);
+  }
+  start_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  assert(start_ != MAP_FAILED);
+  close(fd);
+}
+
+
+inline
+SharedMemoryBuffer::~SharedMemoryBuffer()
+{
+  int const rval = munmap(start_, size_);
+  assert(rval == 0);
+}
+
+
@@ -0,0 +1,353 @@
+#pragma once
+
+/**
+ * Hot-path instrumentation: per-thread event counters and stage timers.
+ *
+ * Instrumentation is compiled in only if `INSTRUMENT` is defined.  Otherwise,
+ * the `INSTRUMENT_*` macros expand to nothing, and cost nothing.
+ *
+ * Each thread increments its own counters, without synchronization beyond
+ * relaxed atomic loads and stores, so counting costs about as much as a plain
+ * increment.  Counts from all threads, including those that have exited, are
+ * aggregated on demand by `get_instrument_totals()`.
+ *
+ * Stage timers read the time stamp counter on entry and exit of a scope.
+ * Times from several threads in the same stage add up, so a parallel stage
+ * may report more time than elapsed.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+#ifdef INSTRUMENT
+
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+# include <x86intrin.h>
+#endif
+
+#endif
+
+//------------------------------------------------------------------------------
+
+namespace instrument {
+
+enum class Counter
+{
+  RECORDS_SCANNED,
+  BYTES_SCANNED,
+  BLOCKS_SKIPPED,
+  FILES_MAPPED,
+  BYTES_MAPPED,
+  BUFFERS_ALLOCATED,
+  BUFFERS_FREED,
+  BYTES_ALLOCATED,
+  BYTES_FREED,
+  NUM
+};
+
+
+enum class Stage
+{
+  OPEN,
+  SCAN,
+  MERGE,
+  OUTPUT,
+  NUM
+};
+
+
+size_t constexpr NUM_COUNTERS = (size_t) Counter::NUM;
+size_t constexpr NUM_STAGES = (size_t) Stage::NUM;
+
+inline char const*
+get_name(
+  Counter const counter)
+{
+  static char const* const names[NUM_COUNTERS] = {
+    "records_scanned",
+    "bytes_scanned",
+    "blocks_skipped",
+    "files_mapped",
+    "bytes_mapped",
+    "buffers_allocated",
+    "buffers_freed",
+    "bytes_allocated",
+    "bytes_freed",
+  };
+  return names[(size_t) counter];
+}
+
+
+inline char const*
+get_name(
+  Stage const stage)
+{
+  static char const* const names[NUM_STAGES] = {
+    "open",
+    "scan",
+    "merge",
+    "output",
+  };
+  return names[(size_t) stage];
+}
+
+}  // namespace instrument
+
+
+/**
+ * Counts and stage times, aggregated over threads.
+ */
+struct InstrumentTotals
+{
+  uint64_t counts[instrument::NUM_COUNTERS] = {};
+  // Time in each stage, in seconds.
+  double stage_time[instrument::NUM_STAGES] = {};
+  uint64_t stage_calls[instrument::NUM_STAGES] = {};
+};
+
+
+inline std::ostream&
+operator<<(
+  std::ostream& os,
+  InstrumentTotals const& totals)
+{
+  using namespace instrument;
+  for (size_t c = 0; c < NUM_COUNTERS; ++c)
+    os << get_name((Counter) c) << " = " << totals.counts[c] << "\n";
+  for (size_t s = 0; s < NUM_STAGES; ++s)
+    if (totals.stage_calls[s] > 0)
+      os << "stage " << get_name((Stage) s) << " = "
+         << totals.stage_time[s] << " s in " << totals.stage_calls[s]
+         << " calls\n";
+  return os;
+}
+
+
+//------------------------------------------------------------------------------
+
+#ifdef INSTRUMENT
+
+namespace instrument {
+
+inline uint64_t
+get_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+
+/*
+ * One thread's counters.  Only the owning thread writes them.
+ */
+struct ThreadCounters
+{
+  ThreadCounters();
+  ~ThreadCounters();
+
+  void
+  add(
+    std::atomic<uint64_t>& counter,
+    uint64_t const n)
+  {
+    counter.store(
+      counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> counts[NUM_COUNTERS] = {};
+  std::atomic<uint64_t> stage_ticks[NUM_STAGES] = {};
+  std::atomic<uint64_t> stage_calls[NUM_STAGES] = {};
+};
+
+
+/*
+ * All threads' counters.  Counters of exited threads are folded into
+ * `retired`.
+ */
+struct Registry
+{
+  std::mutex mutex;
+  std::vector<ThreadCounters*> threads;
+  uint64_t retired_counts[NUM_COUNTERS] = {};
+  uint64_t retired_ticks[NUM_STAGES] = {};
+  uint64_t retired_calls[NUM_STAGES] = {};
+
+  // Reference points for converting ticks to seconds.
+  uint64_t const start_ticks = get_ticks();
+  std::chrono::steady_clock::time_point const start_time
+    = std::chrono::steady_clock::now();
+};
+
+
+inline Registry&
+get_registry()
+{
+  // Never destroyed, since threads may exit after static destruction.
+  static Registry* const registry = new Registry;
+  return *registry;
+}
+
+
+inline
+ThreadCounters::ThreadCounters()
+{
+  auto& registry = get_registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.threads.push_back(this);
+}
+
+
+inline
+ThreadCounters::~ThreadCounters()
+{
+  auto& registry = get_registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  for (size_t c = 0; c < NUM_COUNTERS; ++c)
+    registry.retired_counts[c] += counts[c].load(std::memory_order_relaxed);
+  for (size_t s = 0; s < NUM_STAGES; ++s) {
+    registry.retired_ticks[s] += stage_ticks[s].load(std::memory_order_relaxed);
+    registry.retired_calls[s] += stage_calls[s].load(std::memory_order_relaxed);
+  }
+  for (auto i = registry.threads.begin(); i != registry.threads.end(); ++i)
+    if (*i == this) {
+      registry.threads.erase(i);
+      break;
+    }
+}
+
+
+inline ThreadCounters&
+get_thread_counters()
+{
+  static thread_local ThreadCounters counters;
+  return counters;
+}
+
+
+inline void
+count(
+  Counter const counter,
+  uint64_t const n)
+{
+  auto& counters = get_thread_counters();
+  counters.add(counters.counts[(size_t) counter], n);
+}
+
+
+/*
+ * Adds the time from construction to destruction to a stage.
+ */
+class StageTimer
+{
+public:
+
+  StageTimer(
+    Stage const stage)
+  : stage_(stage),
+    start_(get_ticks())
+  {
+  }
+
+  StageTimer(StageTimer const&) = delete;
+  StageTimer& operator=(StageTimer const&) = delete;
+
+  ~StageTimer()
+  {
+    auto& counters = get_thread_counters();
+    counters.add(counters.stage_ticks[(size_t) stage_], get_ticks() - start_);
+    counters.add(counters.stage_calls[(size_t) stage_], 1);
+  }
+
+private:
+
+  Stage const stage_;
+  uint64_t const start_;
+
+};
+
+
+}  // namespace instrument
+
+
+/**
+ * Returns counts and stage times summed over all threads so far.
+ */
+inline InstrumentTotals
+get_instrument_totals()
+{
+  using namespace instrument;
+  auto& registry = get_registry();
+
+  uint64_t ticks[NUM_STAGES];
+  InstrumentTotals totals;
+  {
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (size_t c = 0; c < NUM_COUNTERS; ++c) {
+      totals.counts[c] = registry.retired_counts[c];
+      for (auto const* const thread : registry.threads)
+        totals.counts[c] += thread->counts[c].load(std::memory_order_relaxed);
+    }
+    for (size_t s = 0; s < NUM_STAGES; ++s) {
+      ticks[s] = registry.retired_ticks[s];
+      totals.stage_calls[s] = registry.retired_calls[s];
+      for (auto const* const thread : registry.threads) {
+        ticks[s] += thread->stage_ticks[s].load(std::memory_order_relaxed);
+        totals.stage_calls[s]
+          += thread->stage_calls[s].load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Calibrate ticks against the steady clock, over the life of the registry.
+  double const elapsed = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - registry.start_time).count();
+  auto const elapsed_ticks = get_ticks() - registry.start_ticks;
+  double const sec_per_tick
+    = elapsed_ticks == 0 ? 0 : elapsed / elapsed_ticks;
+  for (size_t s = 0; s < NUM_STAGES; ++s)
+    totals.stage_time[s] = ticks[s] * sec_per_tick;
+
+  return totals;
+}
+
+
+#define INSTRUMENT_CONCAT_(A, B) A ## B
+#define INSTRUMENT_CONCAT(A, B) INSTRUMENT_CONCAT_(A, B)
+
+/**
+ * Adds `N` to `COUNTER`, a `Counter` enumerator name, for this thread.
+ */
+#define INSTRUMENT_COUNT(COUNTER, N) \
+  ::instrument::count(::instrument::Counter::COUNTER, (N))
+
+/**
+ * Times the rest of the enclosing scope as `STAGE`, a `Stage` enumerator name.
+ */
+#define INSTRUMENT_STAGE(STAGE) \
+  ::instrument::StageTimer INSTRUMENT_CONCAT(instrument_timer_, __LINE__)( \
+    ::instrument::Stage::STAGE)
+
+#else
+
+inline InstrumentTotals
+get_instrument_totals()
+{
+  return {};
+}
+
+
+#define INSTRUMENT_COUNT(COUNTER, N) ((void) 0)
+#define INSTRUMENT_STAGE(STAGE) ((void) 0)
+
+#endif
+
@@ -0,0 +1,483 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//------------------------------------------------------------------------------
+
+struct Cpu
+{
+  int cpu;
+  int node;
+};
+
+
+/**
+ * Parses a sysfs list of ids, like "0-3,8-11".  The list may be empty, as for
+ * a NUMA node without CPUs.
+ */
+inline std::vector<int>
+parse_id_list(
+  std::string const& list)
+{
+  std::vector<int> ids;
+  std::istringstream stream(list);
+  std::string range;
+  while (std::getline(stream, range, ',')) {
+    auto const begin = range.find_first_not_of(" \t\n");
+    if (begin == std::string::npos)
+      continue;
+    auto const end = range.find_last_not_of(" \t\n") + 1;
+    range = range.substr(begin, end - begin);
+    auto const dash = range.find('-');
+    int const first = std::stoi(range.substr(0, dash));
+    int const last
+      = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+    for (int id = first; id <= last; ++id)
+      ids.push_back(id);
+  }
+  return ids;
+}
+
+
+/**
+ * Reads a sysfs list of ids, or returns none if the file doesn't exist.
+ */
+inline std::vector<int>
+read_id_list(
+  std::string const& filename)
+{
+  std::ifstream file(filename);
+  std::string list;
+  std::getline(file, list);
+  return parse_id_list(list);
+}
+
+
+/**
+ * Returns the online CPUs and their NUMA nodes, from sysfs.  If NUMA
+ * information is unavailable, assumes a single node.
+ */
+inline std::vector<Cpu>
+get_cpus()
+{
+  std::vector<Cpu> cpus;
+  // Node ids needn't be contiguous.
+  for (int const node : read_id_list("/sys/devices/system/node/online"))
+    for (int const cpu : read_id_list(
+           "/sys/devices/system/node/node" + std::to_string(node)
+           + "/cpulist"))
+      cpus.push_back({cpu, node});
+
+  if (cpus.empty()) {
+    int const num_cpus = std::max(1u, std::thread::hardware_concurrency());
+    for (int cpu = 0; cpu < num_cpus; ++cpu)
+      cpus.push_back({cpu, 0});
+  }
+  return cpus;
+}
+
+
+//------------------------------------------------------------------------------
+
+/**
+ * Work-stealing thread pool for data-parallel loops over index ranges.
+ *
+ * Each worker has a deque of ranges.  A worker splits the range it is running
+ * in half repeatedly down to the grain size, pushing the upper halves onto its
+ * own deque, then pops from the back of its deque; idle workers steal from the
+ * front of others' deques, which holds the largest ranges.  Idle workers steal
+ * from workers on their own NUMA node first.
+ *
+ * The thread calling `parallel_for()` participates as a worker.  A pool of
+ * `num_threads` runs `num_threads - 1` threads of its own.
+ */
+class ThreadPool
+{
+public:
+
+  /**
+   * If `num_threads` is zero, uses one per CPU.  If `pin`, pins each thread
+   * to a CPU, spreading threads across NUMA nodes.
+   */
+  ThreadPool(size_t num_threads=0, bool pin=true);
+  ThreadPool(ThreadPool const&) = delete;
+  ThreadPool& operator=(ThreadPool const&) = delete;
+
+  ~ThreadPool();
+
+  size_t num_threads() const { return workers_.size(); }
+
+  /**
+   * Invokes `fn(b, e)` on subranges of [begin, end) in parallel.  Ranges
+   * longer than `grain` are split in half, so subranges are no longer than
+   * `grain`, and no shorter than half of it, unless the whole range is.
+   */
+  template<class FN>
+  void parallel_for(size_t begin, size_t end, size_t grain, FN&& fn);
+
+  /**
+   * Reduces [begin, end) by computing `map(b, e)` on chunks of `grain`
+   * indices in parallel, then folding the results in order with `combine`,
+   * starting with `init`.
+   *
+   * Since chunk boundaries and the fold order depend only on `grain`, the
+   * result does not depend on the number of threads.
+   */
+  template<class T, class MAP, class COMBINE>
+  T parallel_reduce(
+    size_t begin, size_t end, size_t grain, T init, MAP&& map,
+    COMBINE&& combine);
+
+private:
+
+  struct Job
+  {
+    void (*fn)(void*, size_t, size_t);
+    void* ctx;
+    size_t grain;
+    std::atomic<size_t> remaining;
+  };
+
+  struct Task
+  {
+    Job* job;
+    size_t begin;
+    size_t end;
+  };
+
+  struct Worker
+  {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    int node = 0;
+    // Other workers, in the order to steal from them.
+    std::vector<size_t> victims;
+    std::thread thread;
+  };
+
+  struct Current
+  {
+    ThreadPool* pool;
+    size_t index;
+  };
+
+  static Current&
+  current()
+  {
+    static thread_local Current current{nullptr, 0};
+    return current;
+  }
+
+  template<class FN>
+  static void
+  invoke(
+    void* const ctx,
+    size_t const begin,
+    size_t const end)
+  {
+    (*reinterpret_cast<typename std::remove_reference<FN>::type*>(ctx))(
+      begin, end);
+  }
+
+  void push(size_t w, Task const& task);
+  bool pop(size_t w, Task& task);
+  bool steal(size_t w, Task& task);
+  void run(size_t w, Task task);
+  void work(size_t w);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  size_t num_jobs_ = 0;
+  bool stop_ = false;
+
+  // Serializes callers from outside the pool, which share the last worker.
+  std::mutex caller_mutex_;
+
+};
+
+
+inline
+ThreadPool::ThreadPool(
+  size_t num_threads,
+  bool const pin)
+{
+  auto cpus = get_cpus();
+  if (num_threads == 0)
+    num_threads = cpus.size();
+
+  // Order CPUs round-robin across nodes.
+  std::vector<size_t> rank(cpus.size());
+  {
+    std::vector<size_t> node_count;
+    for (size_t i = 0; i < cpus.size(); ++i) {
+      auto const node = (size_t) cpus[i].node;
+      if (node_count.size() <= node)
+        node_count.resize(node + 1);
+      rank[i] = node_count[node]++;
+    }
+  }
+  std::vector<size_t> order(cpus.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::stable_sort(
+    order.begin(), order.end(),
+    [&](size_t const i0, size_t const i1) {
+      return
+        rank[i0] < rank[i1]
+        || (rank[i0] == rank[i1] && cpus[i0].node < cpus[i1].node);
+    });
+
+  for (size_t w = 0; w < num_threads; ++w) {
+    workers_.emplace_back(new Worker);
+    workers_[w]->node = cpus[order[w % order.size()]].node;
+  }
+
+  for (size_t w = 0; w < num_threads; ++w) {
+    auto& victims = workers_[w]->victims;
+    for (size_t i = 1; i < num_threads; ++i)
+      victims.push_back((w + i) % num_threads);
+    std::stable_partition(
+      victims.begin(), victims.end(),
+      [&](size_t const v) { return workers_[v]->node == workers_[w]->node; });
+  }
+
+  // The last worker is for the calling thread.
+  for (size_t w = 0; w + 1 < num_threads; ++w) {
+    workers_[w]->thread = std::thread(&ThreadPool::work, this, w);
+    if (pin) {
+      cpu_set_t cpu_set;
+      CPU_ZERO(&cpu_set);
+      CPU_SET(cpus[order[w % order.size()]].cpu, &cpu_set);
+      pthread_setaffinity_np(
+        workers_[w]->thread.native_handle(), sizeof(cpu_set), &cpu_set);
+    }
+  }
+}
+
+
+inline
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto& worker : workers_)
+    if (worker->thread.joinable())
+      worker->thread.join();
+}
+
+
+template<class FN>
+inline void
+ThreadPool::parallel_for(
+  size_t const begin,
+  size_t const end,
+  size_t grain,
+  FN&& fn)
+{
+  if (begin >= end)
+    return;
+  grain = std::max<size_t>(grain, 1);
+  if (workers_.size() == 1 || end - begin <= grain) {
+    fn(begin, end);
+    return;
+  }
+
+  // Work from this thread's own deque, if it's a worker; otherwise, use the
+  // caller's.
+  auto& cur = current();
+  auto const outer = cur;
+  std::unique_lock<std::mutex> caller_lock;
+  if (cur.pool != this) {
+    caller_lock = std::unique_lock<std::mutex>(caller_mutex_);
+    cur = {this, workers_.size() - 1};
+  }
+  auto const w = cur.index;
+
+  Job job{&invoke<FN>, (void*) &fn, grain, {end - begin}};
+  push(w, {&job, begin, end});
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++num_jobs_;
+  }
+  cv_.notify_all();
+
+  Task task;
+  while (job.remaining.load(std::memory_order_acquire) > 0)
+    if (pop(w, task) || steal(w, task))
+      run(w, task);
+    else
+      std::this_thread::yield();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --num_jobs_;
+  }
+  cur = outer;
+}
+
+
+template<class T, class MAP, class COMBINE>
+inline T
+ThreadPool::parallel_reduce(
+  size_t const begin,
+  size_t const end,
+  size_t grain,
+  T init,
+  MAP&& map,
+  COMBINE&& combine)
+{
+  if (begin >= end)
+    return init;
+  grain = std::max<size_t>(grain, 1);
+
+  auto const num_chunks = (end - begin + grain - 1) / grain;
+  std::vector<T> partials(num_chunks, init);
+  parallel_for(
+    0, num_chunks, 1,
+    [&](size_t const c0, size_t const c1) {
+      for (size_t c = c0; c < c1; ++c)
+        partials[c] = map(
+          begin + c * grain, std::min(begin + (c + 1) * grain, end));
+    });
+
+  auto result = init;
+  for (auto const& partial : partials)
+    result = combine(std::move(result), partial);
+  return result;
+}
+
+
+inline void
+ThreadPool::push(
+  size_t const w,
+  Task const& task)
+{
+  auto& worker = *workers_[w];
+  std::lock_guard<std::mutex> lock(worker.mutex);
+  worker.tasks.push_back(task);
+}
+
+
+inline bool
+ThreadPool::pop(
+  size_t const w,
+  Task& task)
+{
+  auto& worker = *workers_[w];
+  std::lock_guard<std::mutex> lock(worker.mutex);
+  if (worker.tasks.empty())
+    return false;
+  task = worker.tasks.back();
+  worker.tasks.pop_back();
+  return true;
+}
+
+
+inline bool
+ThreadPool::steal(
+  size_t const w,
+  Task& task)
+{
+  for (auto const v : workers_[w]->victims) {
+    auto& victim = *workers_[v];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = victim.tasks.front();
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+
+inline void
+ThreadPool::run(
+  size_t const w,
+  Task task)
+{
+  auto* const job = task.job;
+  while (task.end - task.begin > job->grain) {
+    auto const mid = task.begin + (task.end - task.begin) / 2;
+    push(w, {job, mid, task.end});
+    task.end = mid;
+  }
+  job->fn(job->ctx, task.begin, task.end);
+  job->remaining.fetch_sub(task.end - task.begin, std::memory_order_release);
+}
+
+
+inline void
+ThreadPool::work(
+  size_t const w)
+{
+  current() = {this, w};
+
+  Task task;
+  for (;;) {
+    if (pop(w, task) || steal(w, task))
+      run(w, task);
+    else {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (num_jobs_ > 0) {
+        // A job is running but there's nothing to steal right now.
+        lock.unlock();
+        std::this_thread::yield();
+        continue;
+      }
+      cv_.wait(lock, [this] { return stop_ || num_jobs_ > 0; });
+      if (stop_)
+        return;
+    }
+  }
+}
+
+
+/**
+ * Like `ThreadPool::parallel_reduce()`, but runs serially if `pool` is null.
+ * The chunks and fold order are the same either way, and so is the result.
+ */
+template<class T, class MAP, class COMBINE>
+inline T
+parallel_reduce(
+  ThreadPool* const pool,
+  size_t const begin,
+  size_t const end,
+  size_t grain,
+  T init,
+  MAP&& map,
+  COMBINE&& combine)
+{
+  if (pool != nullptr)
+    return pool->parallel_reduce(begin, end, grain, init, map, combine);
+
+  grain = std::max<size_t>(grain, 1);
+  auto result = init;
+  for (size_t start = begin; start < end; start += grain)
+    result = combine(
+      std::move(result), map(start, std::min(start + grain, end)));
+  return result;
+}
+
+
@@ -0,0 +1,415 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+/**
+ * Streaming summaries of values in bounded memory, which merge, so that
+ * chunks of records can be summarized in parallel and combined.
+ */
+
+//------------------------------------------------------------------------------
+
+/**
+ * The K greatest values added, by LESS.  Of values that compare equal, the
+ * ones added first are kept, so that merging summaries of consecutive values
+ * keeps the same values as adding them all to one.
+ *
+ * Values are kept in a min-heap, with the order in which they were added to
+ * break ties, so that an add that doesn't displace one is a single
+ * comparison.  Trivially copyable if T is.
+ */
+template<class T, size_t K, class LESS=std::less<T>>
+class TopK
+{
+public:
+
+  size_t size() const { return size_; }
+
+  void
+  add(
+    T const& val)
+  {
+    Entry const entry{val, seq_++};
+    if (size_ < K) {
+      heap_[size_++] = entry;
+      std::push_heap(heap_.begin(), heap_.begin() + size_, before);
+    }
+    // A value equal to the least is added later, so doesn't displace it.
+    else if (LESS()(heap_[0].val, val)) {
+      std::pop_heap(heap_.begin(), heap_.end(), before);
+      heap_[K - 1] = entry;
+      std::push_heap(heap_.begin(), heap_.end(), before);
+    }
+  }
+
+  /**
+   * Adds the values of `later`, a summary of values added after these.
+   */
+  void
+  merge(
+    TopK const& later)
+  {
+    // Add in the order kept, so ties stay in the order they were added.
+    for (auto const& val : later.get())
+      add(val);
+  }
+
+  /**
+   * Returns the values, greatest first, and of equal values, the first added
+   * first.
+   */
+  std::vector<T>
+  get()
+    const
+  {
+    std::vector<Entry> entries(heap_.begin(), heap_.begin() + size_);
+    std::sort(entries.begin(), entries.end(), before);
+    std::vector<T> vals;
+    vals.reserve(size_);
+    for (auto const& entry : entries)
+      vals.push_back(entry.val);
+    return vals;
+  }
+
+private:
+
+  struct Entry
+  {
+    T val;
+    uint64_t seq;
+  };
+
+  /**
+   * True if `e0` is kept in preference to `e1`: it is greater, or equal and
+   * added first.  As the heap's order, this puts the entry to displace next
+   * on top.
+   */
+  static bool
+  before(
+    Entry const& e0,
+    Entry const& e1)
+  {
+    return
+      LESS()(e1.val, e0.val) || (!LESS()(e0.val, e1.val) && e0.seq < e1.seq);
+  }
+
+  std::array<Entry, K> heap_;
+  size_t size_ = 0;
+  uint64_t seq_ = 0;
+
+};
+
+
+//------------------------------------------------------------------------------
+
+// Default accuracy parameter for quantile sketches.
+size_t constexpr QUANTILE_K = 128;
+
+/**
+ * Approximate quantiles of a stream of values, with a KLL sketch.
+ *
+ * Values are kept in levels of compactors; a value at level h stands for 2^h
+ * values added.  When the sketch is full, the lowest full level is sorted, and
+ * every other value, starting at a random offset, is promoted to the next
+ * level.  The capacity of each level shrinks geometrically below the top, so
+ * the sketch retains about 3k values however many are added, and the rank
+ * error of a quantile is about 1.7/k with high probability.
+ *
+ * Sketches merge by concatenating levels and compacting.  The coin flips come
+ * from a fixed seed, so a sketch of the same values added and merged in the
+ * same order is the same, as for the other scans here.
+ */
+template<class T>
+class QuantileSketch
+{
+public:
+
+  QuantileSketch(
+    size_t const k=QUANTILE_K)
+  : k_(k)
+  {
+    assert(k_ >= MIN_CAPACITY);
+  }
+
+  /**
+   * The number of values added.
+   */
+  uint64_t count() const { return count_; }
+
+  /**
+   * The number of values retained.
+   */
+  size_t size() const { return size_; }
+
+  void
+  add(
+    T const val)
+  {
+    if (levels_.empty())
+      add_level();
+    levels_[0].push_back(val);
+    ++count_;
+    if (++size_ > capacity_)
+      compress();
+  }
+
+  void
+  merge(
+    QuantileSketch const& other)
+  {
+    while (levels_.size() < other.levels_.size())
+      add_level();
+    for (size_t h = 0; h < other.levels_.size(); ++h)
+      levels_[h].insert(
+        levels_[h].end(), other.levels_[h].begin(), other.levels_[h].end());
+    count_ += other.count_;
+    size_ += other.size_;
+    while (size_ > capacity_)
+      compress();
+  }
+
+  /**
+   * Returns the approximate `q` quantile, for q in [0, 1].  The sketch must
+   * not be empty.
+   */
+  T
+  get_quantile(
+    double const q)
+    const
+  {
+    assert(count_ > 0);
+    std::vector<std::pair<T, uint64_t>> vals;
+    vals.reserve(size_);
+    for (size_t h = 0; h < levels_.size(); ++h)
+      for (auto const val : levels_[h])
+        vals.emplace_back(val, uint64_t{1} << h);
+    std::sort(
+      vals.begin(), vals.end(),
+      [](auto const& v0, auto const& v1) { return v0.first < v1.first; });
+
+    // The first value whose cumulative weight reaches rank q.
+    auto const rank = std::max<double>(q * count_, 1);
+    uint64_t weight = 0;
+    for (auto const& val : vals)
+      if ((weight += val.second) >= rank)
+        return val.first;
+    return vals.back().first;
+  }
+
+private:
+
+  // Smallest capacity of a level; a level must hold a pair to compact.
+  static size_t constexpr MIN_CAPACITY = 2;
+
+  /**
+   * Capacity of level `h`, as a fraction (2/3)^d of k for a level d from the
+   * top.
+   */
+  size_t
+  get_capacity(
+    size_t const h)
+    const
+  {
+    auto const depth = levels_.size() - 1 - h;
+    return std::max<size_t>(
+      MIN_CAPACITY, std::ceil(k_ * std::pow(2. / 3, depth)));
+  }
+
+  void
+  add_level()
+  {
+    levels_.emplace_back();
+    capacity_ = 0;
+    for (size_t h = 0; h < levels_.size(); ++h)
+      capacity_ += get_capacity(h);
+  }
+
+  bool
+  flip()
+  {
+    // xorshift64.
+    rng_ ^= rng_ << 13;
+    rng_ ^= rng_ >> 7;
+    rng_ ^= rng_ << 17;
+    return rng_ & 1;
+  }
+
+  /**
+   * Compacts the lowest level that is at capacity.
+   */
+  void
+  compress()
+  {
+    size_t h = 0;
+    while (levels_[h].size() < get_capacity(h))
+      ++h;
+    if (h + 1 == levels_.size())
+      add_level();
+
+    auto& level = levels_[h];
+    std::sort(level.begin(), level.end());
+    // With an odd number, one value stays behind, so weight is conserved.
+    auto const keep = level.size() % 2;
+    auto& next = levels_[h + 1];
+    for (size_t i = keep + flip(); i < level.size(); i += 2)
+      next.push_back(level[i]);
+    size_ -= level.size() - keep - (level.size() - keep) / 2;
+    level.resize(keep);
+  }
+
+  size_t k_;
+  std::vector<std::vector<T>> levels_;
+  // Total capacity of the levels.
+  size_t capacity_ = 0;
+  uint64_t count_ = 0;
+  size_t size_ = 0;
+  uint64_t rng_ = 0x9e3779b97f4a7c15;
+
+};
+
+
+template<class T>
+size_t constexpr QuantileSketch<T>::MIN_CAPACITY;
+
+
+//------------------------------------------------------------------------------
+
+/**
+ * Approximate count of distinct values, with a HyperLogLog sketch of 2^P
+ * registers.  Values are added by 64-bit hash, which must be well mixed.
+ *
+ * The relative error of the count is about 1.04/sqrt(2^P).  Sketches merge by
+ * taking the maximum of each register, so the count of a union needs only
+ * the sketches of its parts.  Trivially copyable, so it can be written to a
+ * file as is.
+ */
+template<unsigned P>
+class HyperLogLog
+{
+public:
+
+  static_assert(4 <= P && P <= 18, "precision out of range");
+  static size_t constexpr NUM_REGISTERS = size_t{1} << P;
+
+  void
+  add_hash(
+    uint64_t const hash)
+  {
+    auto const r = hash >> (64 - P);
+    auto const rest = hash << P;
+    // Position of the first one bit in the rest of the hash.
+    uint8_t const rank = rest == 0 ? 64 - P + 1 : __builtin_clzll(rest) + 1;
+    registers_[r] = std::max(registers_[r], rank);
+  }
+
+  void
+  merge(
+    HyperLogLog const& other)
+  {
+    for (size_t r = 0; r < NUM_REGISTERS; ++r)
+      registers_[r] = std::max(registers_[r], other.registers_[r]);
+  }
+
+  double
+  get_count()
+    const
+  {
+    double const m = NUM_REGISTERS;
+    double sum = 0;
+    size_t zeros = 0;
+    for (auto const reg : registers_) {
+      sum += std::ldexp(1., -reg);
+      zeros += reg == 0;
+    }
+    double const count = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    // For small counts, linear counting of empty registers is more accurate.
+    return count <= 2.5 * m && zeros > 0 ? m * std::log(m / zeros) : count;
+  }
+
+private:
+
+  std::array<uint8_t, NUM_REGISTERS> registers_ = {};
+
+};
+
+
+template<unsigned P>
+size_t constexpr HyperLogLog<P>::NUM_REGISTERS;
+
+
+//------------------------------------------------------------------------------
+
+/**
+ * Set membership with false positives, with a Bloom filter of `BITS` bits and
+ * `HASHES` hash functions.  Values are added by 64-bit hash, which must be
+ * well mixed.
+ *
+ * For n values, the false positive rate is about (1 - e^(-HASHES n / BITS))
+ * ^ HASHES.  Filters of the same size merge by union.  Trivially copyable.
+ */
+template<size_t BITS, unsigned HASHES>
+class BloomFilter
+{
+public:
+
+  static_assert(BITS >= 64 && (BITS & (BITS - 1)) == 0, "BITS power of 2");
+
+  void
+  add_hash(
+    uint64_t const hash)
+  {
+    for (unsigned i = 0; i < HASHES; ++i) {
+      auto const bit = get_bit(hash, i);
+      words_[bit / 64] |= uint64_t{1} << (bit % 64);
+    }
+  }
+
+  /**
+   * False if no value with `hash` was added.
+   */
+  bool
+  may_contain(
+    uint64_t const hash)
+    const
+  {
+    for (unsigned i = 0; i < HASHES; ++i) {
+      auto const bit = get_bit(hash, i);
+      if (!(words_[bit / 64] & (uint64_t{1} << (bit % 64))))
+        return false;
+    }
+    return true;
+  }
+
+  void
+  merge(
+    BloomFilter const& other)
+  {
+    for (size_t w = 0; w < words_.size(); ++w)
+      words_[w] |= other.words_[w];
+  }
+
+private:
+
+  static size_t
+  get_bit(
+    uint64_t const hash,
+    unsigned const i)
+  {
+    // Double hashing; an odd step visits distinct bits.  Positions come from
+    // the high half, as the low bits of a hash often pick a hash partition.
+    return ((hash >> 32) + i * ((uint32_t) hash | 1)) & (BITS - 1);
+  }
+
+  std::array<uint64_t, BITS / 64> words_ = {};
+
+};
+
+
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <cstddef>
+
+//------------------------------------------------------------------------------
+
+/**
+ * Summation algorithms for floating point reductions.
+ *
+ * - NAIVE adds values into a single accumulator, in order.  Fastest, but the
+ *   error grows linearly with length.
+ *
+ * - PAIRWISE adds blocks of values into `SUM_LANES` accumulators, and sums
+ *   the blocks recursively in pairs.  Nearly as fast; error grows with the log
+ *   of the length.
+ *
+ * - KAHAN uses compensated summation in `SUM_LANES` independent lanes, and
+ *   combines the lanes with compensation.  Error is independent of length.
+ *
+ * The lane count is a fixed constant, not the machine's SIMD width, and no
+ * algorithm depends on the compiler reassociating floating point operations.
+ * So each produces bit-identical results on any machine for the same input.
+ *
+ * When `get(i)` is a load from contiguous memory, the compiler packs the
+ * lanes of PAIRWISE and KAHAN into SIMD registers; with a runtime stride,
+ * they stay scalar.
+ */
+enum class Summation
+{
+  NAIVE,
+  PAIRWISE,
+  KAHAN,
+};
+
+
+size_t constexpr SUM_LANES = 8;
+
+// Length at or below which pairwise summation sums directly.
+size_t constexpr PAIRWISE_BLOCK = 128;
+
+//------------------------------------------------------------------------------
+
+/**
+ * A compensated (Kahan) running sum.
+ */
+template<class T>
+struct Compensated
+{
+  T sum = 0;
+  T c = 0;
+
+  inline void
+  add(
+    T const val)
+  {
+    T const y = val - c;
+    T const t = sum + y;
+    c = (t - sum) - y;
+    sum = t;
+  }
+
+  inline void
+  add(
+    Compensated const& other)
+  {
+    add(other.sum);
+    add(-other.c);
+  }
+
+  T get() const { return sum - c; }
+};
+
+
+//------------------------------------------------------------------------------
+
+/**
+ * Sums `get(i)` for i in [0, length) naively.
+ */
+template<class T, class GET>
+inline T
+sum_naive(
+  size_t const length,
+  GET&& get)
+{
+  T sum = 0;
+  for (size_t i = 0; i < length; ++i)
+    sum += get(i);
+  return sum;
+}
+
+
+/**
+ * Sums `get(i)` for i in [start, stop) pairwise.
+ */
+template<class T, class GET>
+inline T
+sum_pairwise(
+  size_t const start,
+  size_t const stop,
+  GET&& get)
+{
+  auto const length = stop - start;
+  if (length <= PAIRWISE_BLOCK) {
+    T lanes[SUM_LANES] = {};
+    size_t i = start;
+    for (; i + SUM_LANES <= stop; i += SUM_LANES)
+      for (size_t l = 0; l < SUM_LANES; ++l)
+        lanes[l] += get(i + l);
+    for (size_t l = 0; l < SUM_LANES && i < stop; ++i, ++l)
+      lanes[l] += get(i);
+    T sum = 0;
+    for (size_t l = 0; l < SUM_LANES; ++l)
+      sum += lanes[l];
+    return sum;
+  }
+  else {
+    // Split on a multiple of the block size.
+    auto const mid
+      = start + (length / 2 + PAIRWISE_BLOCK - 1) / PAIRWISE_BLOCK
+                * PAIRWISE_BLOCK;
+    return sum_pairwise<T>(start, mid, get) + sum_pairwise<T>(mid, stop, get);
+  }
+}
+
+
+/**
+ * Sums `get(i)` for i in [0, length) with compensation.
+ */
+template<class T, class GET>
+inline Compensated<T>
+sum_kahan(
+  size_t const length,
+  GET&& get)
+{
+  T sums[SUM_LANES] = {};
+  T cs[SUM_LANES] = {};
+  size_t i = 0;
+  for (; i + SUM_LANES <= length; i += SUM_LANES)
+    for (size_t l = 0; l < SUM_LANES; ++l) {
+      T const y = get(i + l) - cs[l];
+      T const t = sums[l] + y;
+      cs[l] = (t - sums[l]) - y;
+      sums[l] = t;
+    }
+
+  Compensated<T> sum;
+  for (size_t l = 0; l < SUM_LANES; ++l)
+    sum.add(Compensated<T>{sums[l], cs[l]});
+  for (; i < length; ++i)
+    sum.add(get(i));
+  return sum;
+}
+
+
+/**
+ * Sums `get(i)` for i in [0, length) with the given algorithm.
+ */
+template<class T, class GET>
+inline T
+sum_with(
+  Summation const summation,
+  size_t const length,
+  GET&& get)
+{
+  switch (summation) {
+  case Summation::PAIRWISE:
+    return sum_pairwise<T>(0, length, get);
+  case Summation::KAHAN:
+    return sum_kahan<T>(length, get).get();
+  case Summation::NAIVE:
+  default:
+    return sum_naive<T>(length, get);
+  }
+}
+
+
+/**
+ * Sums `get(i)` for i in [0, length) with the given algorithm, keeping the
+ * compensation of a Kahan sum so that partial sums combine without losing it.
+ */
+template<class T, class GET>
+inline Compensated<T>
+sum_compensated(
+  Summation const summation,
+  size_t const length,
+  GET&& get)
+{
+  return
+    summation == Summation::KAHAN
+    ? sum_kahan<T>(length, get)
+    : Compensated<T>{sum_with<T>(summation, length, get), 0};
+}
+
+
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <time.h>
+
+//------------------------------------------------------------------------------
+
+/**
+ * Returns the time in seconds on a monotonic clock, for timing benchmarks.
+ */
+inline double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1E-9;
+}
+
+